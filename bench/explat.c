@@ -0,0 +1,316 @@
+/*
+Port expander latency and CPU check for retrogame: userspace expander
+handling (IRQ command) against the kernel driver (GPIOCHIP command).
+Needs a loopback wire from a spare native GPIO to an expander input; this
+program drives that GPIO low and high (button press and release) through
+Sysfs, and times each from the write to the key event on retrogame's
+virtual device.  It also totals the CPU time of retrogame plus all kernel
+IRQ threads over the run, since in kernel mode the chip is serviced in
+the driver's threaded IRQ handler instead of in retrogame.
+
+Run it once per mode, with the expander set up to match:
+
+  userspace  -i gpio given: expander INT wired to that GPIO, no kernel
+             driver bound to the chip (retrogame uses /dev/i2c-1)
+  kernel     No -i: chip bound to its driver by an overlay, e.g.
+             dtoverlay=mcp23017,addr=0x20,gpiopin=17
+
+Latency includes the debounce time (20 ms), the same in both modes.
+
+Usage: explat [-t seconds] [-a addr] [-c chip] [-i gpio] [-v] -o gpio
+              -p pin retrogame
+
+  -t  Length of run (default 10 seconds)
+  -a  Expander I2C address (default 0x20)
+  -c  Chip type for the IRQ command (default MCP23017)
+  -i  Userspace mode: GPIO wired to the expander's INT output
+  -o  Native GPIO wired to the expander input (driven by this program)
+  -p  retrogame pin number of that expander input (e.g. 32)
+  -v  Show retrogame's output
+
+Run as root.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_PRESS 10000 // Max presses timed
+
+static char     dir[] = "/tmp/explatXXXXXX";
+static int      runSec = 10, verbose = 0;
+static uint32_t seed = 12345;
+
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+static int64_t usNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void sleepUntil(int64_t us) {
+	struct timespec t = { us / 1000000, us % 1000000 * 1000 };
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) ==
+	  EINTR);
+}
+
+static int sysfsWrite(const char *path, const char *str) {
+	int fd, ok = 0;
+	if((fd = open(path, O_WRONLY)) >= 0) {
+		ok = write(fd, str, strlen(str)) == (ssize_t)strlen(str);
+		close(fd);
+	}
+	return ok;
+}
+
+// Export loopback GPIO as an output, released (high); returns its value
+// file descriptor or -1
+static int outOpen(int gpio) {
+	char path[64], num[16];
+	int  i;
+	sprintf(num, "%d", gpio);
+	sysfsWrite("/sys/class/gpio/export", num);
+	sprintf(path, "/sys/class/gpio/gpio%d/direction", gpio);
+	for(i=0; (i<100) && !sysfsWrite(path, "high"); i++) usleep(10000);
+	sprintf(path, "/sys/class/gpio/gpio%d/value", gpio);
+	return open(path, O_WRONLY);
+}
+
+static void outClose(int gpio) {
+	char path[64], num[16];
+	sprintf(path, "/sys/class/gpio/gpio%d/direction", gpio);
+	sysfsWrite(path, "in");
+	sprintf(num, "%d", gpio);
+	sysfsWrite("/sys/class/gpio/unexport", num);
+}
+
+// Write config into dir: one button on the expander pin
+static int setup(int irq, int addr, const char *chip, int pin) {
+	char  path[128];
+	FILE *fp;
+
+	sprintf(path, "%s/retrogame.cfg", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "DEBUG %d\n", verbose ? 2 : 0);
+	if(irq >= 0) fprintf(fp, "IRQ %d 0x%02X %s\n", irq, addr, chip);
+	else         fprintf(fp, "GPIOCHIP 0x%02X\n", addr);
+	fprintf(fp, "BTN_SOUTH %d\n", pin);
+	return fclose(fp);
+}
+
+// Find and open retrogame's virtual device, event times on CLOCK_MONOTONIC
+static int devOpen(void) {
+	struct dirent *d;
+	DIR           *dp;
+	char           path[300], name[64];
+	int            fd = -1, clk = CLOCK_MONOTONIC, i;
+
+	for(i=0; (fd < 0) && (i<500); i++) { // Up to 5 seconds
+		if(i) usleep(10000);
+		if(!(dp = opendir("/dev/input"))) continue;
+		while((fd < 0) && (d = readdir(dp))) {
+			if(strncmp(d->d_name, "event", 5)) continue;
+			sprintf(path, "/dev/input/%s", d->d_name);
+			if((fd = open(path, O_RDONLY | O_NONBLOCK)) < 0)
+				continue;
+			if((ioctl(fd, EVIOCGNAME(sizeof(name)), name) < 0) ||
+			   strcmp(name, "retrogame")) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		closedir(dp);
+	}
+	if(fd >= 0) ioctl(fd, EVIOCSCLOCKID, &clk);
+	return fd;
+}
+
+// Wait (up to 200 ms) for key event on dev; returns its time or -1
+static int64_t await(int dev, int value) {
+	struct pollfd      pf = { dev, POLLIN, 0 };
+	struct input_event e;
+	int64_t            end = usNow() + 200000;
+	while(poll(&pf, 1, (end - usNow()) / 1000 + 1) > 0) {
+		while(read(dev, &e, sizeof(e)) == sizeof(e)) {
+			if((e.type == EV_KEY) && (e.code == BTN_SOUTH) &&
+			   (e.value == value))
+				return e.input_event_sec * 1000000LL +
+				  e.input_event_usec;
+		}
+		if(usNow() > end) break;
+	}
+	return -1;
+}
+
+// CPU time (clock ticks) from /proc/<name>/stat; irq = only if it's a
+// kernel IRQ thread (irq/N-name)
+static long statTicks(const char *name, int irq) {
+	char path[300], buf[512], *s;
+	long ut, st;
+	int  fd, n;
+
+	sprintf(path, "/proc/%s/stat", name);
+	if((fd = open(path, O_RDONLY)) < 0) return 0;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if(n <= 0) return 0;
+	buf[n] = 0;
+	if(irq && !strstr(buf, "(irq/")) return 0;
+	// After the ')' closing comm: state is field 3, utime and stime
+	// are 14 and 15
+	if(!(s = strrchr(buf, ')')) ||
+	   (sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+	   "%ld %ld", &ut, &st) != 2)) return 0;
+	return ut + st;
+}
+
+// CPU time (clock ticks) of process pid plus, separately, all kernel IRQ
+// threads
+static void cpuTicks(pid_t pid, long *proc, long *irq) {
+	struct dirent *d;
+	DIR           *dp;
+	char           name[16];
+
+	sprintf(name, "%d", pid);
+	*proc = statTicks(name, 0);
+	*irq  = 0;
+	if(!(dp = opendir("/proc"))) return;
+	while((d = readdir(dp))) {
+		if((d->d_name[0] >= '1') && (d->d_name[0] <= '9'))
+			*irq += statTicks(d->d_name, 1);
+	}
+	closedir(dp);
+}
+
+static int cmp(const void *a, const void *b) {
+	int64_t d = *(int64_t *)a - *(int64_t *)b;
+	return (d > 0) - (d < 0);
+}
+
+static void report(const char *label, int64_t *lat, int n, int lost) {
+	qsort(lat, n, sizeof(lat[0]), cmp);
+	if(n) printf("%-10s %8d %8.2f %8.2f %8.2f %8.2f %6d\n", label, n,
+	  lat[n / 2] / 1e3, lat[n * 95 / 100] / 1e3, lat[n * 99 / 100] / 1e3,
+	  lat[n - 1] / 1e3, lost);
+}
+
+static int unlinkCb(const char *path, const struct stat *st, int flag,
+  struct FTW *f) {
+	return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+	static int64_t press[MAX_PRESS], release[MAX_PRESS];
+	char           cfg[128], *chip = "MCP23017";
+	char          *args[] = { NULL, cfg, NULL };
+	int            c, fd, out, dev, nP = 0, nR = 0, lostP = 0, lostR = 0,
+	               irq = -1, outGpio = -1, pin = -1, addr = 0x20;
+	long           rgCpu, irqCpu, rg0, irq0, hz = sysconf(_SC_CLK_TCK);
+	int64_t        t, k, end;
+	pid_t          pid;
+
+	while((c = getopt(argc, argv, "t:a:c:i:o:p:v")) != -1) {
+		switch(c) {
+		   case 't': runSec  = atoi(optarg);           break;
+		   case 'a': addr    = strtol(optarg, NULL, 0); break;
+		   case 'c': chip    = optarg;                 break;
+		   case 'i': irq     = atoi(optarg);           break;
+		   case 'o': outGpio = atoi(optarg);           break;
+		   case 'p': pin     = atoi(optarg);           break;
+		   case 'v': verbose = 1;                      break;
+		   default:  optind  = argc + 1;               break;
+		}
+	}
+	if((optind != argc - 1) || (runSec < 1) || (outGpio < 0) ||
+	   (pin < 32) || (pin > 159)) {
+		fprintf(stderr, "Usage: %s [-t seconds] [-a addr] [-c chip] "
+		  "[-i gpio] [-v] -o gpio -p pin retrogame\n", argv[0]);
+		return 1;
+	}
+	if(!mkdtemp(dir) || setup(irq, addr, chip, pin)) {
+		fprintf(stderr, "%s: can't write config\n", argv[0]);
+		return 1;
+	}
+	if((out = outOpen(outGpio)) < 0) {
+		fprintf(stderr, "%s: can't drive GPIO%d (run as root?)\n",
+		  argv[0], outGpio);
+		goto done;
+	}
+
+	sprintf(cfg, "%s/retrogame.cfg", dir);
+	args[0] = argv[optind];
+	if((pid = fork()) < 0) goto done;
+	if(!pid) {
+		if(!verbose && ((fd = open("/dev/null", O_WRONLY)) >= 0)) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+		setpgid(0, 0); // Not foreground, so no debug output
+		execv(args[0], args);
+		_exit(127);
+	}
+	if((dev = devOpen()) < 0) {
+		fprintf(stderr, "%s: '%s' failed (try -v)\n", argv[0], args[0]);
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		goto done;
+	}
+	sleepUntil(usNow() + 500000); // Settle
+
+	cpuTicks(pid, &rg0, &irq0);
+	for(end = usNow() + runSec * 1000000LL; usNow() < end; ) {
+		sleepUntil(usNow() + 10000 + rnd(20000));
+		t = usNow();
+		if(write(out, "0", 1) != 1) break; // Press
+		if((k = await(dev, 1)) < 0) lostP++;
+		else if(nP < MAX_PRESS) press[nP++] = k - t;
+		sleepUntil(usNow() + 5000 + rnd(20000));
+		t = usNow();
+		write(out, "1", 1);                // Release
+		if((k = await(dev, 0)) < 0) lostR++;
+		else if(nR < MAX_PRESS) release[nR++] = k - t;
+	}
+	cpuTicks(pid, &rgCpu, &irqCpu);
+	rgCpu  -= rg0;
+	irqCpu -= irq0;
+
+	printf("%s mode, %s at 0x%02X\n", (irq >= 0) ? "userspace" : "kernel",
+	  (irq >= 0) ? chip : "expander", addr);
+	printf("%-10s %8s %8s %8s %8s %8s %6s\n", "edge", "count", "p50 ms",
+	  "p95 ms", "p99 ms", "max ms", "lost");
+	report("press", press, nP, lostP);
+	report("release", release, nR, lostR);
+	printf("CPU: retrogame %ld ms, IRQ threads %ld ms (%.3f ms per press)\n",
+	  rgCpu * 1000 / hz, irqCpu * 1000 / hz,
+	  nP ? (rgCpu + irqCpu) * 1000.0 / hz / nP : 0.0);
+
+	close(dev);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+  done:
+	if(out >= 0) {
+		close(out);
+		outClose(outGpio);
+	}
+	nftw(dir, unlinkCb, 8, FTW_DEPTH | FTW_PHYS);
+	return (lostP || lostR) ? 1 : 0;
+}
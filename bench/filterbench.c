@@ -0,0 +1,234 @@
+/*
+Jitter and lag benchmark for retrogame's analog smoothing (config file
+FILTER command).  Runs stick traces through the same fixed-point One-Euro
+filter and threshold code retrogame uses, and compares raw samples, a
+plain EMA (beta = 0, i.e. fixed cutoff) and the One-Euro filter:
+
+  rest rms    Output deviation (ADC units) from local mean while at rest
+  rest chg/s  Output changes per second at rest (= EV_ABS event rate)
+  presses     Threshold-pin presses (raw excess over filtered = chatter)
+  lag avg/max Milliseconds from raw threshold press to filtered press
+
+Usage: filterbench [-b bits] [-r rate] [-m mincut] [-k beta] [-d dcut]
+                   [trace ...]
+
+Trace files are text, one sample per line, recorded at 'rate' scans/sec
+(default 1000) from an ADC of 'bits' resolution (default 10).  With no
+trace arguments a synthetic 20 second trace is used: a noisy centered
+stick (with occasional wiper spikes), fast flicks to either end, hovering
+near a threshold and a slow sweep.  Filter parameters default to the retrogame FILTER defaults.
+
+Build on the Pi with 'make filterbench'.
+*/
+
+#define _GNU_SOURCE // Before any header, else retrogame.c's comes too late
+#include <limits.h>
+#include <math.h>
+
+#define main retrogame_main
+#include "../retrogame.c"
+#undef main
+
+#define MAXSAMPLES 1000000
+#define REST_SPAN  32 // Samples in window for rest detection
+
+static int *trace, nSamples;
+
+// Reproducible noise: LCG, approx. gaussian from sum of 4 uniforms
+static uint32_t seed = 12345;
+static double noise(double sigma) {
+	double sum = 0.0;
+	for(int i=0; i<4; i++) {
+		seed  = seed * 1664525 + 1013904223;
+		sum  += (seed >> 8) / 16777216.0 - 0.5;
+	}
+	return sum * sigma * 1.732;
+}
+
+// Append one sample, clipped to ADC range; 1 in 200 is a spike
+static void add(double v) {
+	int full = (1 << adcBits) - 1, i;
+	seed = seed * 1664525 + 1013904223;
+	if(!((seed >> 8) % 200)) v += ((seed & 0x100) ? 0.2 : -0.2) * full;
+	i = (int)(v + 0.5);
+	if(nSamples >= MAXSAMPLES) return;
+	trace[nSamples++] = (i < 0) ? 0 : (i > full) ? full : i;
+}
+
+// Move from a to b over 'ms' milliseconds (plus noise)
+static void ramp(double a, double b, int ms, double sigma) {
+	int n = ms * adcRate / 1000;
+	for(int i=0; i<n; i++) add(a + (b - a) * i / n + noise(sigma));
+}
+
+static void synthesize(void) {
+	double full = (1 << adcBits) - 1, mid = full / 2, sigma = full / 400;
+	int    i;
+
+	nSamples = 0;
+	ramp(mid, mid, 2000, sigma);                   // Rest
+	for(i=0; i<12; i++) {                          // Flicks
+		double end = (i & 1) ? full : 0;
+		ramp(mid, end, 15, sigma);
+		ramp(end, end, 150, sigma);
+		ramp(end, mid, 15, sigma);
+		ramp(mid, mid, 350, sigma);
+	}
+	ramp(mid, full / 4, 200, sigma);               // Hover at threshold
+	ramp(full / 4, full / 4, 2000, sigma * 2);
+	ramp(full / 4, mid, 200, sigma);
+	ramp(mid, mid, 2000, sigma);                   // Rest
+	ramp(mid, 0, 3000, sigma);                     // Slow sweep
+	ramp(0, full, 6000, sigma);
+}
+
+static bool loadTrace(char *name) {
+	FILE *fp;
+	char  line[80];
+	if(!(fp = fopen(name, "r"))) return false;
+	nSamples = 0;
+	while(fgets(line, sizeof(line), fp) && (nSamples < MAXSAMPLES))
+		trace[nSamples++] = atoi(line);
+	fclose(fp);
+	return nSamples > 0;
+}
+
+// Threshold pin states (bit 0 = low, 1 = high) after sample v, using
+// retrogame's hysteresis
+static int pins(int v, uint32_t *state) {
+	intstate[ADC_PIN0 / 32] = *state;
+	adcThreshold(0, v);
+	return (*state = intstate[ADC_PIN0 / 32]) & 3;
+}
+
+static void run(char *name, char *label, double mincut, double beta,
+  double dcut) {
+	euroFilter f;
+	uint32_t   rawState = 0, outState = 0;
+	int        i, j, k, v, prevOut = -1, rawPins, outPins,
+	           lo, hi, sum, restN = 0, restChg = 0, rawPress = 0,
+	           outPress = 0, pending[2] = { -1, -1 }, lagN = 0,
+	           lagMax = 0, prevRaw = 0, prevPins = 0;
+	int32_t    dt = 1000000 / adcRate;
+	double     lagSum = 0.0, restSq = 0.0;
+
+	memset(&f, 0, sizeof(f));
+	f.minCut = mincut * 1000.0;
+	f.beta   = beta   * 1000.0;
+	f.dCut   = dcut   * 1000.0;
+	f.x      = -1;
+
+	for(i=0; i<nSamples; i++) {
+		v = euroStep(&f, trace[i], dt);
+
+		// Rest = middle half of raw window (spikes excluded) spans
+		// under 3% of range, compared against window mean
+		lo = INT_MAX;
+		hi = INT_MIN;
+		for(sum=0, j=i-REST_SPAN/2; j<i+REST_SPAN/2; j++) {
+			k    = trace[(j < 0) ? 0 :
+			  (j >= nSamples) ? nSamples-1 : j];
+			sum += k;
+			if((j >= i - REST_SPAN/4) && (j < i + REST_SPAN/4)) {
+				if(k < lo) lo = k;
+				if(k > hi) hi = k;
+			}
+		}
+		if((hi - lo) * 100 < (3 << adcBits)) {
+			double d = v - (double)sum / REST_SPAN;
+			restN++;
+			restSq += d * d;
+			if((prevOut >= 0) && (v != prevOut)) restChg++;
+		}
+		prevOut = v;
+
+		rawPins = pins(trace[i], &rawState);
+		outPins = pins(v, &outState);
+		for(k=0; k<2; k++) {
+			int b = 1 << k;
+			if((rawPins & b) && !(prevRaw & b)) {
+				rawPress++;
+				if((pending[k] < 0) && !(outPins & b))
+					pending[k] = i;
+			} else if(!(rawPins & b) && !(outPins & b)) {
+				pending[k] = -1; // Raw blip filtered out
+			}
+			if((outPins & b) && !(prevPins & b)) {
+				outPress++;
+				if(pending[k] >= 0) {
+					int lag = i - pending[k];
+					lagSum += lag;
+					if(lag > lagMax) lagMax = lag;
+					lagN++;
+					pending[k] = -1;
+				}
+			}
+		}
+		prevRaw  = rawPins;
+		prevPins = outPins;
+	}
+
+	printf("%-14.14s %-16s %6.1f %10.1f %8d %8.1f %8.1f\n", name, label,
+	  restN ? sqrt(restSq / restN) : 0.0,
+	  restN ? restChg * (double)adcRate / restN : 0.0,
+	  mincut ? outPress : rawPress,
+	  lagN ? lagSum * 1000.0 / adcRate / lagN : 0.0,
+	  lagMax * 1000.0 / adcRate);
+}
+
+static void runAll(char *name, double mincut, double beta, double dcut) {
+	char label[64];
+	run(name, "raw", 0.0, 0.0, 0.0);
+	sprintf(label, "ema %g", mincut);
+	run(name, label, mincut, 0.0, dcut);
+	sprintf(label, "1euro %g/%g/%g", mincut, beta, dcut);
+	run(name, label, mincut, beta, dcut);
+}
+
+int main(int argc, char *argv[]) {
+	double mincut = FILTER_MINCUT, beta = FILTER_BETA, dcut = FILTER_DCUT;
+	int    c;
+
+	adcBits = 10;
+	while((c = getopt(argc, argv, "b:r:m:k:d:")) != -1) {
+		switch(c) {
+		   case 'b': adcBits = atoi(optarg);   break;
+		   case 'r': adcRate = atoi(optarg);   break;
+		   case 'm': mincut  = atof(optarg);   break;
+		   case 'k': beta    = atof(optarg);   break;
+		   case 'd': dcut    = atof(optarg);   break;
+		   default:
+			fprintf(stderr, "Usage: %s [-b bits] [-r rate] "
+			  "[-m mincut] [-k beta] [-d dcut] [trace ...]\n",
+			  argv[0]);
+			return 1;
+		}
+	}
+	if((adcBits < 8) || (adcBits > 16) || (adcRate < 10)) {
+		fprintf(stderr, "%s: invalid bits or rate\n", argv[0]);
+		return 1;
+	}
+	if(!(trace = malloc(MAXSAMPLES * sizeof(int)))) {
+		fprintf(stderr, "%s: malloc() fail\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-14s %-16s %6s %10s %8s %8s %8s\n", "trace", "filter",
+	  "rest", "rest", "presses", "lag avg", "lag max");
+	printf("%-14s %-16s %6s %10s %8s %8s %8s\n", "", "",
+	  "rms", "chg/s", "", "ms", "ms");
+	if(optind >= argc) {
+		synthesize();
+		runAll("synthetic", mincut, beta, dcut);
+	}
+	for(; optind < argc; optind++) {
+		if(loadTrace(argv[optind])) {
+			char *name = strrchr(argv[optind], '/');
+			runAll(name ? name + 1 : argv[optind], mincut, beta, dcut);
+		} else {
+			fprintf(stderr, "%s: can't read '%s'\n", argv[0],
+			  argv[optind]);
+		}
+	}
+	return 0;
+}
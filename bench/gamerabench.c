@@ -0,0 +1,663 @@
+/*
+Scaling benchmark for gamera.  Generates a synthetic ROM tree (MAME zips,
+NES .nes files) and a matching advmame.xml, runs gamera headless on a
+pseudo-terminal with its -t option, and reports for each tree size:
+
+  cold    No cache: ROM folders are scanned and zips indexed before the
+          menu appears (find_roms() path, plus mameItemize() XML pass)
+  warm    Cached listing still valid: menu straight from the cache
+  rescan  Folder changed since cached: cached menu first, then the
+          background rescan and menu rebuild
+
+with time-to-menu and time-to-rescan-done (as reported by gamera), peak
+RSS and the number of system calls.  Syscalls are counted in a separate
+ptrace'd run, so the timed runs aren't slowed by it.
+
+With -H, ROM hashing (gamera -d) is measured instead, on a tree of large
+MAME zips (256 KB to 32 MB each, stored, valid CRCs) adding up to the
+given size:
+
+  cold    No hash cache and page cache dropped (needs root; otherwise
+          reported as 'hot'): bound by storage read speed
+  hot     No hash cache, files in page cache: bound by CRC throughput,
+          so 'cores' shows whether the hashing threads keep every core
+          busy (about 4.0 on a Pi 3/4 when they do)
+  warm    Hash cache current: stat() per file, nothing read
+
+with time-to-menu, MB hashed per second, CPU time used (user + system)
+and cores busy (CPU time / time-to-menu; CPU time covers the whole run,
+so a few-ms warm case reads a bit over 1).  A tree larger than RAM can't
+stay in page cache, so 'hot' then reads from storage too.
+
+Usage: gamerabench [-g gamera] [-n count[,count...]] [-m xmlgames]
+                   [-k dir] [-s seed] [-H megabytes]
+
+  -g  gamera binary to run (default ./gamera)
+  -n  MAME zip counts to test (default 1000,10000,50000); each tree also
+      gets a quarter as many NES .nes files
+  -m  Games in the XML file (default 40000, roughly a full MAME set);
+      90% of the generated zips have an entry, the rest show filenames
+  -k  Generate (and keep) trees in this directory, rather than in a
+      temporary directory that's removed afterward
+  -s  Random seed, for a different (but reproducible) tree
+  -H  Hashing benchmark on a tree of this many MB (e.g. 5120); -n and -m
+      don't apply
+
+Names follow real sets: MAME short names built from a few syllables with
+version digits and clone suffixes, NES 'Title (Region) [flags].nes'.
+Zips hold 1-8 members; about 1% are truncated or empty, which gamera
+must leave out of the menu.
+
+Build with 'make gamera gamerabench'.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pty.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define XML_GAMES 40000 // Default -m
+#define MAX_NAME  128
+
+// Result of one gamera run
+typedef struct {
+  double menuMs;   // Time to menu (-1 = not reported)
+  double rescanMs; // Time to background rescan done (-1 = none)
+  int    items;    // Menu items
+  long   rssKB;    // Peak resident set size
+  long   syscalls; // System calls (traced run only)
+  double cpuMs;    // User + system CPU time
+} Result;
+
+static char     *gamera = "./gamera";
+static uint32_t  seed   = 12345;
+static int       hashMB = 0; // -H: hashing benchmark, tree size
+
+// Reproducible pseudorandom number 0 to n-1 (LCG)
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+// Name generation -------------------------------------------------------
+
+static const char *syl[] = {
+  "pac", "man", "gal", "ax", "sf", "dk", "kof", "mslug", "tmnt", "xmen",
+  "ddr", "bub", "ble", "sim", "gun", "bird", "robo", "cop", "mk", "nba",
+  "jam", "out", "run", "zero", "wing", "star", "force", "dragn", "ninja",
+  "turbo", "spy", "hunt", "raid", "en", "to", "ki", "ra", "lo", "mi",
+  "sun", "bomb", "jack", "frog", "ger", "cent", "ipede", "aster", "oids" };
+#define N_SYL (sizeof(syl) / sizeof(syl[0]))
+
+static const char *word[] = {
+  "Super", "Street", "Fighter", "Dragon", "Ninja", "Space", "Invaders",
+  "Galaxy", "Warriors", "Turbo", "Racing", "Bomber", "Jack", "Frog",
+  "Castle", "Quest", "Legend", "Mega", "Force", "Strike", "Thunder",
+  "Metal", "Slug", "Bubble", "Bobble", "Double", "Dragon", "Final",
+  "Fight", "King", "of", "the", "Monsters", "Golden", "Axe", "Raiden",
+  "Twin", "Bee", "Mario", "Bros.", "Kid", "Island", "Adventure",
+  "Wrestling", "Soccer", "Tennis", "Pinball", "Hunter", "Commando" };
+#define N_WORD (sizeof(word) / sizeof(word[0]))
+
+static const char *maker[] = {
+  "Namco", "Capcom", "Konami", "Sega", "Taito", "SNK", "Nintendo",
+  "Irem", "Data East", "Atari", "Williams", "bootleg" };
+static const char *region[] = {
+  "(U)", "(E)", "(J)", "(USA)", "(Europe)", "(Japan)", "(W)", "(UE)" };
+static const char *flag[] = {
+  " [!]", "", "", " [b1]", " [h1]", " [o1]", " [T+Eng]", " [a1]" };
+#define N_OF(a) (sizeof(a) / sizeof(a[0]))
+
+// Names in use, so generated filenames are unique (open addressing)
+static char   **used  = NULL;
+static uint32_t nUsed = 0;
+
+static uint32_t hash(const char *s) {
+	uint32_t h = 2166136261u;
+	while(*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+// Add name to used set, returning the stored copy (NULL if present)
+static char *claim(const char *name) {
+	uint32_t i = hash(name) & (nUsed - 1);
+	for(; used[i]; i = (i + 1) & (nUsed - 1))
+		if(!strcmp(used[i], name)) return NULL;
+	return used[i] = strdup(name);
+}
+
+// Unique MAME-style short name, e.g. 'sf2ce', 'mslug3b', 'pacmanj'
+static char *mameName(char *buf, int idx) {
+	char *s;
+	int   tries, n, len;
+	for(tries=0; ; tries++) {
+		buf[0] = 0;
+		for(n = 1 + rnd(3); n--; ) strcat(buf, syl[rnd(N_SYL)]);
+		buf[8] = 0;
+		len = strlen(buf);
+		if(rnd(10) < 3) len += sprintf(&buf[len], "%d", 1 + rnd(9));
+		if(rnd(10) < 2) {
+			buf[len++] = "abcdjub"[rnd(7)];
+			buf[len]   = 0;
+		}
+		if(tries > 8) sprintf(&buf[len], "%x", idx); // Give up
+		if((s = claim(buf))) return s;
+	}
+}
+
+// Human-readable title, e.g. 'Super Dragon Force (set 2)'
+static void title(char *buf) {
+	int n;
+	buf[0] = 0;
+	for(n = 1 + rnd(4); n--; ) {
+		if(buf[0]) strcat(buf, " ");
+		strcat(buf, word[rnd(N_WORD)]);
+	}
+	if(!rnd(5)) strcat(buf, rnd(2) ? " (set 2)" : " (bootleg)");
+}
+
+// Unique NES filename, e.g. 'Mega Castle Quest (U) [!].nes'
+static void nesName(char *buf, int idx) {
+	char t[64];
+	int  tries;
+	for(tries=0; ; tries++) {
+		title(t);
+		if(tries <= 8) {
+			snprintf(buf, MAX_NAME, "%s %s%s.nes", t,
+			  region[rnd(N_OF(region))], flag[rnd(N_OF(flag))]);
+		} else { // Give up
+			snprintf(buf, MAX_NAME, "%s %s [%x].nes", t,
+			  region[rnd(N_OF(region))], idx);
+		}
+		if(claim(buf)) return;
+	}
+}
+
+// Tree generation -------------------------------------------------------
+
+static uint32_t crcTab[256];
+
+static uint32_t crc32(const uint8_t *buf, int len) {
+	uint32_t c = 0xFFFFFFFF;
+	while(len--) c = crcTab[(c ^ *buf++) & 0xFF] ^ (c >> 8);
+	return ~c;
+}
+
+static void put16(uint8_t **p, int v) {
+	*(*p)++ = v;
+	*(*p)++ = v >> 8;
+}
+
+static void put32(uint8_t **p, uint32_t v) {
+	put16(p, v & 0xFFFF);
+	put16(p, v >> 16);
+}
+
+// Write a stored (uncompressed) zip of 'n' small members named after
+// the game.  kind: 0 = normal, 1 = truncated, 2 = no members.
+static int writeZip(const char *path, const char *name, int n, int kind) {
+	static uint8_t buf[65536];
+	uint8_t       *p = buf, *cd, data[64], *cdStart;
+	uint32_t       off[8], crc[8], size[8];
+	char           member[MAX_NAME + 8];
+	int            i, j, len, fd, ok;
+
+	if(kind == 2) n = 0;
+	for(i=0; i<n; i++) { // Local headers and data
+		size[i] = 16 + rnd(48);
+		for(j=0; j<size[i]; j++) data[j] = rnd(256);
+		crc[i]  = crc32(data, size[i]);
+		off[i]  = p - buf;
+		len     = sprintf(member, "%s.%d", name, i + 1);
+		put32(&p, 0x04034b50); put16(&p, 10); put16(&p, 0);
+		put16(&p, 0);          put32(&p, 0);
+		put32(&p, crc[i]);     put32(&p, size[i]); put32(&p, size[i]);
+		put16(&p, len);        put16(&p, 0);
+		memcpy(p, member, len);     p += len;
+		memcpy(p, data, size[i]);   p += size[i];
+	}
+	cdStart = cd = p;
+	for(i=0; i<n; i++) { // Central directory
+		len = sprintf(member, "%s.%d", name, i + 1);
+		put32(&cd, 0x02014b50); put16(&cd, 20); put16(&cd, 10);
+		put16(&cd, 0);          put16(&cd, 0);  put32(&cd, 0);
+		put32(&cd, crc[i]);     put32(&cd, size[i]);
+		put32(&cd, size[i]);    put16(&cd, len); put16(&cd, 0);
+		put16(&cd, 0);          put16(&cd, 0);  put16(&cd, 0);
+		put32(&cd, 0);          put32(&cd, off[i]);
+		memcpy(cd, member, len); cd += len;
+	}
+	put32(&cd, 0x06054b50); put16(&cd, 0); put16(&cd, 0); // EOCD
+	put16(&cd, n);          put16(&cd, n);
+	put32(&cd, cd - cdStart - 12); put32(&cd, cdStart - buf);
+	put16(&cd, 0);
+	len = cd - buf;
+	if(kind == 1) len /= 2;
+
+	if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	ok = (write(fd, buf, len) == len);
+	return (close(fd) || !ok) ? -1 : 0;
+}
+
+// One <game> element, with the sort of detail real listxml output has
+static void xmlGame(FILE *fp, const char *name) {
+	char t[MAX_NAME * 2];
+	int  i, n = 1 + rnd(8);
+
+	title(t);
+	fprintf(fp, "\t<game name=\"%s\" sourcefile=\"%s.c\">\n"
+	  "\t\t<description>%s</description>\n"
+	  "\t\t<year>19%d</year>\n"
+	  "\t\t<manufacturer>%s</manufacturer>\n",
+	  name, syl[rnd(N_SYL)], t, 78 + rnd(22), maker[rnd(N_OF(maker))]);
+	for(i=0; i<n; i++) {
+		fprintf(fp, "\t\t<rom name=\"%s.%d\" size=\"%d\" "
+		  "crc=\"%06x%02x\" sha1=\"%06x%06x%06x%06x%06x%06x%04x\" "
+		  "region=\"cpu1\" offset=\"%x\"/>\n", name, i + 1,
+		  4096 << rnd(6), rnd(1 << 24), rnd(256), rnd(1 << 24),
+		  rnd(1 << 24), rnd(1 << 24), rnd(1 << 24), rnd(1 << 24),
+		  rnd(1 << 24), rnd(1 << 16), i * 4096);
+	}
+	fprintf(fp, "\t\t<chip type=\"cpu\" name=\"Z80\" "
+	  "clock=\"3072000\"/>\n"
+	  "\t\t<display type=\"raster\" rotate=\"%d\" width=\"288\" "
+	  "height=\"224\" refresh=\"60.606061\"/>\n"
+	  "\t\t<input players=\"2\" buttons=\"%d\" coins=\"2\">\n"
+	  "\t\t\t<control type=\"joy4\"/>\n"
+	  "\t\t</input>\n"
+	  "\t\t<driver status=\"good\" emulation=\"good\" color=\"good\" "
+	  "sound=\"good\" graphic=\"good\" savestate=\"supported\" "
+	  "palettesize=\"512\"/>\n"
+	  "\t</game>\n", rnd(4) * 90, 1 + rnd(6));
+}
+
+// Set a folder's mtime to 'ago' seconds in the past.  gamera won't vouch
+// for a cached listing of a folder modified within 2 seconds of its scan.
+static void age(const char *path, int ago) {
+	struct timespec ts[2];
+	clock_gettime(CLOCK_REALTIME, &ts[0]);
+	ts[0].tv_sec -= ago;
+	ts[1]         = ts[0];
+	utimensat(AT_FDCWD, path, ts, 0);
+}
+
+// Generate tree in dir: mame/ (nZip zips), fceu/ (nZip/4 .nes files),
+// advmame.xml (nXml games), cache/.  Returns 0 on success.
+static int generate(const char *dir, int nZip, int nXml) {
+	char   path[PATH_MAX], name[MAX_NAME], **zips;
+	FILE  *fp;
+	int    i, j, nNes = nZip / 4, nDesc = nZip * 9 / 10;
+
+	for(nUsed=1024; nUsed < (uint32_t)(nZip + nNes + nXml) * 2;
+	  nUsed *= 2);
+	if(!(used = (char **)calloc(nUsed, sizeof(char *))) ||
+	   !(zips = (char **)calloc(nZip + 1, sizeof(char *)))) return -1;
+
+	mkdir(dir, 0755);
+	snprintf(path, sizeof(path), "%s/mame", dir);  mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/fceu", dir);  mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/cache", dir); mkdir(path, 0755);
+
+	for(i=0; i<nZip; i++) {
+		zips[i] = mameName(name, i);
+		snprintf(path, sizeof(path), "%s/mame/%s.zip", dir, name);
+		if(writeZip(path, name, 1 + rnd(8),
+		  (rnd(200) == 0) ? 1 : (rnd(200) == 0) ? 2 : 0)) return -1;
+	}
+	for(i=0; i<nNes; i++) { // iNES header only; content is moot
+		nesName(name, i);
+		snprintf(path, sizeof(path), "%s/fceu/%s", dir, name);
+		if(!(fp = fopen(path, "w"))) return -1;
+		fwrite("NES\x1a\x02\x01\0\0\0\0\0\0\0\0\0\0", 1, 16, fp);
+		if(fclose(fp)) return -1;
+	}
+
+	// XML: described zips, interleaved with games not in the folder
+	snprintf(path, sizeof(path), "%s/advmame.xml", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "<?xml version=\"1.0\"?>\n<mame build=\"0.106\">\n");
+	for(i=j=0; i<nXml; i++) {
+		if((j < nDesc) && (rnd(nXml - i) < (nDesc - j))) {
+			xmlGame(fp, zips[j++]);
+		} else {
+			mameName(name, nZip + i);
+			xmlGame(fp, name);
+		}
+	}
+	fprintf(fp, "</mame>\n");
+	if(fclose(fp)) return -1;
+
+	for(i=0; i<nUsed; i++) free(used[i]);
+	free(used);
+	free(zips);
+	snprintf(path, sizeof(path), "%s/mame", dir); age(path, 60);
+	snprintf(path, sizeof(path), "%s/fceu", dir); age(path, 60);
+	return 0;
+}
+
+// Write a stored zip with one member of 'size' pseudorandom bytes, for
+// the hashing benchmark.  Data is written a megabyte at a time; the local
+// header's CRC is filled in afterward.  Returns 0 on success.
+static int writeBigZip(const char *path, const char *name, uint32_t size) {
+	static uint32_t data[1 << 18];
+	uint8_t         hdr[64 + MAX_NAME], *p;
+	uint32_t        x = seed | 1, crc = 0xFFFFFFFF, left, n, i;
+	int             fd, len, ok = 1;
+
+	if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	len = strlen(name) + 2;
+	p   = hdr;
+	put32(&p, 0x04034b50); put16(&p, 10); put16(&p, 0);
+	put16(&p, 0);          put32(&p, 0);
+	put32(&p, 0);          put32(&p, size); put32(&p, size);
+	put16(&p, len);        put16(&p, 0);
+	p  += sprintf((char *)p, "%s.1", name);
+	ok &= (write(fd, hdr, p - hdr) == p - hdr);
+	for(left=size; ok && left; left -= n) {
+		n = (left < sizeof(data)) ? left : sizeof(data);
+		for(i=0; i<(n + 3) / 4; i++) { // xorshift32
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			data[i] = x;
+		}
+		for(i=0; i<n; i++)
+			crc = crcTab[(crc ^ ((uint8_t *)data)[i]) & 0xFF] ^
+			  (crc >> 8);
+		ok &= (write(fd, data, n) == n);
+	}
+	crc = ~crc;
+	seed += x; // Next file differs
+
+	p = hdr; // Central directory and end record
+	put32(&p, 0x02014b50); put16(&p, 20); put16(&p, 10);
+	put16(&p, 0);          put16(&p, 0);  put32(&p, 0);
+	put32(&p, crc);        put32(&p, size); put32(&p, size);
+	put16(&p, len);        put16(&p, 0);  put16(&p, 0);
+	put16(&p, 0);          put16(&p, 0);  put32(&p, 0);
+	put32(&p, 0);
+	p += sprintf((char *)p, "%s.1", name);
+	put32(&p, 0x06054b50); put16(&p, 0); put16(&p, 0);
+	put16(&p, 1);          put16(&p, 1);
+	put32(&p, 46 + len);   put32(&p, 30 + len + size);
+	put16(&p, 0);
+	ok &= (write(fd, hdr, p - hdr) == p - hdr);
+
+	p = hdr; // CRC into local header
+	put32(&p, crc);
+	ok &= (pwrite(fd, hdr, 4, 14) == 4);
+	return (close(fd) || !ok) ? -1 : 0;
+}
+
+// Hashing benchmark tree in dir: mame/ with zips adding up to mb
+// megabytes, all described in advmame.xml; empty fceu/; cache/.
+// Returns number of zips, or -1 on error.
+static int generateHash(const char *dir, int mb) {
+	char      path[PATH_MAX], name[MAX_NAME], **zips;
+	FILE     *fp;
+	long long left = (long long)mb << 20;
+	uint32_t  size;
+	int       i, n;
+
+	for(nUsed=1024; nUsed < (uint32_t)(mb / 4 + 64) * 2; nUsed *= 2);
+	if(!(used = (char **)calloc(nUsed, sizeof(char *))) ||
+	   !(zips = (char **)calloc(nUsed / 2, sizeof(char *)))) return -1;
+
+	mkdir(dir, 0755);
+	snprintf(path, sizeof(path), "%s/mame", dir);  mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/fceu", dir);  mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/cache", dir); mkdir(path, 0755);
+
+	for(n=0; (left > 0) && (n < nUsed / 2); n++, left -= size) {
+		size = (256 << 10) << rnd(8); // 256 KB to 32 MB
+		if(size > left) size = left;
+		zips[n] = mameName(name, n);
+		snprintf(path, sizeof(path), "%s/mame/%s.zip", dir, name);
+		if(writeBigZip(path, name, size)) return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/advmame.xml", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "<?xml version=\"1.0\"?>\n<mame build=\"0.106\">\n");
+	for(i=0; i<n; i++) xmlGame(fp, zips[i]);
+	fprintf(fp, "</mame>\n");
+	if(fclose(fp)) return -1;
+
+	for(i=0; i<nUsed; i++) free(used[i]);
+	free(used);
+	free(zips);
+	snprintf(path, sizeof(path), "%s/mame", dir); age(path, 60);
+	snprintf(path, sizeof(path), "%s/fceu", dir); age(path, 60);
+	return n;
+}
+
+static int unlinkCb(const char *path, const struct stat *st, int flag,
+  struct FTW *f) {
+	return remove(path);
+}
+
+// Running gamera --------------------------------------------------------
+
+// Consume gamera's terminal output so it never blocks on a full pty
+static void *drain(void *arg) {
+	char buf[4096];
+	while(read(*(int *)arg, buf, sizeof(buf)) > 0);
+	return NULL;
+}
+
+// Run gamera on tree in dir; if trace, count system calls rather than
+// trusting the timing.  Returns 0 on success.
+static int run(const char *dir, int trace, Result *r) {
+	char           c[PATH_MAX], m[PATH_MAX], f[PATH_MAX], x[PATH_MAX],
+	               line[256], *p;
+	char          *argv[] = { gamera, "-k", "-t", "-c", c, "-r", m,
+	                 "-r", f, "-x", x, hashMB ? "-d" : NULL, NULL };
+	struct winsize ws = { 24, 80, 0, 0 };
+	struct rusage  ru;
+	pthread_t      tid;
+	FILE          *fp;
+	int            master, errPipe[2], status, stops = 0;
+	pid_t          pid;
+
+	snprintf(c, sizeof(c), "%s/cache", dir);
+	snprintf(m, sizeof(m), "mame=%s/mame", dir);
+	snprintf(f, sizeof(f), "fceu=%s/fceu", dir);
+	snprintf(x, sizeof(x), "%s/advmame.xml", dir);
+	memset(r, 0, sizeof(*r));
+	r->menuMs = r->rescanMs = -1;
+
+	if(pipe(errPipe)) return -1;
+	if((pid = forkpty(&master, NULL, NULL, &ws)) < 0) return -1;
+	if(!pid) { // Child: gamera, stderr to pipe
+		dup2(errPipe[1], 2);
+		close(errPipe[0]);
+		close(errPipe[1]);
+		setenv("TERM", "xterm", 0);
+		if(trace) ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		execv(gamera, argv);
+		_exit(127);
+	}
+	close(errPipe[1]);
+	pthread_create(&tid, NULL, drain, &master);
+
+	if(trace) { // Stops at exec, then at each syscall entry and exit
+		waitpid(pid, &status, 0);
+		ptrace(PTRACE_SETOPTIONS, pid, NULL,
+		  PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+		ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+		while(wait4(pid, &status, 0, &ru) == pid) {
+			if(WIFEXITED(status) || WIFSIGNALED(status)) break;
+			if(WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+				stops++;
+				ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+			} else { // Signal for the child, pass along
+				ptrace(PTRACE_SYSCALL, pid, NULL,
+				  (void *)(intptr_t)WSTOPSIG(status));
+			}
+		}
+		r->syscalls = (stops + 1) / 2; // exit_group() doesn't return
+	} else {
+		wait4(pid, &status, 0, &ru);
+	}
+	r->rssKB = ru.ru_maxrss;
+	r->cpuMs = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+	  (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+	pthread_join(tid, NULL);
+	close(master);
+
+	if((fp = fdopen(errPipe[0], "r"))) {
+		while(fgets(line, sizeof(line), fp)) {
+			if((p = strstr(line, "menu in ")))
+				sscanf(p, "menu in %lf ms, %d items",
+				  &r->menuMs, &r->items);
+			else if((p = strstr(line, "rescan done in ")))
+				sscanf(p, "rescan done in %lf ms, %d items",
+				  &r->rescanMs, &r->items);
+		}
+		fclose(fp);
+	} else {
+		close(errPipe[0]);
+	}
+	return (WIFEXITED(status) && !WEXITSTATUS(status) &&
+	  (r->menuMs >= 0)) ? 0 : -1;
+}
+
+// Flush and drop the page cache (hashing benchmark's cold case).
+// Returns 0 if dropped; needs root.
+static int drop(void) {
+	int fd, ok;
+	sync();
+	if((fd = open("/proc/sys/vm/drop_caches", O_WRONLY)) < 0) return -1;
+	ok = (write(fd, "3", 1) == 1);
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+// Hashing benchmark: -d runs on a tree of hashMB megabytes of zips
+static int benchHash(const char *prog, const char *keep) {
+	static const char *cases[] = { "cold", "hot", "warm" };
+	char    dir[256], path[PATH_MAX];
+	int     i, n, k;
+	Result  r;
+
+	snprintf(dir, sizeof(dir), "%s/hash%d", keep, hashMB);
+	if((n = generateHash(dir, hashMB)) < 0) {
+		fprintf(stderr, "%s: can't generate tree in '%s'\n", prog, dir);
+		return 1;
+	}
+	printf("%7s %7s %-6s %9s %7s %9s %5s %9s\n", "roms", "MB", "case",
+	  "menu ms", "MB/s", "CPU ms", "cores", "RSS KB");
+	for(i=0; i<3; i++) {
+		const char *name = cases[i];
+		if(i < 2) { // No hash cache; cold also drops the page cache
+			snprintf(path, sizeof(path), "%s/cache/mame.crc", dir);
+			unlink(path);
+			if(!i && drop()) name = "hot";
+		}
+		k = run(dir, 0, &r);
+		printf("%7d %7d %-6s %9.1f ", n, hashMB, name, r.menuMs);
+		if(i < 2) printf("%7.0f ", hashMB * 1e3 / r.menuMs);
+		else      printf("%7s ", "-");
+		printf("%9.1f %5.2f %9ld%s\n", r.cpuMs, r.cpuMs / r.menuMs,
+		  r.rssKB, k ? "  (gamera failed)" : "");
+		fflush(stdout);
+	}
+	return 0;
+}
+
+// Prepare tree for a case: cold = empty cache, rescan = folder changed
+static void setup(const char *dir, const char *which, int *mtimeAge) {
+	char path[PATH_MAX];
+	if(!strcmp(which, "cold")) {
+		snprintf(path, sizeof(path), "%s/cache", dir);
+		nftw(path, unlinkCb, 16, FTW_DEPTH | FTW_PHYS);
+		mkdir(path, 0755);
+	} else if(!strcmp(which, "rescan")) {
+		snprintf(path, sizeof(path), "%s/mame", dir);
+		age(path, (*mtimeAge)++); // Differs from cached each time
+	}
+}
+
+int main(int argc, char *argv[]) {
+	static const char *cases[] = { "cold", "warm", "rescan" };
+	char   *counts = "1000,10000,50000", *keep = NULL, *tok,
+	        tmpl[] = "/tmp/gamerabenchXXXXXX", dir[256];
+	int     c, i, k, n, nXml = XML_GAMES, mtimeAge = 30;
+	Result  timed, traced;
+
+	while((c = getopt(argc, argv, "g:n:m:k:s:H:")) != -1) {
+		switch(c) {
+		   case 'g': gamera = optarg;                  break;
+		   case 'n': counts = optarg;                  break;
+		   case 'm': nXml   = atoi(optarg);            break;
+		   case 'k': keep   = optarg;                  break;
+		   case 's': seed   = strtoul(optarg, NULL, 0); break;
+		   case 'H': hashMB = atoi(optarg);            break;
+		   default:
+			fprintf(stderr, "Usage: %s [-g gamera] "
+			  "[-n count[,count...]] [-m xmlgames] [-k dir] "
+			  "[-s seed] [-H megabytes]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(access(gamera, X_OK)) {
+		fprintf(stderr, "%s: can't run '%s' (see -g)\n", argv[0],
+		  gamera);
+		return 1;
+	}
+	if(!keep && !(keep = mkdtemp(tmpl))) {
+		fprintf(stderr, "%s: can't create temp directory\n", argv[0]);
+		return 1;
+	}
+	for(i=0; i<256; i++) {
+		uint32_t v = i;
+		for(k=0; k<8; k++) v = (v & 1) ? (v >> 1) ^ 0xEDB88320 : v >> 1;
+		crcTab[i] = v;
+	}
+	if(hashMB > 0) {
+		k = benchHash(argv[0], keep);
+		if(keep == tmpl) nftw(tmpl, unlinkCb, 16, FTW_DEPTH | FTW_PHYS);
+		return k;
+	}
+
+	printf("%7s %6s %-6s %9s %9s %6s %9s %9s\n", "roms", "xml", "case",
+	  "menu ms", "rescan ms", "items", "RSS KB", "syscalls");
+	for(tok = strtok(counts, ","); tok; tok = strtok(NULL, ",")) {
+		if((n = atoi(tok)) <= 0) continue;
+		snprintf(dir, sizeof(dir), "%s/%d", keep, n);
+		if(generate(dir, n, nXml)) {
+			fprintf(stderr, "%s: can't generate tree in '%s'\n",
+			  argv[0], dir);
+			continue;
+		}
+		for(i=0; i<3; i++) {
+			setup(dir, cases[i], &mtimeAge);
+			k = run(dir, 1, &traced);
+			setup(dir, cases[i], &mtimeAge);
+			k |= run(dir, 0, &timed);
+			printf("%7d %6d %-6s %9.1f ", n + n / 4, nXml,
+			  cases[i], timed.menuMs);
+			if(timed.rescanMs >= 0) printf("%9.1f ", timed.rescanMs);
+			else                    printf("%9s ", "-");
+			printf("%6d %9ld %9ld%s\n", timed.items, timed.rssKB,
+			  traced.syscalls, k ? "  (gamera failed)" : "");
+			fflush(stdout);
+		}
+	}
+	if(keep == tmpl) nftw(tmpl, unlinkCb, 16, FTW_DEPTH | FTW_PHYS);
+	return 0;
+}
@@ -0,0 +1,339 @@
+/*
+Simulated input workload for retrogame, used to train and check the
+profile-guided build ('make pgo').  Runs a retrogame binary against a
+generated config whose only sources are FIFOs standing in for input
+devices (EVDEV command) and a sample file standing in for an SPI ADC, so
+no GPIO hardware is needed.  Three phases of the same length follow:
+
+  idle     No input; only a 250 Hz ADC scan (thumbstick at rest, noisy)
+  mashing  12 encoder buttons pressed and released at button-mashing
+           rates (each ~8 presses/sec, 30-90 ms holds)
+  storm    16 expander-style inputs changing in bursts every 5 ms, each
+           change bouncing 1-3 times within a millisecond
+
+Retrogame's CPU time (from /proc/<pid>/schedstat, in nanoseconds) is
+sampled around each phase.  Idle is measured before and after the input
+phases and reported as CPU milliseconds per second; the input phases as
+microseconds per input event, after taking out the idle rate.  Event
+streams are the same every run (fixed seed), so builds can be compared
+directly.
+
+Usage: inputsim [-t seconds] [-r rounds] [-v] retrogame [retrogame...]
+
+  -t  Length of each phase (default 5 seconds)
+  -r  Rounds; builds are run alternately and each one's best (lowest)
+      figures are reported (default 1)
+  -v  Show retrogame's output
+
+With two or more binaries, the change of each relative to the first is
+shown too.  retrogame must be run as root for its uinput device.  Output
+codes are gamepad buttons (BTN_*), which don't type into the console.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/input.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define N_PAD    12 // Encoder buttons (mashing phase)
+#define N_EXP    16 // Expander inputs (storm phase)
+#define N_ADC    2  // ADC channels (X/Y stick)
+#define ADC_LEN  4096 // Samples per channel in the ADC file (looped)
+
+static const char *padBtn[N_PAD] = {
+  "BTN_SOUTH", "BTN_EAST", "BTN_NORTH", "BTN_WEST", "BTN_TL", "BTN_TR",
+  "BTN_TL2", "BTN_TR2", "BTN_SELECT", "BTN_START", "BTN_MODE",
+  "BTN_THUMBL" };
+static const char *expBtn[N_EXP] = {
+  "BTN_TRIGGER", "BTN_THUMB", "BTN_THUMB2", "BTN_TOP", "BTN_TOP2",
+  "BTN_PINKIE", "BTN_BASE", "BTN_BASE2", "BTN_BASE3", "BTN_BASE4",
+  "BTN_BASE5", "BTN_BASE6", "BTN_C", "BTN_Z", "BTN_THUMBR",
+  "BTN_DEAD" };
+
+typedef struct {
+  double idle;     // CPU ms per second, no input
+  double mash;     // CPU us per event, mashing phase (idle removed)
+  double storm;    // CPU us per event, storm phase (idle removed)
+  long   events[2]; // Events sent, mashing and storm
+} Result;
+
+static char     dir[] = "/tmp/inputsimXXXXXX";
+static int      phaseSec = 5, verbose = 0;
+static uint32_t seed;
+
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+static int64_t nsNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void sleepUntil(int64_t ns) {
+	struct timespec t = { ns / 1000000000, ns % 1000000000 };
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) ==
+	  EINTR);
+}
+
+// CPU time consumed by process, nanoseconds
+static int64_t cpuNs(pid_t pid) {
+	char      path[64];
+	FILE     *fp;
+	long long ns = 0;
+	sprintf(path, "/proc/%d/schedstat", pid);
+	if((fp = fopen(path, "r"))) {
+		if(fscanf(fp, "%lld", &ns) != 1) ns = 0;
+		fclose(fp);
+	}
+	return ns;
+}
+
+// Write config, ADC sample file and FIFOs into dir
+static int setup(void) {
+	char     path[128];
+	FILE    *fp;
+	uint16_t s[N_ADC];
+	int      i;
+
+	sprintf(path, "%s/pad", dir);
+	if(mkfifo(path, 0600)) return -1;
+	sprintf(path, "%s/exp", dir);
+	if(mkfifo(path, 0600)) return -1;
+
+	// Stick at rest near center, with sensor noise
+	sprintf(path, "%s/adc", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	for(seed=1, i=0; i<ADC_LEN; i++) {
+		s[0] = 512 + rnd(9) - 4;
+		s[1] = 512 + rnd(9) - 4;
+		fwrite(s, sizeof(s[0]), N_ADC, fp);
+	}
+	fclose(fp);
+
+	sprintf(path, "%s/retrogame.cfg", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "DEBUG 0\n");
+	fprintf(fp, "ADC MCP3008 %s/adc 250\nAXIS X 0\nAXIS Y 1\n"
+	  "FILTER 0\nFILTER 1\n", dir);
+	fprintf(fp, "EVDEV %s/pad", dir); // Source codes 256+ = BTN_0...
+	for(i=0; i<N_PAD; i++) fprintf(fp, " %d %d", 256 + i, 176 + i);
+	fprintf(fp, "\nEVDEV %s/exp", dir);
+	for(i=0; i<N_EXP; i++) fprintf(fp, " %d %d", 256 + i, 192 + i);
+	fprintf(fp, "\n");
+	for(i=0; i<N_PAD; i++) fprintf(fp, "%s %d\n", padBtn[i], 176 + i);
+	for(i=0; i<N_EXP; i++) fprintf(fp, "%s %d\n", expBtn[i], 192 + i);
+	fprintf(fp, "BTN_MODE 184 185\n"); // SELECT+START 'pinch'
+	return fclose(fp);
+}
+
+// Open FIFO for writing once retrogame has it open for reading
+static int fifoOpen(const char *name, pid_t pid) {
+	char path[128];
+	int  fd, i;
+	sprintf(path, "%s/%s", dir, name);
+	for(i=0; i<500; i++) { // Up to 5 seconds
+		if((fd = open(path, O_WRONLY | O_NONBLOCK)) >= 0) return fd;
+		if(waitpid(pid, NULL, WNOHANG)) break; // retrogame quit
+		usleep(10000);
+	}
+	return -1;
+}
+
+// Append one event (and optionally SYN) to buffer
+static int ev(struct input_event *e, int type, int code, int value) {
+	memset(e, 0, sizeof(*e));
+	e->type  = type;
+	e->code  = code;
+	e->value = value;
+	return 1;
+}
+
+// Mashing phase: each button alternates press/release, presses spaced
+// ~125 ms apart on average with 30-90 ms holds.  Returns events sent.
+static long mash(int fd, int64_t end) {
+	struct input_event e[2];
+	int64_t            next[N_PAD], now;
+	int                down[N_PAD] = { 0 }, i, j;
+	long               n = 0;
+
+	for(now=nsNow(), i=0; i<N_PAD; i++)
+		next[i] = now + rnd(125) * 1000000LL;
+	for(;;) {
+		for(j=0, i=1; i<N_PAD; i++) if(next[i] < next[j]) j = i;
+		if(next[j] >= end) break;
+		sleepUntil(next[j]);
+		down[j] ^= 1;
+		ev(&e[0], EV_KEY, 256 + j, down[j]);
+		ev(&e[1], EV_SYN, SYN_REPORT, 0);
+		if(write(fd, e, sizeof(e)) != sizeof(e)) break;
+		n++;
+		next[j] += (down[j] ? 30 + rnd(60) : 35 + rnd(70)) * 1000000LL;
+	}
+	return n;
+}
+
+// Storm phase: every 5 ms a burst where a random subset of inputs
+// changes, each bouncing 1-3 times; the bounces of one burst arrive as
+// a few quick writes, as an expander IRQ handler would see them.
+static long storm(int fd, int64_t end) {
+	struct input_event e[N_EXP * 6 + 1];
+	int64_t            t;
+	int                state[N_EXP] = { 0 }, i, b, k, m;
+	long               n = 0;
+
+	for(t=nsNow(); t < end; t += 5000000) {
+		sleepUntil(t);
+		for(b=0; b<3; b++) { // Three sub-bursts, 0.3 ms apart
+			for(k=i=0; i<N_EXP; i++) {
+				if(b && !state[i]) continue; // Settled already
+				if(!b && rnd(3)) continue;   // Not changing
+				for(m = 1 + rnd(2); m--; ) {
+					state[i] ^= 1;
+					k += ev(&e[k], EV_KEY, 256 + i, state[i]);
+				}
+			}
+			if(!k) continue;
+			k += ev(&e[k], EV_SYN, SYN_REPORT, 0);
+			if(write(fd, e, k * sizeof(e[0])) !=
+			  (ssize_t)(k * sizeof(e[0]))) return n;
+			n += k - 1;
+			sleepUntil(t + (b + 1) * 300000);
+		}
+	}
+	return n;
+}
+
+// Run one binary through all phases.  Returns 0 on success.
+static int run(char *prog, Result *r) {
+	char    cfg[128];
+	char   *argv[] = { prog, cfg, NULL };
+	int     pad, exp, status, fd;
+	int64_t t[5], c[5], len = phaseSec * 1000000000LL;
+	double  idle;
+	pid_t   pid;
+
+	sprintf(cfg, "%s/retrogame.cfg", dir);
+	if((pid = fork()) < 0) return -1;
+	if(!pid) {
+		if(!verbose && ((fd = open("/dev/null", O_WRONLY)) >= 0)) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+		setpgid(0, 0); // Not foreground, so no debug output
+		execv(prog, argv);
+		_exit(127);
+	}
+	if(((pad = fifoOpen("pad", pid)) < 0) ||
+	   ((exp = fifoOpen("exp", pid)) < 0)) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		return -1;
+	}
+	seed = 12345;
+	sleepUntil(nsNow() + 500000000); // Settle
+
+	// Idle (half), mashing, storm, idle (half), so a drift in the
+	// idle rate over the run mostly cancels out
+	t[0] = nsNow(); c[0] = cpuNs(pid);
+	sleepUntil(t[0] + len / 2);
+	t[1] = nsNow(); c[1] = cpuNs(pid);
+	r->events[0] = mash(pad, t[1] + len);
+	t[2] = nsNow(); c[2] = cpuNs(pid);
+	r->events[1] = storm(exp, t[2] + len);
+	sleepUntil(nsNow() + 100000000); // Let debounce finish
+	t[3] = nsNow(); c[3] = cpuNs(pid);
+	sleepUntil(t[3] + len / 2);
+	t[4] = nsNow(); c[4] = cpuNs(pid);
+
+	close(pad);
+	close(exp);
+	kill(pid, SIGTERM); // Clean exit (writes profile, if instrumented)
+	waitpid(pid, &status, 0);
+
+	idle     = (double)(c[1] - c[0] + c[4] - c[3]) /
+	           (t[1] - t[0] + t[4] - t[3]); // CPU ns per ns
+	r->idle  = idle * 1e3;
+	r->mash  = ((c[2] - c[1]) - idle * (t[2] - t[1])) / 1e3 /
+	  (r->events[0] ? r->events[0] : 1);
+	r->storm = ((c[3] - c[2]) - idle * (t[3] - t[2])) / 1e3 /
+	  (r->events[1] ? r->events[1] : 1);
+	return (WIFEXITED(status) && !WEXITSTATUS(status) && c[4]) ? 0 : -1;
+}
+
+static int unlinkCb(const char *path, const struct stat *st, int flag,
+  struct FTW *f) {
+	return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+	Result *best, r;
+	int     c, i, j, n, rounds = 1, status = 0;
+
+	while((c = getopt(argc, argv, "t:r:v")) != -1) {
+		switch(c) {
+		   case 't': phaseSec = atoi(optarg); break;
+		   case 'r': rounds   = atoi(optarg); break;
+		   case 'v': verbose  = 1;            break;
+		   default:  optind   = argc + 1;     break;
+		}
+	}
+	if((optind >= argc) || (phaseSec < 1) || (rounds < 1)) {
+		fprintf(stderr, "Usage: %s [-t seconds] [-r rounds] [-v] "
+		  "retrogame [retrogame...]\n", argv[0]);
+		return 1;
+	}
+	n = argc - optind;
+	if(!mkdtemp(dir) || setup() ||
+	  !(best = (Result *)calloc(n, sizeof(Result)))) {
+		fprintf(stderr, "%s: can't set up workload\n", argv[0]);
+		return 1;
+	}
+
+	for(i=0; i<rounds; i++) {
+		for(j=0; j<n; j++) {
+			if(run(argv[optind + j], &r)) {
+				fprintf(stderr, "%s: '%s' failed (run as root? "
+				  "try -v)\n", argv[0], argv[optind + j]);
+				status = 1;
+				goto done;
+			}
+			if(!i || (r.idle  < best[j].idle))  best[j].idle  = r.idle;
+			if(!i || (r.mash  < best[j].mash))  best[j].mash  = r.mash;
+			if(!i || (r.storm < best[j].storm)) best[j].storm = r.storm;
+			memcpy(best[j].events, r.events, sizeof(r.events));
+		}
+	}
+
+	printf("%-24s %10s %10s %10s\n", "", "idle", "mashing", "storm");
+	printf("%-24s %10s %10s %10s\n", "build", "CPU ms/s", "us/event",
+	  "us/event");
+	for(j=0; j<n; j++) {
+		printf("%-24.24s %10.3f %10.2f %10.2f\n", argv[optind + j],
+		  best[j].idle, best[j].mash, best[j].storm);
+	}
+	for(j=1; j<n; j++) {
+		printf("%-24.24s %+9.1f%% %+9.1f%% %+9.1f%%\n", "  change",
+		  (best[j].idle  / best[0].idle  - 1.0) * 100.0,
+		  (best[j].mash  / best[0].mash  - 1.0) * 100.0,
+		  (best[j].storm / best[0].storm - 1.0) * 100.0);
+	}
+	printf("(%ld mashing, %ld storm events per run)\n", best[0].events[0],
+	  best[0].events[1]);
+
+  done:
+	nftw(dir, unlinkCb, 8, FTW_DEPTH | FTW_PHYS);
+	return status;
+}
@@ -0,0 +1,203 @@
+/*
+Stress test for retrogame's output ring (outQueue()/outFlush()).  keyfd is
+replaced by a non-blocking pipe with a 4 KB buffer and a deliberately slow
+reader, so writes keep hitting EAGAIN and the ring keeps filling.  The
+reader applies events a frame at a time, as evdev clients do at each
+SYN_REPORT, and checks:
+
+  releases   Every release queued reaches the reader (none dropped)
+  unclosed   ...inside a completed frame: whenever input pauses and the
+             ring drains, no release is left after the last SYN (there's
+             no later frame to close it, so the key would stay down)
+  stuck      No key is down at the reader once all are released
+
+Two cases run:
+
+  random  Randomized frames as the main loop makes them: presses and
+          releases with MSC_TIMESTAMP and SYN, key repeats, axis events
+  flood   The reader stalls while the ring is filled with press frames
+          and a single repeat, then a frame releasing one key arrives,
+          finding the ring full with only that repeat to drop
+
+Usage: outstress [-n frames] [-s seed]
+
+  -n  Frames in the random case (default 200000)
+  -s  Random seed (default 12345)
+
+Exit status is 1 if any check failed.  Build with 'make outstress'.
+*/
+
+#define _GNU_SOURCE // Before any header, else retrogame.c's comes too late
+#define main retrogame_main
+#include "../retrogame.c"
+#undef main
+
+#define N_CODES 64 // Key codes used (KEY_ESC + 0..63)
+
+static int      rfd;                // Pipe read end
+static uint32_t seed = 12345;
+static bool     held[N_CODES];      // Key state as sent
+static int      downAt[N_CODES],    // Key state as applied by reader
+                pendAt[N_CODES];    // ...pending in current frame
+static long     sentRel, gotRel,    // Releases queued, applied at SYN
+                pendRel,            // Releases since last SYN
+                unclosed;           // Pauses that left pendRel > 0
+
+static uint32_t rnd(uint32_t n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+// Read up to max events from the pipe, applying each frame at its SYN.
+// A short write can split an event, so partial events carry over.
+static void reader(int max) {
+	static struct input_event ev[64];
+	static int                part = 0; // Bytes of ev[0] already read
+	int                       i, n, c;
+
+	while(max > 0) {
+		n = read(rfd, (char *)ev + part, sizeof(ev[0]) *
+		  ((max < 64) ? max : 64) - part);
+		if(n <= 0) break;
+		part += n;
+		n     = part / sizeof(ev[0]);
+		max  -= n;
+		for(i=0; i<n; i++) {
+			if(ev[i].type == EV_KEY) {
+				c = ev[i].code - KEY_ESC;
+				if(ev[i].value == 1) {
+					pendAt[c] = 1;
+				} else if(ev[i].value == 0) {
+					pendAt[c] = 0;
+					pendRel++;
+				}
+			} else if(ev[i].type == EV_SYN) {
+				memcpy(downAt, pendAt, sizeof(downAt));
+				gotRel += pendRel;
+				pendRel = 0;
+			}
+		}
+		part %= sizeof(ev[0]);
+		if(part) memmove(ev, &ev[n], part);
+	}
+}
+
+// Queue a key change the way the main loop's debounce does
+static void keySend(int c, int value) {
+	outQueue(EV_KEY, KEY_ESC + c, value);
+	if(value == 0) sentRel++;
+	held[c] = value;
+}
+
+static void frameEnd(void) {
+	outQueue(EV_MSC, MSC_TIMESTAMP, (int32_t)rnd(1 << 30));
+	outQueue(EV_SYN, SYN_REPORT, 0);
+}
+
+// Input pauses: flush and read until the ring is empty, then check that
+// every release has had its SYN
+static void settle(void) {
+	do {
+		outFlush();
+		reader(1 << 20);
+	} while(outHead != outTail);
+	reader(1 << 20);
+	if(pendRel) unclosed++;
+}
+
+// Release everything still held and settle
+static void drain(void) {
+	int c, n = 0;
+	settle();
+	for(c=0; c<N_CODES; c++) {
+		if(held[c]) {
+			keySend(c, 0);
+			n++;
+		}
+	}
+	if(n) frameEnd();
+	settle();
+}
+
+static int report(const char *name) {
+	int c, stuck = 0, fail;
+	for(c=0; c<N_CODES; c++) stuck += downAt[c];
+	fail = (gotRel != sentRel) || unclosed || stuck;
+	printf("%-7s releases %ld/%ld applied, %ld unclosed, %d stuck; "
+	  "%u deferred, %u dropped, max %u  %s\n", name, gotRel, sentRel,
+	  unclosed, stuck, outRetries, outDrops, outMax, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+static void reset(void) {
+	memset(held  , 0, sizeof(held));
+	memset(downAt, 0, sizeof(downAt));
+	memset(pendAt, 0, sizeof(pendAt));
+	sentRel = gotRel = pendRel = unclosed = 0;
+	outHead = outTail = outPart = 0;
+	outRetries = outDrops = outMax = 0;
+}
+
+int main(int argc, char *argv[]) {
+	int pfd[2], c, i, k, n, nFrames = 200000, failed = 0;
+
+	while((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch(c) {
+		   case 'n': nFrames = atoi(optarg); break;
+		   case 's': seed    = atoi(optarg); break;
+		   default:  optind  = argc + 1;     break;
+		}
+	}
+	if((optind < argc) || (nFrames < 1)) {
+		fprintf(stderr, "Usage: %s [-n frames] [-s seed]\n", argv[0]);
+		return 1;
+	}
+	if(pipe2(pfd, O_NONBLOCK) || (fcntl(pfd[1], F_SETPIPE_SZ, 4096) < 0)) {
+		fprintf(stderr, "%s: can't make pipe\n", argv[0]);
+		return 1;
+	}
+	rfd   = pfd[0];
+	keyfd = pfd[1];
+
+	// Random: a flush per frame (one main loop pass), reader taking a
+	// few events now and then, input pausing now and then
+	reset();
+	for(i=0; i<nFrames; i++) {
+		for(k=rnd(4); k>=0; k--) {
+			c = rnd(N_CODES);
+			if(held[c] && rnd(3)) outQueue(EV_KEY, KEY_ESC + c, 2);
+			else                  keySend(c, !held[c]);
+		}
+		if(!rnd(2)) outQueue(EV_ABS, ABS_X, rnd(1024));
+		frameEnd();
+		outFlush();
+		if(!rnd(8))    reader(rnd(48));
+		if(!rnd(1000)) settle();
+	}
+	drain();
+	failed |= report("random");
+
+	// Flood: ring full of press frames plus one repeat while the reader
+	// is stalled, then a frame releasing one key: the repeat alone would
+	// make room for the release but not its MSC_TIMESTAMP and SYN
+	reset();
+	reader(1 << 20);
+	n = 0;
+	for(i=0; (outHead - outTail) < OUT_QUEUE - 1; i++) {
+		c = i % N_CODES;
+		if(!held[c]) {
+			keySend(c, 1);
+		} else if(!n++) {
+			outQueue(EV_KEY, KEY_ESC + c, 2);
+		} else {
+			outQueue(EV_KEY, KEY_ESC + c, 1);
+		}
+		outQueue(EV_SYN, SYN_REPORT, 0);
+	}
+	keySend(0, 0);
+	frameEnd();
+	drain();
+	failed |= report("flood");
+
+	return failed;
+}
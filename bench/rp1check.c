@@ -0,0 +1,152 @@
+/*
+Check of retrogame's Pi 5 (RP1) GPIO register code without a Pi 5.  A
+plain file the size of the RP1 GPIO mapping stands in for /dev/gpiomem0:
+it's mapped with the same gpioMap() retrogame uses, filled with a known
+pattern, then pull() and gpioLevels() are run against it and the file's
+contents compared with what the RP1 registers should then hold:
+
+  pull up/down/off  PUE/PDE set or cleared in each requested pin's pad
+                    register, the pad's other bits (drive, slew, Schmitt,
+                    input enable) and all other pins' pads unchanged
+  bank 0 only       Requested pins past GPIO 27 leave the block untouched
+  levels            gpioLevels() reads RIO_SYNC_IN (not RIO_NOSYNC_IN),
+                    masked to the 28 bank 0 pins
+  BCM levels        Same call on earlier boards: GPLEV0 | GPLEV1 << 32
+
+Usage: rp1check [file]
+
+The block is created in a temporary file unless one is named (e.g. a
+file on the filesystem under test).  Prints each check; exit status is
+1 if any failed.
+
+Build with 'make rp1check'.
+*/
+
+#define _GNU_SOURCE // Before any header, else retrogame.c's comes too late
+#define main retrogame_main
+#include "../retrogame.c"
+#undef main
+
+// Register indexes and bits from the RP1 datasheet, deliberately not
+// retrogame's own defines, so a wrong offset there is caught here
+#define PAD(n)      ((0x20000 + 4 + (n) * 4) / 4) // PADS_BANK0 GPIO n
+#define PUE         0x08                          // Pad pull-up enable
+#define PDE         0x04                          // Pad pull-down enable
+#define NOSYNC_IN   ((0x10000 + 0x08) / 4)        // SYS_RIO0 RIO_NOSYNC_IN
+#define SYNC_IN     ((0x10000 + 0x0C) / 4)        // SYS_RIO0 RIO_SYNC_IN
+#define BCM_GPLEV0  (0x34 / 4)
+#define BCM_GPLEV1  (0x38 / 4)
+
+static volatile unsigned int *regs;
+static unsigned int           expect[RP1_MAP_SIZE / 4];
+static int                    failed = 0;
+
+// Compare whole block against expect[], report result of one check
+static void check(const char *what) {
+	int i, bad = -1;
+	for(i=0; i<RP1_MAP_SIZE/4; i++) {
+		if(regs[i] != expect[i]) {
+			bad = i;
+			break;
+		}
+	}
+	if(bad < 0) {
+		printf("ok    %s\n", what);
+	} else {
+		printf("FAIL  %s: offset 0x%05X is 0x%08X, expected 0x%08X\n",
+		  what, bad * 4, regs[bad], expect[bad]);
+		failed = 1;
+	}
+}
+
+// Apply expected effect of pull(mask, state) on the pads to expect[]
+static void expectPull(uint64_t mask, int state) {
+	for(int n=0; n<28; n++) {
+		if(!(mask & (1ULL << n))) continue;
+		expect[PAD(n)] &= ~(PUE | PDE);
+		if(state == 2)      expect[PAD(n)] |= PUE;
+		else if(state == 1) expect[PAD(n)] |= PDE;
+	}
+}
+
+static void checkLevels(const char *what, uint64_t got, uint64_t want) {
+	if(got == want) {
+		printf("ok    %s\n", what);
+	} else {
+		printf("FAIL  %s: 0x%llX, expected 0x%llX\n", what,
+		  (unsigned long long)got, (unsigned long long)want);
+		failed = 1;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	char     tmp[] = "/tmp/rp1checkXXXXXX", *path = tmp;
+	uint32_t seed = 12345;
+	uint64_t mask = (1ULL << 2) | (1ULL << 3) | (1ULL << 17) |
+	                (1ULL << 27);
+	int      fd, i;
+
+	if(argc > 2) {
+		fprintf(stderr, "Usage: %s [file]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 1) {
+		path = argv[1];
+		fd   = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	} else {
+		fd   = mkstemp(tmp);
+	}
+	if((fd < 0) || ftruncate(fd, RP1_MAP_SIZE)) {
+		fprintf(stderr, "%s: can't create '%s'\n", argv[0], path);
+		return 1;
+	}
+	close(fd);
+	if(!(regs = gpioMap(path, 0, RP1_MAP_SIZE))) {
+		fprintf(stderr, "%s: can't map '%s'\n", argv[0], path);
+		return 1;
+	}
+
+	// Every register gets some pattern, so stray writes show up; pads
+	// start in a mix of pull states with assorted other bits set
+	for(i=0; i<RP1_MAP_SIZE/4; i++) {
+		seed = seed * 1664525 + 1013904223;
+		regs[i] = expect[i] = seed;
+	}
+	gpio = regs;
+	rp1  = true;
+
+	pull(mask, 2);
+	expectPull(mask, 2);
+	check("pull up: PUE set, PDE clear, other bits and pads kept");
+	pull(mask, 1);
+	expectPull(mask, 1);
+	check("pull down: PDE set, PUE clear");
+	pull(mask, 0);
+	expectPull(mask, 0);
+	check("pull off: PUE and PDE clear");
+	pull((1ULL << 28) | (1ULL << 40) | (1ULL << 53), 2);
+	check("pins past GPIO 27 ignored");
+	pull(0xFFFFFFFULL, 2);
+	expectPull(0xFFFFFFFULL, 2);
+	check("pull up all 28 pins");
+
+	regs[NOSYNC_IN] = 0x00000000;
+	regs[SYNC_IN]   = 0xFFFFFFFF;
+	checkLevels("levels from RIO_SYNC_IN, 28-pin mask", gpioLevels(),
+	  0xFFFFFFFULL);
+	regs[SYNC_IN]   = 0xA5A5A5A5;
+	checkLevels("levels pattern", gpioLevels(), 0x5A5A5A5ULL);
+
+	rp1 = false;
+	regs[BCM_GPLEV0] = 0x12345678;
+	regs[BCM_GPLEV1] = 0xFFFFFFFF;
+	checkLevels("BCM levels from GPLEV0/1", gpioLevels(),
+	  0xFFFFFFFF12345678ULL);
+
+	gpio = NULL;
+	checkLevels("no mapping reads as 0", gpioLevels(), 0);
+
+	munmap((void *)regs, RP1_MAP_SIZE);
+	if(path == tmp) unlink(tmp);
+	return failed;
+}
@@ -0,0 +1,273 @@
+/*
+Input latency check for retrogame's RUN command actions.  Runs a
+retrogame binary against a generated config whose input is a FIFO
+standing in for an input device (EVDEV command), and times each press
+from the write into the FIFO to the key event on retrogame's virtual
+device.  Two phases of the same length:
+
+  quiet     Presses on one button, ~20 per second
+  commands  The same presses, while a second button bound to a RUN
+            command is pressed every 300 ms; each command burns a full
+            CPU core for 200 ms (this program, re-run with -b)
+
+Latency includes the debounce time (20 ms).  With commands started via
+posix_spawn() and reaped off the signalfd, the two phases should match
+to within scheduling noise; a blocking system() or a slow fork() in the
+input loop shows up directly as added latency in the second phase.
+
+Usage: runlat [-t seconds] [-v] retrogame
+
+  -t  Length of each phase (default 5 seconds)
+  -v  Show retrogame's output
+
+Run as root, for retrogame's uinput device and for reading it back.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_PRESS 10000 // Max presses timed per phase
+
+static char     dir[] = "/tmp/runlatXXXXXX", self[256];
+static int      phaseSec = 5, verbose = 0;
+static uint32_t seed = 12345;
+
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+static int64_t usNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void sleepUntil(int64_t us) {
+	struct timespec t = { us / 1000000, us % 1000000 * 1000 };
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) ==
+	  EINTR);
+}
+
+// The RUN command: spin for ms milliseconds, tallying each run in 'ran'
+static int burn(int ms) {
+	char    path[128];
+	int64_t end = usNow() + ms * 1000;
+	int     fd;
+	sprintf(path, "%s/ran", dir);
+	if((fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0600)) >= 0) {
+		write(fd, "x", 1);
+		close(fd);
+	}
+	while(usNow() < end);
+	return 0;
+}
+
+// Write config and FIFO into dir
+static int setup(void) {
+	char  path[128];
+	FILE *fp;
+
+	sprintf(path, "%s/pad", dir);
+	if(mkfifo(path, 0600)) return -1;
+	sprintf(path, "%s/retrogame.cfg", dir);
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "DEBUG 0\n");
+	fprintf(fp, "EVDEV %s/pad 256 176 257 177\n", dir); // BTN_0, BTN_1
+	fprintf(fp, "BTN_SOUTH 176\n");
+	fprintf(fp, "RUN 0 177 %s -b 200 %s\n", self, dir);
+	return fclose(fp);
+}
+
+// Open FIFO for writing once retrogame has it open for reading
+static int fifoOpen(const char *name, pid_t pid) {
+	char path[128];
+	int  fd, i;
+	sprintf(path, "%s/%s", dir, name);
+	for(i=0; i<500; i++) { // Up to 5 seconds
+		if((fd = open(path, O_WRONLY | O_NONBLOCK)) >= 0) return fd;
+		if(waitpid(pid, NULL, WNOHANG)) break; // retrogame quit
+		usleep(10000);
+	}
+	return -1;
+}
+
+// Find and open retrogame's virtual device, event times on CLOCK_MONOTONIC
+static int devOpen(void) {
+	struct dirent *d;
+	DIR           *dp;
+	char           path[300], name[64];
+	int            fd = -1, clk = CLOCK_MONOTONIC, i;
+
+	for(i=0; (fd < 0) && (i<200); i++) { // Up to 2 seconds
+		if(i) usleep(10000);
+		if(!(dp = opendir("/dev/input"))) continue;
+		while((fd < 0) && (d = readdir(dp))) {
+			if(strncmp(d->d_name, "event", 5)) continue;
+			sprintf(path, "/dev/input/%s", d->d_name);
+			if((fd = open(path, O_RDONLY | O_NONBLOCK)) < 0)
+				continue;
+			if((ioctl(fd, EVIOCGNAME(sizeof(name)), name) < 0) ||
+			   strcmp(name, "retrogame")) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		closedir(dp);
+	}
+	if(fd >= 0) ioctl(fd, EVIOCSCLOCKID, &clk);
+	return fd;
+}
+
+// Send one button change to the FIFO
+static int sendKey(int fd, int code, int value) {
+	struct input_event e[2];
+	memset(e, 0, sizeof(e));
+	e[0].type  = EV_KEY;
+	e[0].code  = code;
+	e[0].value = value;
+	e[1].type  = EV_SYN;
+	return write(fd, e, sizeof(e)) == sizeof(e);
+}
+
+// Wait (up to 200 ms) for key event on dev; returns its time or -1
+static int64_t await(int dev, int value) {
+	struct pollfd      pf = { dev, POLLIN, 0 };
+	struct input_event e;
+	int64_t            end = usNow() + 200000;
+	while(poll(&pf, 1, (end - usNow()) / 1000 + 1) > 0) {
+		while(read(dev, &e, sizeof(e)) == sizeof(e)) {
+			if((e.type == EV_KEY) && (e.code == BTN_SOUTH) &&
+			   (e.value == value))
+				return e.input_event_sec * 1000000LL +
+				  e.input_event_usec;
+		}
+		if(usNow() > end) break;
+	}
+	return -1;
+}
+
+static int cmp(const void *a, const void *b) {
+	int64_t d = *(int64_t *)a - *(int64_t *)b;
+	return (d > 0) - (d < 0);
+}
+
+// One phase: timed presses for phaseSec, plus RUN button presses every
+// 300 ms if cmds.  Prints latency percentiles; returns presses lost.
+static int phase(const char *label, int pad, int dev, int cmds) {
+	static int64_t lat[MAX_PRESS];
+	int64_t        end = usNow() + phaseSec * 1000000LL, t, k, next;
+	int            n = 0, lost = 0;
+
+	for(next=usNow(); (t = usNow()) < end; ) {
+		if(cmds && (t >= next)) { // Tap the RUN button
+			sendKey(pad, 257, 1);
+			sleepUntil(t + 30000);
+			sendKey(pad, 257, 0);
+			next = t + 300000;
+		}
+		sleepUntil(usNow() + 10000 + rnd(20000));
+		t = usNow();
+		if(!sendKey(pad, 256, 1)) break;
+		if((k = await(dev, 1)) < 0) lost++;
+		else if(n < MAX_PRESS) lat[n++] = k - t;
+		sleepUntil(usNow() + 5000 + rnd(10000));
+		sendKey(pad, 256, 0);
+		await(dev, 0);
+	}
+	qsort(lat, n, sizeof(lat[0]), cmp);
+	if(n) printf("%-10s %8d %8.2f %8.2f %8.2f %8.2f %6d\n", label, n,
+	  lat[n / 2] / 1e3, lat[n * 95 / 100] / 1e3, lat[n * 99 / 100] / 1e3,
+	  lat[n - 1] / 1e3, lost);
+	return lost;
+}
+
+static int unlinkCb(const char *path, const struct stat *st, int flag,
+  struct FTW *f) {
+	return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+	char   cfg[128], path[128];
+	char  *args[] = { NULL, cfg, NULL };
+	int    c, fd, pad, dev, status = 1;
+	pid_t  pid;
+	struct stat st;
+
+	if((argc == 4) && !strcmp(argv[1], "-b")) { // RUN command
+		strcpy(dir, argv[3]);
+		return burn(atoi(argv[2]));
+	}
+	while((c = getopt(argc, argv, "t:v")) != -1) {
+		switch(c) {
+		   case 't': phaseSec = atoi(optarg); break;
+		   case 'v': verbose  = 1;            break;
+		   default:  optind   = argc + 1;     break;
+		}
+	}
+	if((optind != argc - 1) || (phaseSec < 1)) {
+		fprintf(stderr, "Usage: %s [-t seconds] [-v] retrogame\n",
+		  argv[0]);
+		return 1;
+	}
+	if((c = readlink("/proc/self/exe", self, sizeof(self) - 1)) > 0)
+		self[c] = 0;
+	if(!mkdtemp(dir) || setup()) {
+		fprintf(stderr, "%s: can't set up workload\n", argv[0]);
+		return 1;
+	}
+
+	sprintf(cfg, "%s/retrogame.cfg", dir);
+	args[0] = argv[optind];
+	if((pid = fork()) < 0) goto done;
+	if(!pid) {
+		if(!verbose && ((fd = open("/dev/null", O_WRONLY)) >= 0)) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+		setpgid(0, 0); // Not foreground, so no debug output
+		execv(args[0], args);
+		_exit(127);
+	}
+	if(((pad = fifoOpen("pad", pid)) < 0) || ((dev = devOpen()) < 0)) {
+		fprintf(stderr, "%s: '%s' failed (run as root? try -v)\n",
+		  argv[0], args[0]);
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		goto done;
+	}
+	sleepUntil(usNow() + 500000); // Settle
+
+	printf("%-10s %8s %8s %8s %8s %8s %6s\n", "phase", "presses",
+	  "p50 ms", "p95 ms", "p99 ms", "max ms", "lost");
+	status  = phase("quiet", pad, dev, 0);
+	status |= phase("commands", pad, dev, 1);
+	sleepUntil(usNow() + 300000); // Let the last command finish
+	sprintf(path, "%s/ran", dir);
+	printf("(%ld commands run)\n", stat(path, &st) ? 0L :
+	  (long)st.st_size);
+
+	close(pad);
+	close(dev);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+  done:
+	nftw(dir, unlinkCb, 8, FTW_DEPTH | FTW_PHYS);
+	return status ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/*
+ROM folder walking benchmark for gamera.  Generates a synthetic ROM
+collection split across several roots and nested subfolders, then times
+finding the NES ROM files in it (with the fceu filter, .zip files
+stat()'d, results sorted as for the menu) three ways:
+
+  readdir   One thread, recursive opendir()/readdir(), each match copied
+            into its own malloc()'d dirent -- the old scandir() approach
+            extended to subfolders
+  walk 1    gamera's getdents64() walker, one thread
+  walk N    The same with WALK_THREADS threads (gamera's default)
+
+  ms       Best time over the rounds
+  files/s  Entries (files and folders) read per second
+  found    ROM files found (must agree across methods)
+
+Usage: walkbench [-n files] [-d folders] [-r roots] [-t rounds] [-c]
+                 [-k dir]
+
+  -n  Files in the tree (default 100000); 80% .nes, 10% .zip, the rest
+      other files (saves, images, text) the filter rejects
+  -d  Folders per root (default 250), nested up to 4 deep
+  -r  Number of roots (default 2, e.g. SD card and a USB drive)
+  -t  Rounds (default 3)
+  -c  Drop the page cache before each timed run (needs root): cold
+      cache numbers, closer to a freshly-mounted USB drive
+  -k  Generate (and keep) the tree in this directory, rather than in a
+      temporary directory that's removed afterward
+
+Build with 'make walkbench'.
+*/
+
+#define _GNU_SOURCE
+#define main gamera_main
+#include "../gamera.c"
+#undef main
+#include <ftw.h>
+
+#define EMU 1 // fceu
+
+static uint32_t seed = 12345;
+static int      dropCache = 0;
+static long     entries;   // Files and folders in tree
+
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+static double msNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static const char *word[] = { "Galaxy", "Dragon", "Ninja", "Thunder",
+  "Force", "Street", "Fighter", "Power", "Blaster", "Knight", "Rally",
+  "Super", "Attack", "Warrior", "Space", "Quest", "Bubble", "Dig" };
+static const char *region[] = { "(U)", "(E)", "(J)", "(W)", "(U) [!]",
+  "(E) [b1]", "(J) [h2]" };
+static const char *other[] = { ".sav", ".png", ".txt", ".srm", ".cfg" };
+#define N_OF(a) (sizeof(a) / sizeof(a[0]))
+
+// Generate tree under dir: roots dir/root0..., each with nDirs folders
+// (random parents, so a mix of wide and deep), files spread among all.
+// Returns colon-separated root list (malloc'd), or NULL on error.
+static char *generate(const char *dir, int nFiles, int nDirs, int nRoots) {
+	char  **folder, path[PATH_MAX], *roots;
+	int    *depth, nFolders = nRoots * (nDirs + 1), i, j, p, fd;
+
+	folder = (char **)malloc(nFolders * sizeof(char *));
+	depth  = (int *)malloc(nFolders * sizeof(int));
+	roots  = (char *)malloc(nRoots * (strlen(dir) + 16));
+	if(!folder || !depth || !roots) return NULL;
+	roots[0] = 0;
+	for(i=0; i<nFolders; i++) {
+		if(!(i % (nDirs + 1))) { // Root
+			sprintf(path, "%s/root%d", dir, i / (nDirs + 1));
+			sprintf(&roots[strlen(roots)], "%s%s",
+			  i ? ":" : "", path);
+			depth[i] = 0;
+		} else {
+			// Parent: root or an earlier folder of this root,
+			// not too deep
+			do {
+				p = i - 1 - rnd(i % (nDirs + 1));
+			} while(depth[p] >= 4);
+			sprintf(path, "%s/%s %d", folder[p],
+			  word[rnd(N_OF(word))], i);
+			depth[i] = depth[p] + 1;
+		}
+		if(mkdir(path, 0755) || !(folder[i] = strdup(path)))
+			return NULL;
+	}
+	for(i=0; i<nFiles; i++) {
+		p = rnd(nFolders);
+		j = rnd(10);
+		sprintf(path, "%s/%s %s %d %s%s", folder[p],
+		  word[rnd(N_OF(word))], word[rnd(N_OF(word))], i,
+		  region[rnd(N_OF(region))], (j < 8) ? ".nes" :
+		  (j < 9) ? ".zip" : other[rnd(N_OF(other))]);
+		if((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+			return NULL;
+		close(fd);
+	}
+	entries = nFiles + nFolders;
+	for(i=0; i<nFolders; i++) free(folder[i]);
+	free(folder);
+	free(depth);
+	return roots;
+}
+
+// Old method, one folder: recurse into subfolders, copy matches
+static void readdirFolder(const char *path, struct dirent ***list,
+  int *n, int *max) {
+	char           sub[PATH_MAX];
+	struct dirent *d, *copy;
+	struct stat    st;
+	DIR           *dp;
+	size_t         len;
+
+	if(!(dp = opendir(path))) return;
+	while((d = readdir(dp))) {
+		if(d->d_name[0] == '.') continue;
+		if(d->d_type == DT_DIR) {
+			snprintf(sub, sizeof(sub), "%s/%s", path, d->d_name);
+			readdirFolder(sub, list, n, max);
+		} else if(((d->d_type == DT_REG) || (d->d_type == DT_LNK)) &&
+		  fceuFilter(d->d_name, strlen(d->d_name))) {
+			len = strlen(d->d_name);
+			if(!strcasecmp(&d->d_name[len - 4], ".zip"))
+				(void)fstatat(dirfd(dp), d->d_name, &st, 0);
+			if(*n >= *max) {
+				*max  = *max ? *max * 2 : 256;
+				*list = (struct dirent **)realloc(*list,
+				  *max * sizeof(struct dirent *));
+			}
+			len += offsetof(struct dirent, d_name) + 1;
+			if((copy = (struct dirent *)malloc(len))) {
+				memcpy(copy, d, len);
+				(*list)[(*n)++] = copy;
+			}
+		}
+	}
+	closedir(dp);
+}
+
+static int readdirCompare(const void *a, const void *b) {
+	return strcoll((*(struct dirent **)a)->d_name,
+	  (*(struct dirent **)b)->d_name);
+}
+
+// Old method, all roots; returns files found
+static int readdirAll(void) {
+	const char     *p = emulator[EMU].romPath, *root;
+	char            path[PATH_MAX];
+	struct dirent **list = NULL;
+	int             len, n = 0, max = 0;
+
+	while((len = rootNext(&p, &root)) >= 0) {
+		sprintf(path, "%.*s", len, root);
+		readdirFolder(path, &list, &n, &max);
+	}
+	qsort(list, n, sizeof(struct dirent *), readdirCompare);
+	for(len=0; len<n; len++) free(list[len]);
+	free(list);
+	return n;
+}
+
+// gamera's walker with the given thread count; returns files found
+static int walkAll(int threads) {
+	int n;
+	walkThreads = threads;
+	scanStart(EMU);
+	// Every file as found; no zip indexing (files are empty anyway)
+	while(!scan[EMU].list && !scanStep(EMU, 0));
+	scan[EMU].nKeep = n = scan[EMU].nList;
+	qsort(scan[EMU].list, n, sizeof(RomFile *), emulator[EMU].compar);
+	scanAbort(EMU);
+	return n;
+}
+
+static void drop(void) {
+	int fd;
+	sync();
+	if((fd = open("/proc/sys/vm/drop_caches", O_WRONLY)) >= 0) {
+		if(write(fd, "3", 1) != 1) dropCache = 0;
+		close(fd);
+	} else {
+		dropCache = 0;
+	}
+}
+
+static int unlinkCb(const char *path, const struct stat *st, int flag,
+  struct FTW *f) {
+	return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+	char         tmp[] = "/tmp/walkbenchXXXXXX", *dir = NULL, *roots,
+	             label[3][16];
+	double       t, best[3] = { 0, 0, 0 };
+	int          c, i, r, nFiles = 100000, nDirs = 250, nRoots = 2,
+	             rounds = 3, found[3];
+
+	while((c = getopt(argc, argv, "n:d:r:t:ck:")) != -1) {
+		switch(c) {
+		   case 'n': nFiles    = atoi(optarg); break;
+		   case 'd': nDirs     = atoi(optarg); break;
+		   case 'r': nRoots    = atoi(optarg); break;
+		   case 't': rounds    = atoi(optarg); break;
+		   case 'c': dropCache = 1;            break;
+		   case 'k': dir       = optarg;       break;
+		   default:  optind    = argc + 1;     break;
+		}
+	}
+	if((optind < argc) || (nFiles < 1) || (nDirs < 0) || (nRoots < 1) ||
+	   (rounds < 1)) {
+		fprintf(stderr, "Usage: %s [-n files] [-d folders] [-r roots] "
+		  "[-t rounds] [-c] [-k dir]\n", argv[0]);
+		return 1;
+	}
+	if(dir) {
+		(void)mkdir(dir, 0755);
+	} else if(!(dir = mkdtemp(tmp))) {
+		return 1;
+	}
+	fprintf(stderr, "generating %d files in %s...\n", nFiles, dir);
+	if(!(roots = generate(dir, nFiles, nDirs, nRoots))) {
+		fprintf(stderr, "%s: can't generate tree in %s (not empty?)\n",
+		  argv[0], dir);
+		return 1;
+	}
+	emulator[EMU].romPath = roots;
+
+	sprintf(label[0], "readdir");
+	sprintf(label[1], "walk 1");
+	sprintf(label[2], "walk %d", WALK_THREADS);
+	for(r=0; r<rounds; r++) {
+		for(i=0; i<3; i++) {
+			if(dropCache) drop();
+			t = msNow();
+			found[i] = i ? walkAll((i == 1) ? 1 : WALK_THREADS) :
+			  readdirAll();
+			t = msNow() - t;
+			if(!r || (t < best[i])) best[i] = t;
+		}
+	}
+
+	printf("%ld entries, %d roots, %s cache\n", entries, nRoots,
+	  dropCache ? "cold" : "warm");
+	printf("%-8s %10s %12s %8s\n", "method", "ms", "files/s", "found");
+	for(i=0; i<3; i++) {
+		printf("%-8s %10.1f %12.0f %8d\n", label[i], best[i],
+		  entries / best[i] * 1e3, found[i]);
+	}
+	if((found[1] != found[0]) || (found[2] != found[0])) {
+		fprintf(stderr, "%s: methods found different files\n", argv[0]);
+		return 1;
+	}
+
+	if(dir == tmp) nftw(dir, unlinkCb, 16, FTW_DEPTH | FTW_PHYS);
+	return 0;
+}
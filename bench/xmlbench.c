@@ -0,0 +1,294 @@
+/*
+Title extraction benchmark for gamera's MAME XML pass.  Times the fast
+listxml scanner (mameScan()) against the full expat parse (mameExpat())
+on the same mapped file, looking up the same list of ROM names, and
+checks that both find the same titles:
+
+  ms      Best time over the rounds, file already in the page cache
+  MB/s    File size over that time
+  titles  ROM names given a title from the file
+
+Usage: xmlbench [-s megabytes] [-n roms] [-r rounds] [-k] [file]
+
+  -s  Size of generated XML (default 200, about a full current MAME set)
+  -n  ROM names to look up (default 10000); 90% are in the file
+  -r  Rounds (default 3)
+  -k  Keep the generated file (its name is printed)
+
+With a file argument (e.g. real 'mame -listxml' output) that's used
+instead of a generated one, and ROM names are taken from it.  Generated
+files follow current MAME output: a DOCTYPE with internal DTD, then
+<machine> elements with ROMs, devices, chips, inputs and DIP switches,
+and descriptions using entity references (&amp;, &apos;, &#...;).
+
+Build with 'make xmlbench'.
+*/
+
+#define _GNU_SOURCE
+#define main gamera_main
+#include "../gamera.c"
+#undef main
+
+static uint32_t seed = 12345;
+
+static int rnd(int n) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % n;
+}
+
+static double msNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static const char *syl[] = { "pac", "gal", "don", "kong", "xe", "vi",
+  "ous", "ga", "ax", "fr", "gg", "sf", "mk", "tm", "nt", "bub", "ble",
+  "zer", "wing", "ro", "bot", "ron", "cen", "ti", "pede", "ast", "dig" };
+static const char *word[] = { "Galaxy", "Dragon", "Ninja", "Thunder",
+  "Force", "Street", "Fighter", "Power", "Blaster", "Knight", "Rally",
+  "Super", "Attack", "Warrior", "Space", "Quest", "Bubble", "Dig" };
+static const char *maker[] = { "Namco", "Nintendo", "Sega", "Capcom",
+  "Konami", "Taito", "Williams", "Atari", "SNK", "Data East" };
+#define N_OF(a) (sizeof(a) / sizeof(a[0]))
+
+// Unique machine name for index i
+static void name(char *buf, int i) {
+	int n;
+	buf[0] = 0;
+	for(n = 1 + rnd(2); n--; ) strcat(buf, syl[rnd(N_OF(syl))]);
+	sprintf(&buf[strlen(buf)], "%x", i);
+}
+
+// Description text, with the sort of entities real titles have
+static void title(char *buf) {
+	int n;
+	buf[0] = 0;
+	for(n = 1 + rnd(4); n--; ) {
+		if(buf[0]) strcat(buf, rnd(8) ? " " : " &amp; ");
+		strcat(buf, word[rnd(N_OF(word))]);
+	}
+	switch(rnd(10)) {
+	   case 0: strcat(buf, " (World, set 2)");      break;
+	   case 1: strcat(buf, " (bootleg)");           break;
+	   case 2: strcat(buf, " - Hero&apos;s Path");  break;
+	   case 3: strcat(buf, " (Pok&#233;mon ver.)"); break;
+	}
+}
+
+// Write generated listxml of about mb megabytes to path; returns
+// number of machines, or -1 on error
+static int generate(const char *path, int mb) {
+	FILE  *fp;
+	char   n[64], t[256];
+	int    i, j, k;
+	long   target = mb * 1048576L;
+
+	if(!(fp = fopen(path, "w"))) return -1;
+	fprintf(fp, "<?xml version=\"1.0\"?>\n<!DOCTYPE mame [\n"
+	  "<!ELEMENT mame (machine+)>\n"
+	  "\t<!ATTLIST mame build CDATA #IMPLIED>\n"
+	  "\t<!ELEMENT machine (description, year?, manufacturer?, rom*, "
+	  "device_ref*, chip*, display*, sound?, input?, dipswitch*, "
+	  "driver?)>\n"
+	  "\t\t<!ATTLIST machine name CDATA #REQUIRED>\n"
+	  "\t\t<!ATTLIST machine sourcefile CDATA #IMPLIED>\n"
+	  "\t\t<!ATTLIST machine cloneof CDATA #IMPLIED>\n"
+	  "\t\t<!ELEMENT description (#PCDATA)>\n"
+	  "]>\n\n<mame build=\"0.250 (mame0250)\" debug=\"no\" "
+	  "mameconfig=\"10\">\n");
+	for(i=0; ftell(fp) < target; i++) {
+		name(n, i);
+		title(t);
+		fprintf(fp, "\t<machine name=\"%s\" sourcefile=\"%s/%s.cpp\"",
+		  n, maker[rnd(N_OF(maker))], syl[rnd(N_OF(syl))]);
+		if(rnd(3)) fprintf(fp, " cloneof=\"%s%x\" romof=\"%s%x\"",
+		  syl[0], i / 3, syl[0], i / 3);
+		fprintf(fp, ">\n\t\t<description>%s</description>\n"
+		  "\t\t<year>19%d</year>\n"
+		  "\t\t<manufacturer>%s</manufacturer>\n", t, 78 + rnd(22),
+		  maker[rnd(N_OF(maker))]);
+		for(j = 2 + rnd(30); j--; ) {
+			fprintf(fp, "\t\t<rom name=\"%s.%d\" size=\"%d\" "
+			  "crc=\"%08x\" sha1=\"%08x%08x%08x%08x%08x\" "
+			  "region=\"maincpu\" offset=\"%x\"/>\n", n, j,
+			  4096 << rnd(6), rnd(1 << 30), rnd(1 << 30),
+			  rnd(1 << 30), rnd(1 << 30), rnd(1 << 30),
+			  rnd(1 << 30), j * 4096);
+		}
+		for(j = 1 + rnd(6); j--; )
+			fprintf(fp, "\t\t<device_ref name=\"%s\"/>\n",
+			  syl[rnd(N_OF(syl))]);
+		fprintf(fp, "\t\t<chip type=\"cpu\" tag=\"maincpu\" "
+		  "name=\"Zilog Z80\" clock=\"3072000\"/>\n"
+		  "\t\t<chip type=\"audio\" tag=\"speaker\" name=\"Speaker\"/>\n"
+		  "\t\t<display tag=\"screen\" type=\"raster\" rotate=\"%d\" "
+		  "width=\"288\" height=\"224\" refresh=\"60.606061\" "
+		  "pixclock=\"6144000\" htotal=\"384\" hbend=\"0\" "
+		  "hbstart=\"288\" vtotal=\"264\" vbend=\"0\" "
+		  "vbstart=\"224\"/>\n"
+		  "\t\t<sound channels=\"1\"/>\n"
+		  "\t\t<input players=\"2\" coins=\"2\">\n"
+		  "\t\t\t<control type=\"joy\" player=\"1\" buttons=\"%d\" "
+		  "ways=\"4\"/>\n"
+		  "\t\t</input>\n", rnd(4) * 90, 1 + rnd(6));
+		for(j = rnd(8); j--; ) {
+			fprintf(fp, "\t\t<dipswitch name=\"Coinage %d\" "
+			  "tag=\"DSW%d\" mask=\"7\">\n", j, j);
+			for(k=0; k<8; k++) {
+				fprintf(fp, "\t\t\t<diplocation name=\"SW%d\" "
+				  "number=\"%d\"/>\n", j, k + 1);
+				fprintf(fp, "\t\t\t<dipvalue name=\"%d Coin/%d "
+				  "Credit%s\" value=\"%d\"%s/>\n", 1 + k / 4,
+				  1 + k % 4, (k % 4) ? "s" : "", k,
+				  k ? "" : " default=\"yes\"");
+			}
+			fprintf(fp, "\t\t</dipswitch>\n");
+		}
+		fprintf(fp, "\t\t<driver status=\"good\" emulation=\"good\" "
+		  "savestate=\"supported\"/>\n\t</machine>\n");
+	}
+	fprintf(fp, "</mame>\n");
+	return fclose(fp) ? -1 : i;
+}
+
+// Up to max machine names from buf (every <game> or <machine> name)
+static int names(const char *buf, size_t len, char **out, int max) {
+	const char *p = buf, *end = buf + len, *q;
+	int         n = 0;
+	while((n < max) && (p = memmem(p, end - p, " name=\"", 7))) {
+		if(((p - buf >= 5) && !strncmp(p - 5, "<game", 5)) ||
+		   ((p - buf >= 8) && !strncmp(p - 8, "<machine", 8))) {
+			p += 7;
+			if(!(q = memchr(p, '"', end - p))) break;
+			out[n++] = strndup(p, q - p);
+		}
+		p += 7;
+	}
+	return n;
+}
+
+// Title lookup by one method: time it, count titles found
+static double run(const char *buf, size_t len, int expat, int *found) {
+	double t;
+	int    i;
+	for(i=0; i<mameCount; i++) {
+		free(mameArray[i].title);
+		mameArray[i].title = NULL;
+	}
+	t = msNow();
+	if(expat) mameExpat(buf, len);
+	else if(mameScan(buf, len)) {
+		fprintf(stderr, "(scanner fell back to expat)\n");
+		mameExpat(buf, len);
+	}
+	t = msNow() - t;
+	for(*found=i=0; i<mameCount; i++) if(mameArray[i].title) (*found)++;
+	return t;
+}
+
+int main(int argc, char *argv[]) {
+	char        path[] = "/tmp/xmlbenchXXXXXX", **list, **scanned,
+	           *file = NULL, *map;
+	struct stat st;
+	double      t, best[2] = { 0, 0 };
+	int         c, i, r, fd, mb = 200, nRoms = 10000, rounds = 3,
+	            keep = 0, nXml = 0, found[2], diff = 0;
+	Game       *g;
+	volatile char sum = 0;
+
+	while((c = getopt(argc, argv, "s:n:r:k")) != -1) {
+		switch(c) {
+		   case 's': mb     = atoi(optarg); break;
+		   case 'n': nRoms  = atoi(optarg); break;
+		   case 'r': rounds = atoi(optarg); break;
+		   case 'k': keep   = 1;            break;
+		   default:  optind = argc + 1;     break;
+		}
+	}
+	if((optind < argc - 1) || (mb < 1) || (nRoms < 1) || (rounds < 1)) {
+		fprintf(stderr, "Usage: %s [-s megabytes] [-n roms] "
+		  "[-r rounds] [-k] [file]\n", argv[0]);
+		return 1;
+	}
+	if(optind < argc) {
+		file = argv[optind];
+	} else {
+		if((fd = mkstemp(path)) < 0) return 1;
+		close(fd);
+		file = path;
+		fprintf(stderr, "generating %d MB in %s...\n", mb, file);
+		if((nXml = generate(file, mb)) < 0) {
+			fprintf(stderr, "%s: can't write %s\n", argv[0], file);
+			return 1;
+		}
+	}
+
+	if(((fd = open(file, O_RDONLY)) < 0) || fstat(fd, &st) ||
+	   ((map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+	   fd, 0)) == MAP_FAILED)) {
+		fprintf(stderr, "%s: can't map %s\n", argv[0], file);
+		return 1;
+	}
+	for(i=0; i<st.st_size; i+=4096) sum += map[i]; // Into page cache
+
+	// ROM list: 90% names from the file, spread through it; the rest
+	// not in it (shown by filename in gamera)
+	scanned = (char **)malloc(1000000 * sizeof(char *));
+	nXml    = names(map, st.st_size, scanned, 1000000);
+	list    = (char **)malloc(nRoms * sizeof(char *));
+	mameArray = (mameID *)calloc(nRoms, sizeof(mameID));
+	g       = (Game *)calloc(nRoms, sizeof(Game));
+	for(i=0; i<nRoms; i++) {
+		if(nXml && (i % 10)) {
+			list[i] = scanned[(long)i * nXml / nRoms];
+		} else {
+			list[i] = (char *)malloc(24);
+			sprintf(list[i], "nothere%d", i);
+		}
+		g[i].name         = list[i];
+		g[i].file         = list[i];
+		mameArray[i].g    = &g[i];
+	}
+	mameCount = nRoms;
+	qsort(mameArray, nRoms, sizeof(mameID), mameCompareName);
+
+	for(r=0; r<rounds; r++) {
+		for(i=0; i<2; i++) {
+			t = run(map, st.st_size, i, &found[i]);
+			if(!r || (t < best[i])) best[i] = t;
+		}
+	}
+
+	// Same titles both ways?  (expat results are still in mameArray)
+	char **expatTitle = (char **)malloc(nRoms * sizeof(char *));
+	for(i=0; i<nRoms; i++) {
+		expatTitle[i]      = mameArray[i].title;
+		mameArray[i].title = NULL;
+	}
+	run(map, st.st_size, 0, &found[0]);
+	for(i=0; i<nRoms; i++) {
+		if((!expatTitle[i] != !mameArray[i].title) || (expatTitle[i] &&
+		   strcmp(expatTitle[i], mameArray[i].title))) {
+			if(!diff++) fprintf(stderr, "'%s': '%s' vs '%s'\n",
+			  mameArray[i].g->name, mameArray[i].title,
+			  expatTitle[i]);
+		}
+	}
+
+	printf("%.1f MB, %d machines, %d ROM names\n",
+	  st.st_size / 1048576.0, nXml, nRoms);
+	printf("%-8s %10s %10s %8s\n", "method", "ms", "MB/s", "titles");
+	for(i=0; i<2; i++) {
+		printf("%-8s %10.1f %10.1f %8d\n", i ? "expat" : "scan",
+		  best[i], st.st_size / 1048576.0 / (best[i] / 1e3),
+		  found[i]);
+	}
+	printf("speedup  %9.1fx\n", best[1] / best[0]);
+	if(diff) printf("%d titles differ\n", diff);
+
+	munmap(map, st.st_size);
+	close(fd);
+	if(!keep && (file == path)) unlink(path);
+	return diff ? 1 : 0;
+}
@@ -18,11 +18,48 @@ Use the following command to generate the XML file:
 
 fceu does not have this option; the ROM filename is the only name displayed.
 
-advmame -must- be configured with 'z' and 'x' as the primary and secondary
-buttons, respectively (normally left ctrl and alt) for a seamless
-retrogame/gamera/advmame experience.  This is because handling raw keycodes
-with ncurses is a Pandora's Box of pure evil.  These lines should exist in
-the advmame.rc file:
+The XML file from a full MAME set runs to a couple hundred megabytes, so
+titles are picked out by a quick scan that relies on MAME's fixed output
+layout; anything that doesn't fit it goes through a full expat parse.
+
+Zip files are not taken at face value: each archive's central directory is
+read (without decompressing anything) so that broken, empty or non-ROM
+zips can be left out of the menu rather than failing at launch time.  The
+member list is cached in /var/cache/gamera, keyed on file size and mtime,
+so only new or changed archives are read on subsequent scans.  The final
+filtered, sorted listing for each emulator is cached there too, and shown
+immediately at startup; if any ROM folder has changed since, they're
+rescanned in the background while the menu is in use.
+
+Each emulator may have several ROM folders (e.g. the SD card and a USB
+drive), and subfolders within them are scanned too, so collections can be
+split up however is convenient.  Folders are read by a small pool of
+threads.
+
+Command line options (mostly for testing and benchmarking):
+
+    -c dir       Use alternate cache directory
+    -d           Hash ROM files; flag duplicates and known-bad dumps (CRC-32s
+                 listed in /boot/gamera-bad.txt) in the menu
+    -e device    Read controls from this evdev device (/dev/input/eventN)
+    -f           Report bytes written to terminal per keypress on stderr
+    -k           Terminal input only, don't look for an evdev device
+    -r emu=dirs  Use alternate ROM folder(s) for emulator ('mame' or 'fceu');
+                 separate multiple folders with ':' (e.g. -r
+                 mame=/boot/advmame/rom:/media/usb0/mame)
+    -t           Report time-to-menu (and background rescan) on stderr, exit
+    -x file      Use alternate MAME XML file (bench/gamerabench.c makes these)
+
+Controls are read directly from the retrogame virtual keyboard (or, if
+that's not present, the first gamepad or joystick found) through evdev,
+using real key and button codes; gamera does its own auto-repeat for list
+scrolling.  The device is grabbed while the menu is active, and released
+while an emulator runs.  If no such device exists, input falls back on the
+terminal via ncurses.  In that case only, advmame -must- be configured with
+'z' and 'x' as the primary and secondary buttons, respectively (normally
+left ctrl and alt) for a seamless retrogame/gamera/advmame experience.
+This is because handling raw keycodes with ncurses is a Pandora's Box of
+pure evil.  These lines should exist in the advmame.rc file:
 
  device_keyboard raw
  input_map[p1_button1] keyboard[0,lcontrol] or keyboard[0,z]
@@ -70,9 +107,69 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+#include <linux/input.h>
+
+// linux/input.h and ncurses.h both define KEY_UP and friends, with very
+// different values.  Capture the evdev codes that gamera needs, then drop
+// the Linux definitions so the ncurses ones are used everywhere else.
+enum {
+  EVKEY_UP    = KEY_UP,
+  EVKEY_DOWN  = KEY_DOWN,
+  EVKEY_LEFT  = KEY_LEFT,
+  EVKEY_RIGHT = KEY_RIGHT,
+  EVKEY_ENTER = KEY_ENTER,
+  EVKEY_CNT   = KEY_CNT
+};
+#undef KEY_BACKSPACE
+#undef KEY_BREAK
+#undef KEY_CANCEL
+#undef KEY_CLEAR
+#undef KEY_CLOSE
+#undef KEY_COPY
+#undef KEY_DOWN
+#undef KEY_END
+#undef KEY_ENTER
+#undef KEY_EXIT
+#undef KEY_F
+#undef KEY_FIND
+#undef KEY_HELP
+#undef KEY_HOME
+#undef KEY_LEFT
+#undef KEY_MAX
+#undef KEY_MOVE
+#undef KEY_NEXT
+#undef KEY_OPEN
+#undef KEY_PREVIOUS
+#undef KEY_PRINT
+#undef KEY_REDO
+#undef KEY_REFRESH
+#undef KEY_RESTART
+#undef KEY_RIGHT
+#undef KEY_SAVE
+#undef KEY_SELECT
+#undef KEY_SEND
+#undef KEY_SUSPEND
+#undef KEY_UNDO
+#undef KEY_UP
+
 #include <ncurses.h>
 #include <menu.h>
 #include <expat.h>
@@ -90,11 +187,76 @@ static const struct {
   { "/boot/cmdline.txt"            , "fbtft_device.rotate" } };
 #define N_TFT_FILES (sizeof(tftCfg) / sizeof(tftCfg[0]))
 
+// evdev key and button codes recognized for menu navigation, and the
+// equivalent ncurses keys.  Analog sticks and hats (ABS_X/Y, ABS_HAT0X/Y)
+// are handled separately: vertical moves up/down, horizontal pages.
+static const struct {
+  unsigned short code; // evdev code (KEY_* or BTN_*)
+  int            key;  // ncurses key
+} evKeys[] = {
+  { EVKEY_UP      , KEY_UP    }, { BTN_DPAD_UP   , KEY_UP    },
+  { EVKEY_DOWN    , KEY_DOWN  }, { BTN_DPAD_DOWN , KEY_DOWN  },
+  { EVKEY_LEFT    , KEY_PPAGE }, { BTN_DPAD_LEFT , KEY_PPAGE },
+  { EVKEY_RIGHT   , KEY_NPAGE }, { BTN_DPAD_RIGHT, KEY_NPAGE },
+  { KEY_PAGEUP    , KEY_PPAGE }, { BTN_TL        , KEY_PPAGE },
+  { KEY_PAGEDOWN  , KEY_NPAGE }, { BTN_TR        , KEY_NPAGE },
+  { EVKEY_ENTER   , '\n'      }, { KEY_KPENTER   , '\n'      },
+  { KEY_LEFTCTRL  , '\n'      }, { KEY_LEFTALT   , '\n'      },
+  { KEY_Z         , '\n'      }, { KEY_X         , '\n'      },
+  { BTN_SOUTH     , '\n'      }, { BTN_EAST      , '\n'      },
+  { BTN_START     , '\n'      }, { BTN_TRIGGER   , '\n'      },
+  { BTN_THUMB     , '\n'      }, { KEY_ESC       , 27        },
+  { KEY_R         , 'r'       } }; // Shift+R = 'R' (rotate & reboot)
+#define N_EV_KEYS (sizeof(evKeys) / sizeof(evKeys[0]))
+
+// Zip index and ROM listings are cached here between runs (-c overrides)
+static const char *cacheDir = "/var/cache/gamera";
+
+// Known-bad ROM CRC-32s (hex, one per line) for the -d option
+static const char badList[] = "/boot/gamera-bad.txt";
+
+// One member file within a zip archive, from the central directory
+typedef struct {
+  uint32_t  crc;  // CRC-32 of uncompressed data
+  uint32_t  size; // Uncompressed size in bytes
+  char     *name; // Member filename (may include path within archive)
+} ZipEntry;
+
+// Central directory summary for one zip file.  These are kept in a hash
+// table per emulator, and persist across rescans (and runs, via the cache
+// file) until the file's size or mtime changes.
+typedef struct ZipInfo {
+  char           *name;     // Key: ROM name, same as Game name
+  long long       mtime;    // File modification time when indexed
+  long long       size;     // File size when indexed (-1 = not indexed)
+  int             nEntries; // Member count (0 = unusable, -1 = zip64 etc.)
+  ZipEntry       *entry;    // Member list
+  char            desc[8];  // Menu annotation (total uncompressed size)
+  unsigned char   used;     // Seen during current scan
+  struct ZipInfo *next;     // Next in hash chain
+} ZipInfo;
+
+// One candidate ROM file found while walking an emulator's ROM folders.
+// These are carved out of per-thread memory blocks, not malloc()'d one
+// by one, and live until the scan is installed or abandoned.
+typedef struct {
+  int            len;   // Length of path
+  int            file;  // Offset of filename within path
+  int            key;   // Length of Game name (from filter function)
+  unsigned char  isZip; // Nonzero if .zip file (size & mtime are valid)
+  long long      size;  // File size (-1 = stat() failed)
+  long long      mtime; // File modification time
+  char           path[]; // Full pathname
+} RomFile;
+
 // For each emulator, a linked list of these Game structs is generated
-// when scanning the corresponding ROM directory.
+// when scanning the corresponding ROM directories.
 typedef struct Game {
   unsigned char emu;  // Index of parent emulator
-  char         *name; // ROM name (as passed to emulator; may be sans .zip)
+  char         *name; // ROM pathname (may be sans .zip, see mameCommand())
+  char         *file; // Filename part of name (past any folders)
+  ZipInfo      *zip;  // Zip index, if ROM is a zip file, else NULL
+  unsigned char flags; // GAME_DUP, GAME_BAD (with -d option)
   struct Game  *next; // Next game in linked list
 } Game;
 
@@ -103,24 +265,28 @@ typedef struct Game {
 static void
   mameInit(void), mameCommand(Game *, char *), fceuCommand(Game *, char *);
 static int
-  mameFilter(const struct dirent *), mameItemize(Game *, int),
-  fceuFilter(const struct dirent *), fceuItemize(Game *, int);
+  mameFilter(const char *, int), mameItemize(Game *, int),
+  fceuFilter(const char *, int), fceuItemize(Game *, int),
+  fceuCompare(const void *, const void *);
 
 // List of supported emulators
 static struct Emulator {
   const char *title;                           // Emulator name on menu
-  const char *romPath;                         // Absolute path to ROMs
+  const char *romPath;                         // ROM folder(s), ':'-separated
+  const char *tag;                             // Cache filename prefix
+  const char *nameExt;                         // Stripped from Game name
+  const char *zipExt;                          // Required in zip (or NULL)
   Game       *gameList;                        // Linked list of Games
   void       (*init)(void);                    // Emulator-specific setup
-  int        (*filter)(const struct dirent *); // ID ROMs for scandir()
-  int        (*compar)(const struct dirent **, const struct dirent**);
+  int        (*filter)(const char *, int);     // ID ROMs by filename
+  int        (*compar)(const void *, const void *); // Sort RomFiles
   int        (*itemize)(Game *, int);          // Filenames to item list
   void       (*command)(Game *, char *);       // Prepare command line
 } emulator[] = {
-  { "MAME:", "/boot/advmame/rom", NULL,
-     mameInit, mameFilter, NULL     , mameItemize, mameCommand },
-  { "NES:" , "/boot/fceu/rom"   , NULL,
-     NULL    , fceuFilter, alphasort, fceuItemize, fceuCommand }
+  { "MAME:", "/boot/advmame/rom", "mame", ".zip", NULL  , NULL,
+     mameInit, mameFilter, NULL       , mameItemize, mameCommand },
+  { "NES:" , "/boot/fceu/rom"   , "fceu", NULL  , ".nes", NULL,
+     NULL    , fceuFilter, fceuCompare, fceuItemize, fceuCommand }
 };
 #define N_EMULATORS (sizeof(emulator) / sizeof(emulator[0]))
 
@@ -131,19 +297,1008 @@ MENU   *menu     = NULL;
 ITEM  **items    = NULL;
 
 
+// Zip archive indexing --------------------------------------------------
+
+// Rather than trusting the .zip extension alone, each archive's central
+// directory is read to confirm it's intact and actually holds ROM data.
+// Only the tail of the file is mapped: the end-of-central-directory
+// record is in the last 64K (at most) and normally points to a central
+// directory immediately before it, so this is a few KB of I/O per zip.
+
+#define ZIP_EOCD_SIG 0x06054b50           // End of central dir signature
+#define ZIP_CDIR_SIG 0x02014b50           // Central dir header signature
+#define ZIP_EOCD_LEN 22                   // Fixed part of EOCD record
+#define ZIP_CDIR_LEN 46                   // Fixed part of central dir hdr
+#define ZIP_MAX_TAIL (ZIP_EOCD_LEN+65535) // EOCD + max comment length
+#define ZIP_BUCKETS  4096                 // Hash table size (per emulator)
+
+static ZipInfo       *zipTable[N_EMULATORS][ZIP_BUCKETS];
+static unsigned char  zipLoaded[N_EMULATORS], // Cache file read?
+                      zipDirty[N_EMULATORS];  // Cache file needs write?
+
+// Bytes written to cache files, so the -f frame-cost report can exclude
+// them and count only output to the terminal.
+static long long cacheBytes = 0;
+
+static uint16_t le16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// FNV-1a hash of first len chars of string, for zipTable[] lookup
+static unsigned int zipHash(const char *str, int len) {
+	uint32_t h = 2166136261u;
+	while(len--) h = (h ^ (uint8_t)*str++) * 16777619u;
+	return h % ZIP_BUCKETS;
+}
+
+// Locate ZipInfo for emulator e by name (first len chars), NULL if absent
+static ZipInfo *zipLookup(int e, const char *name, int len) {
+	ZipInfo *z;
+	for(z = zipTable[e][zipHash(name, len)]; z &&
+	  (strncmp(z->name, name, len) || z->name[len]); z = z->next);
+	return z;
+}
+
+// Same, but allocate and insert a new (unindexed) ZipInfo if not found
+static ZipInfo *zipAdd(int e, const char *name, int len) {
+	ZipInfo     *z;
+	unsigned int h;
+
+	if((z = zipLookup(e, name, len))) return z;
+	if((z = (ZipInfo *)calloc(1, sizeof(ZipInfo)))) {
+		if((z->name = strndup(name, len))) {
+			h           = zipHash(name, len);
+			z->size     = -1;
+			z->next     = zipTable[e][h];
+			zipTable[e][h] = z;
+		} else {
+			free(z);
+			z = NULL;
+		}
+	}
+	return z;
+}
+
+// Free member list of a ZipInfo, leaving it in the unusable state
+static void zipClear(ZipInfo *z) {
+	int i;
+	if(z->entry) {
+		for(i=0; i<z->nEntries; i++) free(z->entry[i].name);
+		free(z->entry);
+		z->entry = NULL;
+	}
+	z->nEntries = 0;
+	z->desc[0]  = 0;
+}
+
+// Format total uncompressed size as a menu item description
+static void zipAnnotate(ZipInfo *z) {
+	uint64_t total = 0;
+	int      i;
+
+	for(i=0; i<z->nEntries; i++) total += z->entry[i].size;
+	total = (total + 1023) / 1024;
+	if(z->nEntries <= 0)  z->desc[0] = 0;
+	else if(total < 1024) (void)sprintf(z->desc, "%4uK", (unsigned)total);
+	else (void)sprintf(z->desc, "%4uM", (unsigned)((total + 1023) / 1024));
+}
+
+// Copy n central directory file headers into z->entry[].
+// Returns 0 on success, -1 if directory is truncated or corrupt.
+static int zipParseDir(ZipInfo *z, const uint8_t *cd, uint32_t cdSize,
+  int n) {
+	const uint8_t *end = cd + cdSize;
+	int            nameLen;
+
+	if(!n) return 0;
+	if(!(z->entry = (ZipEntry *)calloc(n, sizeof(ZipEntry)))) return -1;
+	while(z->nEntries < n) {
+		if((cd + ZIP_CDIR_LEN > end) || (le32(cd) != ZIP_CDIR_SIG))
+			return -1;
+		nameLen = le16(&cd[28]);
+		if(cd + ZIP_CDIR_LEN + nameLen > end) return -1;
+		z->entry[z->nEntries].crc  = le32(&cd[16]);
+		z->entry[z->nEntries].size = le32(&cd[24]);
+		if(!(z->entry[z->nEntries].name =
+		  strndup((char *)&cd[ZIP_CDIR_LEN], nameLen))) return -1;
+		z->nEntries++;
+		cd += ZIP_CDIR_LEN + nameLen + le16(&cd[30]) + le16(&cd[32]);
+	}
+	return 0;
+}
+
+// Read zip central directory from open file into ZipInfo struct.
+// Returns 0 on success, -1 if not a valid zip.
+static int zipParse(ZipInfo *z, int fd, off_t size) {
+	off_t     pageMask = ~(off_t)(sysconf(_SC_PAGESIZE) - 1),
+	          tail, mapStart, eocdPos, cdOff, cdStart;
+	size_t    mapLen;
+	uint8_t  *map, *eocd, *cdMap;
+	uint32_t  cdSize;
+	int       n, status = -1;
+
+	if(size < ZIP_EOCD_LEN) return -1;
+	tail     = (size > ZIP_MAX_TAIL) ? (size - ZIP_MAX_TAIL) : 0;
+	mapStart = tail & pageMask;
+	mapLen   = size - mapStart;
+	if((map = (uint8_t *)mmap(NULL, mapLen, PROT_READ, MAP_PRIVATE,
+	  fd, mapStart)) == MAP_FAILED) return -1;
+
+	// EOCD is followed only by a variable-length comment; scan backward
+	for(eocd = &map[mapLen - ZIP_EOCD_LEN];
+	  (eocd >= &map[tail - mapStart]) && (le32(eocd) != ZIP_EOCD_SIG);
+	  eocd--);
+
+	if(eocd >= &map[tail - mapStart]) {
+		eocdPos = mapStart + (eocd - map);
+		n       = le16(&eocd[10]); // Total number of entries
+		cdSize  = le32(&eocd[12]);
+		cdOff   = le32(&eocd[16]);
+		if((n == 0xFFFF) || (cdOff == 0xFFFFFFFF)) {
+			// Zip64 -- not something MAME or NES sets produce.
+			// Allow it through, but there's nothing to index.
+			z->nEntries = -1;
+			status      = 0;
+		} else if(cdOff + cdSize <= eocdPos) {
+			if(cdOff >= mapStart) { // Usual case, already mapped
+				status = zipParseDir(z,
+				  &map[cdOff - mapStart], cdSize, n);
+			} else { // Huge central directory, map separately
+				cdStart = cdOff & pageMask;
+				if((cdMap = (uint8_t *)mmap(NULL,
+				  cdOff + cdSize - cdStart, PROT_READ,
+				  MAP_PRIVATE, fd, cdStart)) != MAP_FAILED) {
+					status = zipParseDir(z,
+					  &cdMap[cdOff - cdStart], cdSize, n);
+					munmap(cdMap, cdOff + cdSize - cdStart);
+				}
+			}
+		}
+	}
+
+	munmap(map, mapLen);
+	return status;
+}
+
+// Returns 1 if ZipInfo looks like a game: has at least one non-empty
+// file (with the emulator's required extension, if any).
+static int zipUsable(ZipInfo *z, const char *ext) {
+	int   i, len, extLen;
+	char *name;
+
+	if(z->nEntries < 0) return 1; // Couldn't index, give benefit of doubt
+	extLen = ext ? strlen(ext) : 0;
+	for(i=0; i<z->nEntries; i++) {
+		if(!z->entry[i].size || !(name = z->entry[i].name)) continue;
+		len = strlen(name);
+		if(!len || (name[len - 1] == '/')) continue; // Directory
+		if(!ext || ((len > extLen) &&
+		  !strcasecmp(&name[len - extLen], ext))) return 1;
+	}
+	return 0;
+}
+
+// Called from scanStep() for each .zip file found for emulator e:
+// (re)index the file if new or changed since last indexed (size and
+// mtime were fetched by the folder walker), mark as seen during this
+// scan.  The first f->key chars of f->path are the Game name.  Returns
+// the ZipInfo, or NULL if not a usable ROM file.
+static ZipInfo *zipIndex(int e, const RomFile *f) {
+	ZipInfo *z;
+	int      fd;
+
+	if((f->size < 0) || !(z = zipAdd(e, f->path, f->key))) return NULL;
+
+	if((z->mtime != f->mtime) || (z->size != f->size)) {
+		zipClear(z);
+		if((fd = open(f->path, O_RDONLY)) >= 0) {
+			if(zipParse(z, fd, f->size)) zipClear(z);
+			close(fd);
+		}
+		zipAnnotate(z);
+		z->mtime = f->mtime;
+		z->size  = f->size;
+		zipDirty[e] = 1;
+	}
+
+	z->used = 1;
+	return zipUsable(z, emulator[e].zipExt) ? z : NULL;
+}
+
+// Finish a ZipInfo record read from the cache file; n is the expected
+// entry count.  An incomplete record is left unindexed, so the file is
+// read again during the scan.
+static void zipLoadEnd(ZipInfo *z, int n) {
+	if(z) {
+		if((z->nEntries >= 0) && (z->nEntries != n)) z->size = -1;
+		zipAnnotate(z);
+	}
+}
+
+// Read zip index cache file for emulator e.  Format is one line per zip:
+//   Z <mtime> <size> <entry count> <name>
+// followed by a line per member:
+//   M <crc> <size> <name>
+static void zipLoad(int e) {
+	char       path[256], line[PATH_MAX + 64];
+	FILE      *fp;
+	ZipInfo   *z = NULL;
+	long long  mtime, size;
+	unsigned   crc, usize;
+	int        n = 0, cnt, pos;
+
+	zipLoaded[e] = 1;
+	(void)sprintf(path, "%s/%s.zip", cacheDir, emulator[e].tag);
+	if(!(fp = fopen(path, "r"))) return;
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = 0;
+		if(sscanf(line, "Z %lld %lld %d %n",
+		  &mtime, &size, &cnt, &pos) == 3) {
+			zipLoadEnd(z, n);
+			n = cnt;
+			if(!(z = zipAdd(e, &line[pos], strlen(&line[pos]))))
+				break;
+			zipClear(z);
+			z->mtime = mtime;
+			z->size  = size;
+			if(n < 0) {
+				z->nEntries = -1;
+			} else if(n && !(z->entry =
+			  (ZipEntry *)calloc(n, sizeof(ZipEntry)))) {
+				z->size = -1;
+			}
+		} else if(z && z->entry && (z->nEntries < n) &&
+		  (sscanf(line, "M %x %u %n", &crc, &usize, &pos) == 2)) {
+			if(!(z->entry[z->nEntries].name = strdup(&line[pos])))
+				break;
+			z->entry[z->nEntries].crc  = crc;
+			z->entry[z->nEntries].size = usize;
+			z->nEntries++;
+		}
+	}
+	zipLoadEnd(z, n);
+	fclose(fp);
+}
+
+// After scanning, discard index entries for files no longer present,
+// and rewrite cache file for emulator e if anything changed.
+static void zipSave(int e) {
+	char      path[256], tmp[260];
+	FILE     *fp = NULL;
+	ZipInfo **zp, *z;
+	int       h, i;
+
+	for(h=0; h<ZIP_BUCKETS; h++) {
+		for(zp = &zipTable[e][h]; (z = *zp); ) {
+			if(z->used) {
+				z->used = 0;
+				zp      = &z->next;
+			} else {
+				*zp = z->next;
+				zipClear(z);
+				free(z->name);
+				free(z);
+				zipDirty[e] = 1;
+			}
+		}
+	}
+	if(!zipDirty[e]) return;
+
+	(void)mkdir(cacheDir, 0755);
+	(void)sprintf(path, "%s/%s.zip", cacheDir, emulator[e].tag);
+	(void)sprintf(tmp, "%s.tmp", path);
+	if(!(fp = fopen(tmp, "w"))) return;
+	for(h=0; h<ZIP_BUCKETS; h++) {
+		for(z = zipTable[e][h]; z; z = z->next) {
+			if(z->size < 0) continue;
+			fprintf(fp, "Z %lld %lld %d %s\n",
+			  z->mtime, z->size, z->nEntries, z->name);
+			for(i=0; i<z->nEntries; i++) {
+				fprintf(fp, "M %08x %u %s\n", z->entry[i].crc,
+				  z->entry[i].size, z->entry[i].name);
+			}
+		}
+	}
+	cacheBytes += ftell(fp);
+	if(!fclose(fp) && !rename(tmp, path)) zipDirty[e] = 0;
+	else unlink(tmp);
+}
+
+// ROM folder walking ----------------------------------------------------
+
+// Each emulator's romPath is a list of folders (e.g. the SD card plus a
+// USB drive), all scanned recursively.  A few threads share a queue of
+// folders to read, using getdents64() directly with a large buffer (far
+// fewer system calls than readdir() on big folders) and the d_type it
+// returns, so files needn't be stat()'d to tell them from folders.  Only
+// .zip files, whose size and mtime the zip index needs, are stat()'d.
+// Names found go into per-thread memory blocks rather than individual
+// malloc()s; the per-thread lists are merged and sorted at the end.
+
+#define WALK_THREADS 4          // Max folder reader threads per scan
+#define WALK_BUF     (64 << 10) // getdents64() buffer size
+#define WALK_BLOCK   (64 << 10) // Name storage block size
+#define WALK_DEPTH   16         // Max folder nesting below a root
+
+// Kernel's directory entry format for getdents64()
+struct linuxDirent64 {
+  uint64_t       d_ino;
+  int64_t        d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[];
+};
+
+// Storage for names found, freed all at once with the walk
+typedef struct WalkBlock {
+  struct WalkBlock *next; // Previous (full) block
+  size_t            used; // Bytes used in data[]
+  char              data[] __attribute__((aligned(8)));
+} WalkBlock;
+
+// One folder, queued to be read and then kept as a record of its
+// identity (for validating the listing cache)
+typedef struct WalkDir {
+  struct WalkDir *next;  // Next in queue, then in reader's list
+  long long       dev;   // Folder device, inode and mtime when
+  long long       ino;   //   read (all zero if it couldn't be)
+  long long       mtime;
+  int             depth; // Nesting below root (0 = root)
+  int             len;   // Length of path
+  char            path[]; // Full pathname, no trailing slash
+} WalkDir;
+
+struct Walk;
+
+// Per-thread state
+typedef struct {
+  struct Walk  *walk;    // Walk this thread belongs to
+  pthread_t     thread;
+  WalkBlock    *block;   // Name storage
+  WalkDir      *dirs;    // Folders read by this thread
+  RomFile     **list;    // Files that passed the filter function
+  int           nList;   // Number of entries in list
+  int           maxList; // Allocated size of list
+} Walker;
+
+// A walk in progress (or finished) over all of one emulator's folders
+typedef struct Walk {
+  int             emu;      // Emulator index
+  pthread_mutex_t lock;     // Guards queue, pending and stop
+  pthread_cond_t  cond;     // Signaled on new work and on completion
+  WalkDir        *queue;    // Folders waiting to be read
+  int             pending;  // Folders queued or being read
+  int             stop;     // Set to abandon walk
+  int             nThreads; // Threads started
+  WalkDir       **root;     // Root folders, in romPath order
+  int             nRoots;
+  Walker          walker[WALK_THREADS];
+} Walk;
+
+static int walkThreads = WALK_THREADS; // Threads per scan (bench tweaks)
+
+// Next root folder in colon-separated list at *p: sets *root to its
+// start and advances *p past it.  Returns its length, less any trailing
+// slashes (so "/" is 0), or -1 at end of list.  Empty entries are skipped.
+static int rootNext(const char **p, const char **root) {
+	int len;
+	while(**p == ':') (*p)++;
+	if(!**p) return -1;
+	*root = *p;
+	len   = strcspn(*p, ":");
+	*p   += len;
+	while(len && ((*root)[len - 1] == '/')) len--;
+	return len;
+}
+
+// Allocate len bytes from walker's storage blocks; NULL if out of memory
+static void *walkAlloc(Walker *w, size_t len) {
+	WalkBlock *b = w->block;
+	void      *ptr;
+	size_t     size;
+
+	len = (len + 7) & ~7;
+	if(!b || (b->used + len > WALK_BLOCK)) {
+		size = (len > WALK_BLOCK) ? len : WALK_BLOCK;
+		if(!(b = (WalkBlock *)malloc(sizeof(WalkBlock) + size)))
+			return NULL;
+		b->next  = w->block;
+		b->used  = 0;
+		w->block = b;
+	}
+	ptr      = &b->data[b->used];
+	b->used += len;
+	return ptr;
+}
+
+// New folder record for name within parent (or for root, if no parent)
+static WalkDir *walkDirNew(Walker *w, const WalkDir *parent,
+  const char *name, int len) {
+	WalkDir *d;
+	int      plen = parent ? parent->len + 1 : 0;
+
+	if((plen + len >= PATH_MAX) ||
+	  !(d = (WalkDir *)walkAlloc(w, sizeof(WalkDir) + plen + len + 1)))
+		return NULL;
+	if(parent) {
+		memcpy(d->path, parent->path, parent->len);
+		d->path[parent->len] = '/';
+	}
+	memcpy(&d->path[plen], name, len);
+	d->path[plen + len] = 0;
+	d->len   = plen + len;
+	d->depth = parent ? parent->depth + 1 : 0;
+	d->dev   = d->ino = d->mtime = 0;
+	return d;
+}
+
+// Add folder to the walk's queue
+static void walkQueue(Walk *k, WalkDir *d) {
+	pthread_mutex_lock(&k->lock);
+	d->next  = k->queue;
+	k->queue = d;
+	k->pending++;
+	pthread_cond_signal(&k->cond);
+	pthread_mutex_unlock(&k->lock);
+}
+
+// Add file name (of length len, Game name length key) in folder d to
+// walker's list.  dirFd is the open folder, for stat()ing zips.
+static void walkFile(Walker *w, const WalkDir *d, int dirFd,
+  const char *name, int len, int key) {
+	struct stat st;
+	RomFile    *f, **list;
+	int         n;
+
+	if(w->nList >= w->maxList) {
+		n = w->maxList ? w->maxList * 2 : 1024;
+		if(!(list = (RomFile **)realloc(w->list, n * sizeof(*list))))
+			return;
+		w->list    = list;
+		w->maxList = n;
+	}
+	if((d->len + 1 + len >= PATH_MAX) ||
+	  !(f = (RomFile *)walkAlloc(w, sizeof(RomFile) + d->len + len + 2)))
+		return;
+	memcpy(f->path, d->path, d->len);
+	f->path[d->len] = '/';
+	memcpy(&f->path[d->len + 1], name, len + 1);
+	f->file  = d->len + 1;
+	f->len   = f->file + len;
+	f->key   = f->file + key;
+	f->size  = -1;
+	f->mtime = 0;
+	if((f->isZip = (len > 4) && !strcasecmp(&name[len - 4], ".zip")) &&
+	  !fstatat(dirFd, name, &st, 0) && S_ISREG(st.st_mode)) {
+		f->size  = st.st_size;
+		f->mtime = st.st_mtime;
+	}
+	w->list[w->nList++] = f;
+}
+
+// Read one folder: queue subfolders, list files passing the filter
+static void walkDir(Walker *w, WalkDir *d) {
+	char                  buf[WALK_BUF] __attribute__((aligned(8)));
+	struct linuxDirent64 *de;
+	struct stat           st;
+	WalkDir              *sub;
+	int                   fd, len, key, type;
+	long                  n, pos;
+	int                 (*filter)(const char *, int) =
+	                        emulator[w->walk->emu].filter;
+
+	if((fd = open(d->len ? d->path : "/", // "/" root is ""
+	  O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) return;
+	if(!fstat(fd, &st)) {
+		d->dev   = st.st_dev;
+		d->ino   = st.st_ino;
+		d->mtime = st.st_mtime;
+	}
+	while(!w->walk->stop &&
+	  ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)) {
+		for(pos=0; pos<n; pos += de->d_reclen) {
+			de = (struct linuxDirent64 *)&buf[pos];
+			if(de->d_name[0] == '.') continue; // Dotfiles, . and ..
+			len  = strlen(de->d_name);
+			type = de->d_type;
+			if((type == DT_UNKNOWN) && !fstatat(fd, de->d_name,
+			  &st, AT_SYMLINK_NOFOLLOW)) // Some filesystems
+				type = IFTODT(st.st_mode);
+			if(type == DT_DIR) {
+				// Symlinked folders aren't followed (no loops)
+				if((d->depth < WALK_DEPTH) &&
+				  (sub = walkDirNew(w, d, de->d_name, len)))
+					walkQueue(w->walk, sub);
+			} else if(((type == DT_REG) || (type == DT_LNK)) &&
+			  (key = filter(de->d_name, len))) {
+				walkFile(w, d, fd, de->d_name, len, key);
+			}
+		}
+	}
+	close(fd);
+}
+
+// Thread function: read queued folders until none remain (or stopped)
+static void *walkWorker(void *arg) {
+	Walker  *w = (Walker *)arg;
+	Walk    *k = w->walk;
+	WalkDir *d;
+
+	pthread_mutex_lock(&k->lock);
+	for(;;) {
+		while(!k->queue && k->pending && !k->stop)
+			pthread_cond_wait(&k->cond, &k->lock);
+		if(!(d = k->queue) || k->stop) break;
+		k->queue = d->next;
+		pthread_mutex_unlock(&k->lock);
+		walkDir(w, d);
+		d->next = w->dirs;
+		w->dirs = d;
+		pthread_mutex_lock(&k->lock);
+		if(!--k->pending) pthread_cond_broadcast(&k->cond);
+	}
+	pthread_mutex_unlock(&k->lock);
+	return NULL;
+}
+
+// Begin walking emulator e's ROM folders.  Returns NULL if out of memory.
+static Walk *walkStart(int e) {
+	const char *p = emulator[e].romPath, *root;
+	Walk       *k;
+	WalkDir    *d;
+	int         i, len;
+
+	if(!(k = (Walk *)calloc(1, sizeof(Walk)))) return NULL;
+	k->emu = e;
+	pthread_mutex_init(&k->lock, NULL);
+	pthread_cond_init(&k->cond, NULL);
+	for(i=0; i<WALK_THREADS; i++) k->walker[i].walk = k;
+
+	for(i=0; rootNext(&p, &root) >= 0; i++);
+	if(i && !(k->root = (WalkDir **)walkAlloc(&k->walker[0],
+	  i * sizeof(WalkDir *)))) i = 0;
+	for(p=emulator[e].romPath; (k->nRoots < i) &&
+	  ((len = rootNext(&p, &root)) >= 0); ) {
+		// Queued in reverse, so first root is read first
+		if((d = walkDirNew(&k->walker[0], NULL, root, len))) {
+			k->root[k->nRoots++] = d;
+		}
+	}
+	for(i=k->nRoots; i--; ) walkQueue(k, k->root[i]);
+
+	// pthread_create() failures just mean fewer threads; with none
+	// at all, the walk is done right here.
+	for(i=0; i<walkThreads; i++) {
+		if(pthread_create(&k->walker[i].thread, NULL,
+		  walkWorker, &k->walker[i])) break;
+	}
+	if(!(k->nThreads = i)) walkWorker(&k->walker[0]);
+	return k;
+}
+
+// Wait up to ms milliseconds (-1 = indefinitely) for walk to finish.
+// Returns 1 if finished (threads joined), 0 if still in progress.
+static int walkWait(Walk *k, int ms) {
+	struct timespec t;
+	int             i;
+
+	pthread_mutex_lock(&k->lock);
+	if(ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &t);
+		t.tv_nsec += ms * 1000000L;
+		t.tv_sec  += t.tv_nsec / 1000000000L;
+		t.tv_nsec %= 1000000000L;
+		while(k->pending && !k->stop &&
+		  !pthread_cond_timedwait(&k->cond, &k->lock, &t));
+	}
+	i = !k->pending || k->stop || (ms < 0);
+	pthread_mutex_unlock(&k->lock);
+	if(!i) return 0;
+
+	for(i=0; i<k->nThreads; i++) pthread_join(k->walker[i].thread, NULL);
+	k->nThreads = 0;
+	return 1;
+}
+
+// Stop walk (if still running) and free everything from it
+static void walkFree(Walk *k) {
+	WalkBlock *b;
+	int        i;
+
+	pthread_mutex_lock(&k->lock);
+	k->stop = 1;
+	pthread_cond_broadcast(&k->cond);
+	pthread_mutex_unlock(&k->lock);
+	(void)walkWait(k, -1);
+	for(i=0; i<WALK_THREADS; i++) {
+		while((b = k->walker[i].block)) {
+			k->walker[i].block = b->next;
+			free(b);
+		}
+		free(k->walker[i].list);
+	}
+	pthread_mutex_destroy(&k->lock);
+	pthread_cond_destroy(&k->cond);
+	free(k);
+}
+
+// ROM hashing and duplicate detection -----------------------------------
+
+// With -d, the full contents of every ROM file are CRC-32'd (the same
+// CRC used in zip files and most ROM checksum lists) to find duplicates
+// and known bad dumps.  Files are mmap()'d and hashed by a pool of
+// threads, one per CPU core; results are cached by name, size and mtime
+// so only new or changed files are read on later runs.  Zips are also
+// compared by their member CRCs, which catches copies that were merely
+// recompressed, and any member CRC may match the known-bad list.
+
+#define GAME_DUP  0x01    // Game.flags: same contents as an earlier ROM
+#define GAME_BAD  0x02    // Game.flags: CRC is in the known-bad list
+#define HASH_CHUNK (16 << 20) // mmap() window for hashing large files
+
+static uint32_t crcTable[8][256]; // Slicing-by-8 tables
+
+// One file to be hashed, or a cached result
+typedef struct {
+  Game      *g;     // Game this result belongs to
+  char      *path;  // File to hash, or NULL if cached result is current
+  long long  size;  // File size
+  long long  mtime; // File modification time
+  uint32_t   crc;   // CRC-32 of file contents
+  int        ok;    // Nonzero if crc is valid
+} HashJob;
+
+static HashJob      *hashJob;       // All ROM files, largest first
+static int           nHashJobs;
+static volatile int  hashNext;      // Next job index for worker threads
+static int           checkDups = 0; // Set by -d option
+
+static void crcInit(void) {
+	uint32_t c;
+	int      i, j;
+
+	for(i=0; i<256; i++) {
+		for(c=i, j=0; j<8; j++) c = (c >> 1) ^ ((c & 1) ? 0xEDB88320 : 0);
+		crcTable[0][i] = c;
+	}
+	for(i=0; i<256; i++) {
+		for(j=1; j<8; j++) {
+			crcTable[j][i] = (crcTable[j-1][i] >> 8) ^
+			  crcTable[0][crcTable[j-1][i] & 0xFF];
+		}
+	}
+}
+
+// Update running CRC-32 (pre- and post-inverted by caller) with buffer
+static uint32_t crcUpdate(uint32_t crc, const uint8_t *buf, size_t len) {
+#ifdef __ARM_FEATURE_CRC32
+	// ARMv8 (Pi 3 and later in 64-bit mode) has CRC-32 instructions
+	while(len && ((uintptr_t)buf & 7)) {
+		crc = __crc32b(crc, *buf++);
+		len--;
+	}
+	for(; len >= 8; len -= 8, buf += 8)
+		crc = __crc32d(crc, *(const uint64_t *)buf);
+	while(len--) crc = __crc32b(crc, *buf++);
+#else
+	// Slicing-by-8, 8 bytes per step (assumes little-endian)
+	uint32_t a, b;
+	while(len && ((uintptr_t)buf & 3)) {
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *buf++) & 0xFF];
+		len--;
+	}
+	for(; len >= 8; len -= 8, buf += 8) {
+		a   = crc ^ *(const uint32_t *)buf;
+		b   = *(const uint32_t *)&buf[4];
+		crc = crcTable[7][a & 0xFF] ^ crcTable[6][(a >> 8) & 0xFF] ^
+		      crcTable[5][(a >> 16) & 0xFF] ^ crcTable[4][a >> 24] ^
+		      crcTable[3][b & 0xFF] ^ crcTable[2][(b >> 8) & 0xFF] ^
+		      crcTable[1][(b >> 16) & 0xFF] ^ crcTable[0][b >> 24];
+	}
+	while(len--) crc = (crc >> 8) ^ crcTable[0][(crc ^ *buf++) & 0xFF];
+#endif
+	return crc;
+}
+
+// CRC-32 an entire file through a sliding mmap() window.
+// Returns 0 on success, -1 on error.
+static int crcFile(HashJob *j) {
+	uint8_t  *map;
+	off_t     pos;
+	size_t    len;
+	uint32_t  crc = 0xFFFFFFFF;
+	int       fd, status = 0;
+
+	if((fd = open(j->path, O_RDONLY)) < 0) return -1;
+	for(pos=0; !status && (pos < j->size); pos += len) {
+		len = (j->size - pos > HASH_CHUNK) ? HASH_CHUNK : j->size - pos;
+		if((map = (uint8_t *)mmap(NULL, len, PROT_READ, MAP_PRIVATE,
+		  fd, pos)) == MAP_FAILED) {
+			status = -1;
+		} else {
+			(void)madvise(map, len, MADV_SEQUENTIAL);
+			crc = crcUpdate(crc, map, len);
+			munmap(map, len);
+		}
+	}
+	close(fd);
+	j->crc = ~crc;
+	return status;
+}
+
+// Worker thread: take the next unhashed file until none remain.  Jobs
+// are sorted largest-first so one big file doesn't finish last alone.
+static void *hashWorker(void *arg) {
+	int i;
+	while((i = __sync_fetch_and_add(&hashNext, 1)) < nHashJobs) {
+		if(hashJob[i].path) hashJob[i].ok = !crcFile(&hashJob[i]);
+	}
+	return NULL;
+}
+
+static int hashCompareName(const void *a, const void *b) {
+	const HashJob *ja = (const HashJob *)a, *jb = (const HashJob *)b;
+	int            c  = (int)ja->g->emu - (int)jb->g->emu;
+	return c ? c : strcmp(ja->g->name, jb->g->name);
+}
+
+static int hashCompareSize(const void *a, const void *b) {
+	long long d = ((const HashJob *)b)->size - ((const HashJob *)a)->size;
+	return (d > 0) - (d < 0);
+}
+
+// Known-bad CRCs, sorted for bsearch()
+static uint32_t *badCrc  = NULL;
+static int       nBadCrc = 0;
+
+static int crcCompare(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+// Load known-bad CRC list: one hex CRC-32 per line, anything following
+// (e.g. the game or file name) is ignored, as are '#' comment lines.
+static void badLoad(void) {
+	char      line[256];
+	FILE     *fp;
+	unsigned  crc;
+	uint32_t *list;
+
+	if(badCrc || !(fp = fopen(badList, "r"))) return;
+	while(fgets(line, sizeof(line), fp)) {
+		if((line[0] == '#') || (sscanf(line, "%x", &crc) != 1)) continue;
+		if(!(nBadCrc & 255)) { // Grow list 256 at a time
+			if(!(list = (uint32_t *)realloc(badCrc,
+			  (nBadCrc + 256) * sizeof(uint32_t)))) break;
+			badCrc = list;
+		}
+		badCrc[nBadCrc++] = crc;
+	}
+	fclose(fp);
+	if(badCrc) qsort(badCrc, nBadCrc, sizeof(uint32_t), crcCompare);
+}
+
+static int isBad(uint32_t crc) {
+	return badCrc &&
+	  bsearch(&crc, badCrc, nBadCrc, sizeof(uint32_t), crcCompare);
+}
+
+// Order-independent signature of a zip's member CRCs and sizes
+static uint64_t zipSignature(ZipInfo *z) {
+	uint64_t sig = 0, x;
+	int      i;
+	for(i=0; i<z->nEntries; i++) { // splitmix64 finalizer per member
+		x  = ((uint64_t)z->entry[i].crc << 32) | z->entry[i].size;
+		x  = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x  = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		sig += x ^ (x >> 31);
+	}
+	return sig;
+}
+
+// Identity key (for duplicate detection) paired with its Game
+typedef struct {
+  uint64_t key;
+  Game    *g;
+} DupKey;
+
+static int dupCompare(const void *a, const void *b) {
+	const DupKey *da = (const DupKey *)a, *db = (const DupKey *)b;
+	int           c;
+	if(da->key != db->key) return (da->key > db->key) ? 1 : -1;
+	if((c = (int)da->g->emu - (int)db->g->emu)) return c;
+	return strcmp(da->g->name, db->g->name);
+}
+
+// Sort keys; all but the first (alphabetically) of each run of equal
+// keys are flagged as duplicates.
+static void flagDups(DupKey *k, int n) {
+	int i;
+	qsort(k, n, sizeof(DupKey), dupCompare);
+	for(i=1; i<n; i++) {
+		if(k[i].key == k[i-1].key) k[i].g->flags |= GAME_DUP;
+	}
+}
+
+// Hash cache file per emulator, one line per ROM file:
+//   <crc> <size> <mtime> <name>
+static void hashLoad(int e, HashJob *job, int n) {
+	char      path[256], line[PATH_MAX + 64];
+	FILE     *fp;
+	Game      key;
+	HashJob   find, *j;
+	long long size, mtime;
+	unsigned  crc;
+	int       pos;
+
+	(void)sprintf(path, "%s/%s.crc", cacheDir, emulator[e].tag);
+	if(!(fp = fopen(path, "r"))) return;
+	find.g   = &key;
+	key.emu  = e;
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = 0;
+		if(sscanf(line, "%x %lld %lld %n",
+		  &crc, &size, &mtime, &pos) != 3) continue;
+		key.name = &line[pos];
+		if((j = (HashJob *)bsearch(&find, job, n, sizeof(HashJob),
+		  hashCompareName)) && (j->size == size) &&
+		  (j->mtime == mtime)) {
+			free(j->path); // Current; no need to hash
+			j->path = NULL;
+			j->crc  = crc;
+			j->ok   = 1;
+		}
+	}
+	fclose(fp);
+}
+
+static void hashSave(int e, HashJob *job, int n) {
+	char  path[256], tmp[260];
+	FILE *fp;
+	int   i;
+
+	(void)mkdir(cacheDir, 0755);
+	(void)sprintf(path, "%s/%s.crc", cacheDir, emulator[e].tag);
+	(void)sprintf(tmp, "%s.tmp", path);
+	if(!(fp = fopen(tmp, "w"))) return;
+	for(i=0; i<n; i++) {
+		if((job[i].g->emu == e) && job[i].ok) {
+			fprintf(fp, "%08x %lld %lld %s\n", job[i].crc,
+			  job[i].size, job[i].mtime, job[i].g->name);
+		}
+	}
+	cacheBytes += ftell(fp);
+	if(fclose(fp) || rename(tmp, path)) unlink(tmp);
+}
+
+// Hash all games' ROM files (or fetch from cache) and set GAME_DUP and
+// GAME_BAD flags.  Called before building the menu when -d is used.
+static void hashGames(void) {
+	char            path[PATH_MAX];
+	struct stat     st;
+	Game           *g;
+	DupKey         *dup;
+	pthread_t      *thread;
+	long            nThreads;
+	int             e, i, n, nDup, nHash = 0;
+
+	if(!crcTable[0][1]) crcInit();
+	badLoad();
+
+	for(n=e=0; e<N_EMULATORS; e++)
+		for(g=emulator[e].gameList; g; g=g->next, n++) g->flags = 0;
+	if(!n || !(hashJob = (HashJob *)calloc(n, sizeof(HashJob)))) return;
+
+	// Stat each ROM file to validate cache entries.  MAME Game names
+	// lack the .zip extension, which might be in either case.
+	for(nHashJobs=e=0; e<N_EMULATORS; e++) {
+		for(g=emulator[e].gameList; g; g=g->next) {
+			(void)sprintf(path, "%s%s", g->name,
+			  emulator[e].nameExt ? emulator[e].nameExt : "");
+			if(stat(path, &st) && emulator[e].nameExt) {
+				(void)sprintf(path, "%s.ZIP", g->name);
+				if(stat(path, &st)) continue;
+			}
+			hashJob[nHashJobs].g     = g;
+			hashJob[nHashJobs].path  = strdup(path);
+			hashJob[nHashJobs].size  = st.st_size;
+			hashJob[nHashJobs].mtime = st.st_mtime;
+			nHashJobs++;
+		}
+	}
+
+	// Game lists are sorted per emulator but not necessarily by strcmp()
+	qsort(hashJob, nHashJobs, sizeof(HashJob), hashCompareName);
+	for(e=0; e<N_EMULATORS; e++) hashLoad(e, hashJob, nHashJobs);
+	for(i=0; i<nHashJobs; i++) if(hashJob[i].path) nHash++;
+
+	if(nHash) {
+		const char hashMsg[] = "Checking ROMs...";
+		WINDOW    *hashWin = newwin(3, strlen(hashMsg) + 4,
+		  (LINES - 4) / 2 - 1, (COLS - strlen(hashMsg)) / 2 - 2);
+		box(hashWin, 0, 0);
+		mvwprintw(hashWin, 1, 2, hashMsg);
+		wrefresh(hashWin);
+		delwin(hashWin);
+
+		qsort(hashJob, nHashJobs, sizeof(HashJob), hashCompareSize);
+		hashNext = 0;
+		nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if(nThreads < 1) nThreads = 1;
+		if(nThreads > nHash) nThreads = nHash;
+		if((thread = (pthread_t *)malloc(
+		  nThreads * sizeof(pthread_t)))) {
+			// Main thread works too; pthread_create() failures
+			// just mean fewer workers.
+			for(i=1; i<nThreads; i++) {
+				if(pthread_create(&thread[i], NULL,
+				  hashWorker, NULL)) break;
+			}
+			nThreads = i;
+			hashWorker(NULL);
+			for(i=1; i<nThreads; i++) pthread_join(thread[i], NULL);
+			free(thread);
+		}
+		qsort(hashJob, nHashJobs, sizeof(HashJob), hashCompareName);
+		for(e=0; e<N_EMULATORS; e++) hashSave(e, hashJob, nHashJobs);
+	}
+
+	// Flag bad dumps and duplicates: by whole-file CRC and size, and
+	// for indexed zips, by member CRCs and sizes.
+	if((dup = (DupKey *)malloc(nHashJobs * sizeof(DupKey)))) {
+		for(i=nDup=0; i<nHashJobs; i++) {
+			if(!hashJob[i].ok) continue;
+			g = hashJob[i].g;
+			if(isBad(hashJob[i].crc)) g->flags |= GAME_BAD;
+			dup[nDup].key = ((uint64_t)hashJob[i].size << 32) |
+			  hashJob[i].crc;
+			dup[nDup++].g = g;
+		}
+		flagDups(dup, nDup);
+		for(i=nDup=0; i<nHashJobs; i++) {
+			g = hashJob[i].g;
+			if(!g->zip || (g->zip->nEntries <= 0)) continue;
+			for(e=0; e<g->zip->nEntries; e++) {
+				if(isBad(g->zip->entry[e].crc))
+					g->flags |= GAME_BAD;
+			}
+			dup[nDup].key = zipSignature(g->zip);
+			dup[nDup++].g = g;
+		}
+		flagDups(dup, nDup);
+		free(dup);
+	}
+
+	for(i=0; i<nHashJobs; i++) free(hashJob[i].path);
+	free(hashJob);
+	hashJob   = NULL;
+	nHashJobs = 0;
+}
+
+// Menu item description for game: flags if any, else zip annotation
+static const char *gameDesc(Game *g) {
+	if(g->flags & GAME_BAD) return "  BAD";
+	if(g->flags & GAME_DUP) return "  DUP";
+	return g->zip ? g->zip->desc : NULL;
+}
+
 // MAME-specific globals and code ----------------------------------------
 
 static const char
   mameCfgTall[] = "/boot/advmame/advmame.rc.portrait",  // Absolute paths
   mameCfgWide[] = "/boot/advmame/advmame.rc.landscape", // to config and
-  mameXmlFile[] = "/boot/advmame/advmame.xml",          // data files.
+ *mameXmlFile   = "/boot/advmame/advmame.xml",          // data files.
  *mameCfg;                                              // Active config.
 
 // Each emulator's Games are stored in a linked list.  The titles
 // displayed for MAME are alphabetically sorted by the XML-derived title,
 // not filename.  In order to use qsort() -- which is array-oriented --
 // MAME titles are placed in an array with a pointer back to the Game
-// struct.  fceu sorts by filename during scandir(); it doesn't have
+// struct.  fceu sorts by filename after scanning; it doesn't have
 // XML verbose titles and doesn't do this.
 typedef struct {
   Game *g;
@@ -155,10 +1310,11 @@ mameID *mameArray;
 // Speaking of Pandora's Box of pure evil...XML cross-referencing (for
 // human-readable MAME titles) is a spaghetti-fest involving globals
 // for maintaining state across callbacks invoked by the expat library.
-static Game          *mameGameList   = NULL, // -> MAME game linked list
-                     *gameToDescribe = NULL; // Game being XML-parsed
-static unsigned char  descFlag       = 0;    // Enable name parser
-static int            mameIdx;               // Counter into mameArray[]
+static int           mameCount;          // Games in mameArray[]
+static int           mameIdx   = -1;     // Game being XML-parsed (or -1)
+static unsigned char descFlag  = 0;      // Enable name parser
+static int           descLen   = 0;      // Description text so far...
+static char          descBuf[256];       // ...and the text itself
 
 static void mameInit(void) {
 	char cmdline[1024];
@@ -179,32 +1335,41 @@ static void mameInit(void) {
 	}
 }
 
-// MAME-specific filter function for scandir() -- given a dirent struct,
-// returns 1 if it's a likely ROM file candidate (ends in .zip).  The
-// .zip file extension is then stripped; not needed when invoking emulator.
-static int mameFilter(const struct dirent *d) {
-	char *ptr;
-	if(((d->d_type == DT_REG) || (d->d_type == DT_LNK)) &&
-	   (d->d_name[0] != '.') && // Ignore dotfiles
-	   (ptr = strrchr(d->d_name, '.')) && !strcasecmp(ptr, ".zip")) {
-		*ptr = 0; // Truncate .zip extension
-		return 1;
+// MAME-specific filter function for the folder walker -- given a
+// filename, returns the Game name length if it's a likely ROM file
+// candidate (ends in .zip; the central directory is checked later), else
+// 0.  The .zip file extension is left off the Game name; not needed when
+// invoking emulator.
+static int mameFilter(const char *name, int len) {
+	return ((len > 4) && !strcasecmp(&name[len - 4], ".zip")) ?
+	  len - 4 : 0;
+}
+
+// Index into mameArray[] (sorted by name while parsing) of the game
+// named by the len chars at name, or -1 if it's not in the list.
+static int mameFind(const char *name, int len) {
+	int lo = 0, hi = mameCount - 1, mid, c;
+	while(lo <= hi) {
+		mid = (lo + hi) / 2;
+		if(!(c = strncmp(name, mameArray[mid].g->file, len)) &&
+		   mameArray[mid].g->file[len]) c = -1; // Name is a prefix
+		if(!c) return mid;
+		if(c < 0) hi = mid - 1;
+		else      lo = mid + 1;
 	}
-	return 0;
+	return -1;
 }
 
 // Called at the start of each XML element: e.g. <foo>
 static void XMLCALL startElement(
   void *depth, const char *name, const char **attr) {
 	if((*(int *)depth += 1) == 2) { // If level 2 nesting...
-		// If element is <game> and at least 2 attributes present...
-		if(!strcmp(name, "game") && attr[0] && attr[1]) {
-			// Compare attr[1] against list of game names...
-			Game *g;
-			for(mameIdx=0,g=mameGameList;g;g=g->next,mameIdx++) {
-				if(!strcmp(attr[1], g->name)) {
-					// Found match, save pointer to game
-					gameToDescribe = g;
+		// If element is <game> or <machine>, look up its name
+		if(!strcmp(name, "game") || !strcmp(name, "machine")) {
+			for(; attr[0] && attr[1]; attr += 2) {
+				if(!strcmp(attr[0], "name")) {
+					mameIdx = mameFind(attr[1],
+					  strlen(attr[1]));
 					break;
 					// The element data parser, if
 					// subsequently enabled, may then
@@ -213,29 +1378,200 @@ static void XMLCALL startElement(
 			}
 		}
 	// else if element is '<description>' at level 3...
-	} else if((*(int *)depth == 3) && !strcmp(name, "description")) {
+	} else if((*(int *)depth == 3) && !strcmp(name, "description") &&
+	  (mameIdx >= 0) && !mameArray[mameIdx].title) {
 		descFlag = 1; // Enable element data parser
+		descLen  = 0;
 	}
 }
 
 // Called at the end of each XML element: e.g. </foo>
 static void XMLCALL endElement(void *depth, const char *name) {
-	if((*(int *)depth -= 1) == 1) { // End of 'game' element?
-		gameToDescribe = NULL;  // Deactivate description search
-		descFlag       = 0;
+	if((*(int *)depth -= 1) == 2) { // End of 'description' element?
+		if(descFlag) { // Found description, we're done
+			mameArray[mameIdx].title = strndup(descBuf, descLen);
+			descFlag = 0;
+		}
+	} else if(*(int *)depth == 1) { // End of 'game' element?
+		mameIdx  = -1; // Deactivate description search
+		descFlag = 0;
 	}
 }
 
-// Called for element data between start/end: e.g. <foo>DATA</foo>
+// Called for element data between start/end: e.g. <foo>DATA</foo>.
+// expat may deliver one element's text in several pieces (e.g. either
+// side of an &amp;), so it's accumulated until the end of the element.
 static void elementData(void *data, const char *content, int length) {
-	// gameToDescribe and descFlag must both be set; avoid false positives
-	if(descFlag && gameToDescribe) {
-		if(mameArray && (!mameArray[mameIdx].title))
-			mameArray[mameIdx].title = strndup(content, length);
-		descFlag = 0; // Found description, we're done
+	if(descFlag) {
+		if(length > (int)sizeof(descBuf) - descLen)
+			length = sizeof(descBuf) - descLen;
+		memcpy(&descBuf[descLen], content, length);
+		descLen += length;
 	}
 }
 
+// Full XML parse of MAME's -listxml output for game titles (used if the
+// fast scanner below doesn't like the look of the file)
+static void mameExpat(const char *buf, size_t len) {
+	XML_Parser parser = XML_ParserCreate(NULL);
+	int        depth  = 0;
+	XML_SetUserData(parser, &depth);
+	XML_SetElementHandler(parser, startElement, endElement);
+	XML_SetCharacterDataHandler(parser, elementData);
+	XML_Parse(parser, buf, len, 1);
+	XML_ParserFree(parser);
+	mameIdx  = -1;
+	descFlag = 0;
+}
+
+// The XML file is tens to hundreds of megabytes of which only the game
+// names and descriptions are wanted, and MAME writes it in a fixed form:
+// each <game> or <machine> element has name as its first attribute and
+// <description> as its first child.  So rather than a full parse, the
+// scanner looks for the byte pairs '<g' and '<m' (16 bytes per step,
+// using GCC vector compares, which become SSE2 on x86 and NEON on ARM)
+// and reads the two strings in place.  Anything unexpected -- another
+// attribute or element order, an entity other than the XML built-ins,
+// CDATA, an encoding other than UTF-8 -- and it gives up, and the file
+// goes through expat instead.
+
+typedef uint8_t v16u8 __attribute__ ((vector_size(16)));
+
+// Offset of next '<g' or '<m' in buf at or after pos, else len
+static size_t xmlNextTag(const char *buf, size_t pos, size_t len) {
+	v16u8    a, b;
+	uint64_t m[2];
+	for(; pos + 17 <= len; pos += 16) {
+		memcpy(&a, &buf[pos], 16);
+		memcpy(&b, &buf[pos + 1], 16);
+		a = (v16u8)((a == '<') & ((b == 'g') | (b == 'm')));
+		memcpy(m, &a, 16);
+		if(m[0]) return pos + __builtin_ctzll(m[0]) / 8;
+		if(m[1]) return pos + 8 + __builtin_ctzll(m[1]) / 8;
+	}
+	for(; pos + 1 < len; pos++) {
+		if((buf[pos] == '<') && ((buf[pos+1] == 'g') ||
+		   (buf[pos+1] == 'm'))) return pos;
+	}
+	return len;
+}
+
+// Copy len bytes of XML character data from src to dst (which needs
+// len + 1 bytes; decoding never lengthens), decoding the built-in and
+// numeric character references.  Returns 0 on success, -1 if there's
+// anything else in there (an entity that must be declared in the DTD,
+// or markup).
+static int xmlText(char *dst, const char *src, size_t len) {
+	static const struct {
+	  const char *name; // Entity reference
+	  char        c;    // Character it stands for
+	} ent[] = {
+	  { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' },
+	  { "&quot;", '"' }, { "&apos;", '\'' } };
+	const char *end = src + len, *semi;
+	char       *ptr;
+	unsigned    i, c;
+
+	while(src < end) {
+		if((*src == '<') || (*src == '\r')) return -1;
+		if(*src != '&') {
+			*dst++ = *src++;
+			continue;
+		}
+		if(!(semi = memchr(src, ';', end - src))) return -1;
+		if(src[1] == '#') { // Numeric reference, to UTF-8
+			c = (src[2] == 'x') ? strtoul(&src[3], &ptr, 16) :
+			                      strtoul(&src[2], &ptr, 10);
+			if((ptr != semi) || !c || (c > 0x10FFFF)) return -1;
+			if(c < 0x80) {
+				*dst++ = c;
+			} else if(c < 0x800) {
+				*dst++ = 0xC0 | (c >> 6);
+				*dst++ = 0x80 | (c & 0x3F);
+			} else if(c < 0x10000) {
+				*dst++ = 0xE0 | (c >> 12);
+				*dst++ = 0x80 | ((c >> 6) & 0x3F);
+				*dst++ = 0x80 | (c & 0x3F);
+			} else {
+				*dst++ = 0xF0 | (c >> 18);
+				*dst++ = 0x80 | ((c >> 12) & 0x3F);
+				*dst++ = 0x80 | ((c >> 6) & 0x3F);
+				*dst++ = 0x80 | (c & 0x3F);
+			}
+		} else {
+			for(i=0; (i < sizeof(ent) / sizeof(ent[0])) &&
+			  strncmp(src, ent[i].name, semi + 1 - src); i++);
+			if((i >= sizeof(ent) / sizeof(ent[0])) ||
+			   ent[i].name[semi + 1 - src]) return -1;
+			*dst++ = ent[i].c;
+		}
+		src = semi + 1;
+	}
+	*dst = 0;
+	return 0;
+}
+
+// Fast scan of MAME's -listxml output for game titles, as described
+// above.  Returns 0 on success, -1 if the file needs a full parse
+// (titles found up to that point are kept).
+static int mameScan(const char *buf, size_t len) {
+	const char *p, *q, *end = buf + len;
+	size_t      pos = 0;
+	int         i, n, quote;
+
+	// Anything but UTF-8 needs expat's conversion
+	if((len >= 5) && !strncmp(buf, "<?xml", 5)) {
+		if(!(q = memchr(buf, '>', (len < 256) ? len : 256))) return -1;
+		for(p=buf; (p < q - 9) && strncmp(p, "encoding=", 9); p++);
+		if((p < q - 9) && strncasecmp(&p[10], "utf-8", 5)) return -1;
+	}
+
+	while((pos = xmlNextTag(buf, pos, len)) < len) {
+		p = &buf[pos];
+		n = (((end - p) > 5) && !strncmp(p, "<game", 5)) ? 5 :
+		    (((end - p) > 8) && !strncmp(p, "<machine", 8)) ? 8 : 0;
+		if(!n || !(isspace(p[n]) || (p[n] == '>') || (p[n] == '/'))) {
+			pos++; // Some other <g... or <m... element
+			continue;
+		}
+		if(((end - p) < n + 8) || strncmp(&p[n], " name=\"", 7))
+			return -1; // Not name first, or unusual spacing
+		p += n + 7;
+
+		// Name, then rest of start tag (quotes may hide a '>')
+		if(!(q = memchr(p, '"', end - p)) || memchr(p, '&', q - p))
+			return -1;
+		i = mameFind(p, q - p);
+		for(quote=0, p=q+1; (p < end) && (quote || (*p != '>')); p++)
+			if(*p == '"') quote ^= 1;
+		if((p >= end) || (p[-1] == '/')) return -1;
+
+		// First child must be the description
+		for(p++; (p < end) && isspace(*p); p++);
+		if(((end - p) < 13) || strncmp(p, "<description>", 13))
+			return -1;
+		p += 13;
+		if(!(q = memchr(p, '<', end - p)) || ((end - q) < 14) ||
+		   strncmp(q, "</description>", 14)) return -1;
+		if((i >= 0) && !mameArray[i].title) {
+			if(!(mameArray[i].title = (char *)malloc(q - p + 1)))
+				return -1;
+			if(xmlText(mameArray[i].title, p, q - p)) {
+				free(mameArray[i].title);
+				mameArray[i].title = NULL;
+				return -1;
+			}
+		}
+		pos = q + 14 - buf;
+	}
+	return 0;
+}
+
+// Compare function for qsort() -- MAME game list by name, for mameFind()
+static int mameCompareName(const void *a, const void *b) {
+	return strcmp(((mameID *)a)->g->file, ((mameID *)b)->g->file);
+}
+
 // Compare function for qsort() -- for alphabetizing MAME game list
 static int mameCompare(const void *a, const void *b) {
 	return strcasecmp(((mameID *)a)->title, ((mameID *)b)->title);
@@ -245,9 +1581,10 @@ static int mameCompare(const void *a, const void *b) {
 // against filenames and populate the items[] array with human-readable
 // game descriptions.  Fall back on names alone for items.
 static int mameItemize(Game *gList, int i) {
-	FILE *fp;
-	Game *g;
-	int   gCount;
+	struct stat st;
+	Game       *g;
+	char       *map;
+	int         fd, gCount;
 
 	// Count number of games, alloc and init array of mameIDs.
 	for(gCount=0, g=gList; g; g=g->next, gCount++);
@@ -258,26 +1595,20 @@ static int mameItemize(Game *gList, int i) {
 		}
 	}
 
-	mameGameList = NULL; // -> MAME linked list doubles as success flag
-	if((fp = fopen(mameXmlFile, "r"))) {
-		fseek(fp, 0, SEEK_END);
-		char *buf;
-		int   len = ftell(fp);
-		if((buf = (char *)malloc(len))) {
-			int depth = 0;
-			fseek(fp, 0, SEEK_SET);
-			fread(buf, 1, len, fp);
-			mameGameList = gList; // Opened & alloc'd OK
-			XML_Parser parser = XML_ParserCreate(NULL);
-			XML_SetUserData(parser, &depth);
-			XML_SetElementHandler(parser,
-			  startElement, endElement);
-			XML_SetCharacterDataHandler(parser, elementData);
-			XML_Parse(parser, buf, len, 1);
-			XML_ParserFree(parser);
-			free(buf);
+	// Map the XML file and look for titles there: fast scan if it's
+	// standard listxml output, else a full parse.
+	if(mameArray && ((fd = open(mameXmlFile, O_RDONLY)) >= 0)) {
+		if(!fstat(fd, &st) && (st.st_size > 0) &&
+		   ((map = (char *)mmap(NULL, st.st_size, PROT_READ,
+		   MAP_PRIVATE, fd, 0)) != MAP_FAILED)) {
+			(void)madvise(map, st.st_size, MADV_SEQUENTIAL);
+			mameCount = gCount;
+			qsort(mameArray, gCount, sizeof(mameID),
+			  mameCompareName);
+			if(mameScan(map, st.st_size)) mameExpat(map, st.st_size);
+			munmap(map, st.st_size);
 		}
-		fclose(fp);
+		close(fd);
 	}
 
 	// Make a second pass through games list...
@@ -288,7 +1619,8 @@ static int mameItemize(Game *gList, int i) {
 		// located in the XML file), fall back on filename alone.
 		for(gCount=0, g=gList; g; g=g->next, gCount++) {
 			if(!mameArray[gCount].title) {
-				mameArray[gCount].title = strdup(g->name);
+				mameArray[gCount].title =
+				  strdup(mameArray[gCount].g->file);
 			}
 		}
 		// Alphabetize MAME game list...
@@ -296,8 +1628,8 @@ static int mameItemize(Game *gList, int i) {
 		// And populate menu...
 		for(gCount=0, g=gList; g; g=g->next, gCount++) {
 			if((mameArray[gCount].title)) {
-				items[i] = new_item(
-				  mameArray[gCount].title, NULL);
+				items[i] = new_item(mameArray[gCount].title,
+				  gameDesc(mameArray[gCount].g));
 				set_item_userptr(items[i],
 				  mameArray[gCount].g);
 				i++;
@@ -315,26 +1647,40 @@ static int mameItemize(Game *gList, int i) {
 }
 
 // Given a Game struct and an output buffer, format a command string
-// for invoking advmame via system()
+// for invoking advmame via system().  advmame takes the set name and
+// finds the zip through the dir_rom setting in advmame.rc, which covers
+// the first ROM folder.  Sets anywhere else (subfolders, other drives)
+// get their own folder and all the ROM folders (for parent sets)
+// passed along explicitly.
 static void mameCommand(Game *g, char *cmdline) {
-	(void)sprintf(cmdline, "advmame -cfg %s %s", mameCfg, g->name);
+	const char *root = emulator[g->emu].romPath, *first;
+	int         len  = g->file - g->name - 1; // Length of folder name
+
+	if((len <= 0) || ((rootNext(&root, &first) == len) &&
+	  !strncmp(first, g->name, len))) {
+		(void)sprintf(cmdline, "advmame -cfg %s %s", mameCfg, g->file);
+	} else {
+		(void)sprintf(cmdline, "advmame -cfg %s -dir_rom \"%.*s:%s\" %s",
+		  mameCfg, len, g->name, emulator[g->emu].romPath, g->file);
+	}
 }
 
 // NES-specific globals and code -----------------------------------------
 
-// fceu-specific filter function for scandir() -- given a dirent struct,
-// returns 1 if it's a likely ROM file candidate (ends in .zip or .nes).
-static int fceuFilter(const struct dirent *d) {
-	static const char *ext[] = { "zip", "nes" };
-	char              *ptr;
-	int                i;
+// fceu-specific filter function for the folder walker -- given a
+// filename, returns its length if it's a likely ROM file candidate (ends
+// in .nes, or ends in .zip; zips are later checked for a .nes file).
+static int fceuFilter(const char *name, int len) {
+	return ((len > 4) && (!strcasecmp(&name[len - 4], ".nes") ||
+	  !strcasecmp(&name[len - 4], ".zip"))) ? len : 0;
+}
 
-	if(((d->d_type == DT_REG) || (d->d_type == DT_LNK)) &&
-	   (d->d_name[0] != '.') && (ptr = strrchr(d->d_name,'.'))) {
-		for(++ptr, i=0; i<sizeof(ext)/sizeof(ext[0]); i++)
-			if(!strcasecmp(ptr, ext[i])) return 1;
-	}
-	return 0;
+// Compare function for qsort() -- NES ROMs by filename (as alphasort()
+// did when these were scandir() results), then by folder
+static int fceuCompare(const void *a, const void *b) {
+	const RomFile *fa = *(const RomFile **)a, *fb = *(const RomFile **)b;
+	int            c  = strcoll(&fa->path[fa->file], &fb->path[fb->file]);
+	return c ? c : strcmp(fa->path, fb->path);
 }
 
 // After scanning folder for NES ROM files, populate the items[] array with
@@ -342,9 +1688,9 @@ static int fceuFilter(const struct dirent *d) {
 static int fceuItemize(Game *gList, int i) {
 	char *str;
 	for(; gList; gList=gList->next) {
-		if((str = strndup(gList->name,
-		  strrchr(gList->name,'.') - gList->name))) {
-			items[i] = new_item(str, NULL);
+		if((str = strndup(gList->file,
+		  strrchr(gList->file,'.') - gList->file))) {
+			items[i] = new_item(str, gameDesc(gList));
 			set_item_userptr(items[i++], gList);
 		}
 	}
@@ -354,20 +1700,242 @@ static int fceuItemize(Game *gList, int i) {
 // Given a Game struct and an output buffer, format a command string
 // for invoking fceu via system()
 static void fceuCommand(Game *g, char *cmdline) {
-	(void)sprintf(cmdline, "fceu \"%s/%s\"",
-	  emulator[g->emu].romPath, g->name);
+	(void)sprintf(cmdline, "fceu \"%s\"", g->name);
 }
 
 
 // Utility functions -----------------------------------------------------
 
-// Delete existing ROM list, scan all emulators' ROM folders, generate
-// new ROM menu for ncurses.
-int find_roms(void) {
-	struct dirent **dirList;
-	int             i, e, nFiles, nGames = 0, nEmuTitles = 0;
-	Game           *g;       // For traversing Game linked list
-	WINDOW         *scanWin; // Modal 'Scanning...' window
+// ROM folders are walked by background threads, so a rescan can proceed
+// while a cached menu is displayed; the zip index pass that follows is
+// done a chunk at a time between keypresses.  One of these per emulator
+// tracks a scan in progress.
+static struct {
+  unsigned char  active;  // Scan started but not yet installed
+  Walk          *walk;    // Folder walk (names in list[] live here)
+  time_t         started; // Time scan started
+  RomFile      **list;    // Files found, merged from walker threads
+  int            nList;   // Number of entries in list
+  int            next;    // Next entry for zip index pass
+  int            nKeep;   // Entries (at start of list) passing it
+} scan[N_EMULATORS];
+
+#define SCAN_CHUNK 64 // Files zip-indexed per background scan step
+#define SCAN_WAIT  20 // Max ms to await walker threads per scan step
+
+// Discard any scan in progress for emulator e
+static void scanAbort(int e) {
+	if(scan[e].walk) {
+		walkFree(scan[e].walk);
+		scan[e].walk = NULL;
+	}
+	free(scan[e].list);
+	scan[e].list   = NULL;
+	scan[e].nList  = scan[e].next = scan[e].nKeep = 0;
+	scan[e].active = 0;
+}
+
+// Begin scanning emulator e's ROM folders.  Folders that can't be read
+// simply yield no files.
+static void scanStart(int e) {
+	scanAbort(e);
+	if(!zipLoaded[e]) zipLoad(e);
+	scan[e].active  = 1;
+	scan[e].started = time(NULL);
+	scan[e].walk    = walkStart(e);
+}
+
+// Advance emulator e's scan: once the folder walk is complete, index up
+// to max zip files found.  With max = INT_MAX, waits for the walk to
+// finish; otherwise waits SCAN_WAIT ms at most.  Returns 1 once all files
+// are checked (results sorted and ready for scanInstall()), else 0.
+static int scanStep(int e, int max) {
+	Walk     *k = scan[e].walk;
+	RomFile  *f;
+	int       i, n;
+
+	if(!scan[e].list && k) { // Walk not yet merged
+		if(!walkWait(k, (max == INT_MAX) ? -1 : SCAN_WAIT)) return 0;
+		for(n=i=0; i<WALK_THREADS; i++) n += k->walker[i].nList;
+		if(!(scan[e].list = (RomFile **)malloc(
+		  (n ? n : 1) * sizeof(RomFile *)))) return 1;
+		for(i=0; i<WALK_THREADS; i++) {
+			memcpy(&scan[e].list[scan[e].nList], k->walker[i].list,
+			  k->walker[i].nList * sizeof(RomFile *));
+			scan[e].nList += k->walker[i].nList;
+		}
+	}
+
+	while((scan[e].next < scan[e].nList) && (max-- > 0)) {
+		f = scan[e].list[scan[e].next++];
+		if(!f->isZip || zipIndex(e, f))
+			scan[e].list[scan[e].nKeep++] = f;
+	}
+	if(scan[e].next < scan[e].nList) return 0;
+
+	if(emulator[e].compar && (scan[e].nKeep > 1)) {
+		qsort(scan[e].list, scan[e].nKeep, sizeof(RomFile *),
+		  emulator[e].compar);
+	}
+	return 1;
+}
+
+// New Game for emulator e, named by len chars at name; NULL on error
+static Game *gameNew(int e, const char *name, int len) {
+	Game *g;
+	if((g = (Game *)malloc(sizeof(Game)))) {
+		if((g->name = strndup(name, len))) {
+			g->file  = strrchr(g->name, '/');
+			g->file  = g->file ? &g->file[1] : g->name;
+			g->emu   = e;
+			g->zip   = zipLookup(e, name, len);
+			g->flags = 0;
+			g->next  = NULL;
+		} else {
+			free(g);
+			g = NULL;
+		}
+	}
+	return g;
+}
+
+// Cached ROM listings allow the menu to appear immediately at startup.
+// Each file holds the device, inode and mtime of every folder scanned
+// (roots first, in romPath order, then all subfolders) at the time,
+// followed by the filtered, sorted Game names:
+//   D <dev> <inode> <mtime> <folder>
+//   ...
+//   <name>
+//   ...
+// Adding or removing a file or subfolder changes its folder's mtime, so
+// this catches any change in the tree.  Emulator e's Game list must be
+// empty on entry.  Returns 1 if listing was loaded and the folders are
+// unchanged since, 0 if listing was loaded but is stale (folders should
+// be rescanned), -1 if no listing available.
+static int listLoad(int e) {
+	char         path[256], line[PATH_MAX + 64], *dir;
+	const char  *p = emulator[e].romPath, *root;
+	FILE        *fp;
+	Game        *g, **tail = &emulator[e].gameList;
+	struct stat  st;
+	long long    dev, ino, mtime;
+	int          status = -1, pos, len, dirLen;
+
+	if(!zipLoaded[e]) zipLoad(e);
+	(void)sprintf(path, "%s/%s.dir", cacheDir, emulator[e].tag);
+	if(!(fp = fopen(path, "r"))) return -1;
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = 0;
+		if(sscanf(line, "D %lld %lld %lld %n",
+		  &dev, &ino, &mtime, &pos) == 3) {
+			// Folders must precede names.  Older files lack
+			// folder names here, and hold bare filenames.
+			dir = &line[pos];
+			if(emulator[e].gameList || !*dir) break;
+			if(status < 0) status = 1;
+			// First folders must be romPath's roots, in order
+			if(p && ((len = rootNext(&p, &root)) >= 0)) {
+				for(dirLen = strlen(dir);
+				  dirLen && (dir[dirLen - 1] == '/'); dirLen--);
+				if((len != dirLen) || strncmp(root, dir, len))
+					status = 0;
+			} else {
+				p = NULL;
+			}
+			// FAT doesn't have persistent inode numbers, so on
+			// /boot the listing will often be revalidated after
+			// a reboot; it's still displayed immediately
+			// regardless.  A missing folder is cached as all
+			// zeros, same as here.
+			if(status) {
+				if(stat(dir, &st)) memset(&st, 0, sizeof(st));
+				status = (st.st_dev == dev) &&
+				  (st.st_ino == ino) && (st.st_mtime == mtime);
+			}
+		} else if(status >= 0) {
+			if((g = gameNew(e, line, strlen(line)))) {
+				*tail = g;
+				tail  = &g->next;
+			}
+		}
+	}
+	fclose(fp);
+	if(p && (rootNext(&p, &root) >= 0) && (status > 0))
+		status = 0; // romPath has roots not in listing
+	return status;
+}
+
+// Write a folder's line for the listing cache file.  FAT timestamps
+// have 2-second resolution; a change landing in the same interval as the
+// scan wouldn't alter mtime.  Don't vouch for a folder that recent --
+// next startup will revalidate it.
+static void listFolder(FILE *fp, const WalkDir *d, time_t started) {
+	fprintf(fp, "D %lld %lld %lld %s\n", d->dev, d->ino,
+	  ((started - d->mtime) <= 2) ? -1 : d->mtime,
+	  d->len ? d->path : "/");
+}
+
+// Write emulator e's Game list to its listing cache file, along with
+// folder identities as of the scan that produced it.
+static void listSave(int e) {
+	char      path[256], tmp[260];
+	FILE     *fp;
+	Game     *g;
+	Walk     *k = scan[e].walk;
+	WalkDir  *d;
+	int       i;
+
+	if(!k) return;
+	(void)mkdir(cacheDir, 0755);
+	(void)sprintf(path, "%s/%s.dir", cacheDir, emulator[e].tag);
+	(void)sprintf(tmp, "%s.tmp", path);
+	if(!(fp = fopen(tmp, "w"))) return;
+	for(i=0; i<k->nRoots; i++) listFolder(fp, k->root[i], scan[e].started);
+	for(i=0; i<WALK_THREADS; i++) {
+		for(d=k->walker[i].dirs; d; d=d->next) {
+			if(d->depth) listFolder(fp, d, scan[e].started);
+		}
+	}
+	for(g=emulator[e].gameList; g; g=g->next) fprintf(fp, "%s\n", g->name);
+	cacheBytes += ftell(fp);
+	if(fclose(fp) || rename(tmp, path)) unlink(tmp);
+}
+
+// Delete emulator e's Game list
+static void freeGames(int e) {
+	Game *g;
+	while(emulator[e].gameList) {
+		g = emulator[e].gameList->next;
+		if(emulator[e].gameList->name) free(emulator[e].gameList->name);
+		free(emulator[e].gameList);
+		emulator[e].gameList = g;
+	}
+}
+
+// Replace emulator e's Game list with the results of a completed scan,
+// then update the listing and zip index caches.  Menu must be freed
+// first, as its items reference the old Games.
+static void scanInstall(int e) {
+	Game *g;
+	int   i;
+
+	freeGames(e);
+	// Copy RomFile array to a Game linked list.
+	for(i=scan[e].nKeep; i--; ) { // Assembled in reverse
+		RomFile *f = scan[e].list[i];
+		if((g = gameNew(e, f->path, f->key))) {
+			g->next = emulator[e].gameList;
+			emulator[e].gameList = g;
+		}
+	}
+	listSave(e);
+	zipSave(e); // Prune deleted files, update cache
+	scanAbort(e);
+}
+
+// Delete 'No ROMs' window and existing ROM menu, if present
+static void freeMenu(void) {
+	int i;
 
 	if(noRomWin) { // Delete 'No ROMS' window if present
 		delwin(noRomWin);
@@ -378,62 +1946,32 @@ int find_roms(void) {
 
 	if(items) { // Delete old ROM menu and contents, if any
 		if(menu) {
+			WINDOW *sub = menu_sub(menu);
 			unpost_menu(menu);
 			free_menu(menu);
+			if(sub != mainWin) delwin(sub);
 			menu = NULL;
 		}
 		for(i=0; items[i]; i++) free_item(items[i]);
 		free(items);
 		items = NULL;
 	}
+}
 
-	const char scanMsg[] = "Scanning ROM folder...";
-	scanWin = newwin(3, strlen(scanMsg) + 4,
-	  (LINES - 4) / 2 - 1, (COLS - strlen(scanMsg)) / 2 - 2);
-	box(scanWin, 0, 0);
-	mvwprintw(scanWin, 1, 2, scanMsg);
+// Generate new ROM menu for ncurses from all emulators' Game lists.
+// Returns number of emulator titles in menu (0 if only one emulator).
+static int buildMenu(void) {
+	int   i, e, nGames = 0, nEmuTitles = 0;
+	Game *g;
 
-	wnoutrefresh(mainWin);
-	wnoutrefresh(scanWin);
-	doupdate();
+	if(checkDups) hashGames();
 
-	delwin(scanWin);
 	werase(mainWin);
 	box(mainWin, 0, 0);
 
-	for(e=0; e<N_EMULATORS; e++) { // For each emulator...
-
-		// Delete existing gameList, if any
-		while(emulator[e].gameList) {
-			g = emulator[e].gameList->next;
-			if(emulator[e].gameList->name)
-				free(emulator[e].gameList->name);
-			free(emulator[e].gameList);
-			emulator[e].gameList = g;
-		}
-
-		// Scan ROM folder, build new gameList
-		if((nFiles = scandir(emulator[e].romPath, &dirList,
-		  emulator[e].filter, emulator[e].compar)) > 0) {
-			nEmuTitles++;
-			// Copy dirent array to a Game linked list.
-			while(nFiles--) { // Assembled in reverse
-				if((g = (Game *)malloc(sizeof(Game)))) {
-					if((g->name = strdup(
-					  dirList[nFiles]->d_name))) {
-						g->emu  = e;
-						g->next = emulator[e].gameList;
-						emulator[e].gameList = g;
-						nGames++; // A winner is you
-					} else {
-						free(g);
-					}
-				}
-				// dirList contents are freed as we go
-				free(dirList[nFiles]);
-			}
-			free(dirList);
-		}
+	for(e=0; e<N_EMULATORS; e++) {
+		if(emulator[e].gameList) nEmuTitles++;
+		for(g=emulator[e].gameList; g; g=g->next) nGames++;
 	}
 
 	// nGames is the total number of game files found.  nEmuTitles
@@ -480,15 +2018,368 @@ int find_roms(void) {
 	return nEmuTitles;
 }
 
+// Throw up a modal 'Scanning...' message while folders are read
+static void scanMessage(void) {
+	const char scanMsg[] = "Scanning ROM folders...";
+	WINDOW    *scanWin = newwin(3, strlen(scanMsg) + 4,
+	  (LINES - 4) / 2 - 1, (COLS - strlen(scanMsg)) / 2 - 2);
+	box(scanWin, 0, 0);
+	mvwprintw(scanWin, 1, 2, scanMsg);
+
+	wnoutrefresh(mainWin);
+	wnoutrefresh(scanWin);
+	doupdate();
+
+	delwin(scanWin);
+}
+
+// Scan all emulators' ROM folders, replace existing ROM list, generate
+// new ROM menu for ncurses.  The old menu stays on screen (under the
+// 'Scanning...' message) until the new one is built, so only rows that
+// differ are output, rather than erasing and repainting everything.
+int find_roms(void) {
+	int e;
+
+	scanMessage();
+
+	// All emulators' folder walks run at once
+	for(e=0; e<N_EMULATORS; e++) scanStart(e);
+	for(e=0; e<N_EMULATORS; e++) while(!scanStep(e, INT_MAX));
+
+	freeMenu();
+	for(e=0; e<N_EMULATORS; e++) scanInstall(e);
+
+	return buildMenu();
+}
+
+// Called between keypresses while a background rescan is active: moves
+// the next stale emulator's scan along and, when that's complete, swaps
+// in the new Game list and rebuilds the menu, keeping the current
+// selection if that game is still present.  Returns 1 while any scans
+// remain active, else 0.
+static int scanIdle(void) {
+	Game *g;
+	char *name = NULL;
+	int   e, i, emu = -1;
+
+	for(e=0; (e<N_EMULATORS) && !scan[e].active; e++);
+	if(e >= N_EMULATORS) return 0;
+
+	if(scanStep(e, SCAN_CHUNK)) {
+		if(menu && (g = item_userptr(current_item(menu)))) {
+			emu  = g->emu;
+			name = strdup(g->name);
+		}
+		freeMenu();
+		scanInstall(e);
+		i = buildMenu();
+		if(menu && name) {
+			for(i=0; items[i]; i++) {
+				if((g = item_userptr(items[i])) &&
+				  (g->emu == emu) && !strcmp(g->name, name)) {
+					set_current_item(menu, items[i]);
+					break;
+				}
+			}
+		} else if(i) {
+			menu_driver(menu, REQ_DOWN_ITEM);
+		}
+		free(name);
+	}
+
+	for(e=0; (e<N_EMULATORS) && !scan[e].active; e++);
+	return e < N_EMULATORS;
+}
+
+// Total bytes written to the terminal so far: everything this process
+// has written (per /proc/self/io) less cache file output.  Used by the
+// -f option to report the display cost of each keypress.
+static long long bytesWritten(void) {
+	char    buf[512], *ptr;
+	int     fd;
+	ssize_t n = 0;
+
+	if((fd = open("/proc/self/io", O_RDONLY)) >= 0) {
+		n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+	}
+	if(n <= 0) return 0;
+	buf[n] = 0;
+	return (ptr = strstr(buf, "wchar:")) ?
+	  (strtoll(&ptr[6], NULL, 10) - cacheBytes) : 0;
+}
+
+// Milliseconds elapsed since time t
+static double msSince(const struct timespec *t) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1000.0 +
+	  (now.tv_nsec - t->tv_nsec) / 1000000.0;
+}
+
+
+// evdev input -----------------------------------------------------------
+
+// Reading the input device directly sidesteps the console keymap, tty and
+// ncurses escape-sequence decoding.  Kernel (or retrogame) auto-repeat
+// events are ignored; gamera repeats navigation keys itself, starting
+// after REPEAT_DELAY ms and accelerating from REPEAT_RATE to REPEAT_MIN,
+// the same as retrogame's own repeat.
+
+#define REPEAT_DELAY 500 // Key hold time to begin repeat (ms)
+#define REPEAT_RATE  100 // Initial time between repetitions (ms)
+#define REPEAT_MIN    30 // Fastest repeat interval (ms)
+
+static const char        *evPath = NULL;  // -e device, NULL = search
+static int                evFd   = -1,    // evdev device, -1 = tty only
+                          evAuto = 1,     // Look for device (-k clears)
+                          evCount = 0,    // Events in evBuf[]
+                          evPos  = 0,     // Next event to process
+                          heldKey = ERR,  // Auto-repeating key, if any
+                          repeatMs,       // Current repeat interval
+                          shiftKeys = 0,  // Shift keys currently held
+                          axisDir[ABS_HAT0Y + 1]; // -1/0/+1 per axis
+static time_t             evRetry = 0;    // Time of last open attempt
+static struct timespec    repeatTime;     // When next repeat is due
+static struct input_event evBuf[64];      // Events read, not processed
+static struct input_absinfo
+                          absInfo[ABS_HAT0Y + 1]; // Stick/hat ranges
+
+#define TEST_BIT(bits, n) ((bits)[(n) / 8] & (1 << ((n) % 8)))
+
+// Open given evdev device, or if NULL, search for the retrogame virtual
+// keyboard, else the first gamepad or joystick.  The device is grabbed
+// so the console doesn't also see its keys; if that fails, another
+// program has it, and gamera falls back on terminal input.
+static void evdevOpen(const char *path) {
+	char          dev[32], name[256];
+	unsigned char keys[EVKEY_CNT / 8 + 1];
+	int           i, fd, pass;
+
+	evRetry = time(NULL);
+	for(pass=0; (evFd < 0) && (pass < (path ? 1 : 2)); pass++) {
+		for(i=0; (evFd < 0) && (i < (path ? 1 : 32)); i++) {
+			if(!path) (void)sprintf(dev, "/dev/input/event%d", i);
+			if((fd = open(path ? path : dev,
+			  O_RDONLY | O_NONBLOCK)) < 0) continue;
+			memset(name, 0, sizeof(name));
+			memset(keys, 0, sizeof(keys));
+			(void)ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+			(void)ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+			if((path || (!pass && !strcmp(name, "retrogame")) ||
+			  (pass && (TEST_BIT(keys, BTN_GAMEPAD) ||
+			  TEST_BIT(keys, BTN_JOYSTICK)))) &&
+			  !ioctl(fd, EVIOCGRAB, 1)) {
+				evFd = fd;
+			} else {
+				close(fd);
+			}
+		}
+	}
+
+	memset(absInfo, 0, sizeof(absInfo));
+	memset(axisDir, 0, sizeof(axisDir));
+	if(evFd >= 0) {
+		(void)ioctl(evFd, EVIOCGABS(ABS_X)    , &absInfo[ABS_X]);
+		(void)ioctl(evFd, EVIOCGABS(ABS_Y)    , &absInfo[ABS_Y]);
+		(void)ioctl(evFd, EVIOCGABS(ABS_HAT0X), &absInfo[ABS_HAT0X]);
+		(void)ioctl(evFd, EVIOCGABS(ABS_HAT0Y), &absInfo[ABS_HAT0Y]);
+	}
+	evCount = evPos = 0;
+	heldKey = ERR;
+}
+
+// Release evdev device while an emulator runs (grab=0), reclaim it after
+// (grab=1), discarding any input that arrived in the meantime.
+static void evdevGrab(int grab) {
+	if(evFd < 0) return;
+	(void)ioctl(evFd, EVIOCGRAB, grab);
+	if(grab) {
+		while(read(evFd, evBuf, sizeof(evBuf)) > 0);
+		memset(axisDir, 0, sizeof(axisDir));
+		evCount = evPos = shiftKeys = 0;
+		heldKey = ERR;
+	}
+}
+
+// Translate one evdev event to an ncurses key (or ERR if it doesn't
+// map to anything), starting or stopping auto-repeat as needed.
+static int evdevEvent(const struct input_event *ev) {
+	int i, key = ERR, dir, range, twice;
+
+	if(ev->type == EV_KEY) {
+		if((ev->code == KEY_LEFTSHIFT) || (ev->code == KEY_RIGHTSHIFT)) {
+			if(ev->value != 2) shiftKeys += ev->value ? 1 : -1;
+			if(shiftKeys < 0) shiftKeys = 0;
+			return ERR;
+		}
+		if(ev->value == 2) return ERR; // Sender's repeat; ours is below
+		for(i=0; (i<N_EV_KEYS) && (evKeys[i].code != ev->code); i++);
+		if(i >= N_EV_KEYS) return ERR;
+		key = evKeys[i].key;
+		if(!ev->value) { // Release
+			if(key == heldKey) heldKey = ERR;
+			return ERR;
+		}
+		if((key == 'r') && (shiftKeys > 0)) key = 'R';
+	} else if((ev->type == EV_ABS) && ((ev->code == ABS_X) ||
+	  (ev->code == ABS_Y) || (ev->code == ABS_HAT0X) ||
+	  (ev->code == ABS_HAT0Y))) {
+		// Outer quarter of axis range either side counts as a press
+		range = absInfo[ev->code].maximum - absInfo[ev->code].minimum;
+		twice = 4 * ev->value - 2 * (absInfo[ev->code].maximum +
+		  absInfo[ev->code].minimum);
+		dir   = (twice < -range) ? -1 : (twice > range) ? 1 : 0;
+		if(dir == axisDir[ev->code]) return ERR;
+		if((ev->code == ABS_X) || (ev->code == ABS_HAT0X))
+			key = ((dir ? dir : axisDir[ev->code]) < 0) ?
+			  KEY_PPAGE : KEY_NPAGE;
+		else
+			key = ((dir ? dir : axisDir[ev->code]) < 0) ?
+			  KEY_UP : KEY_DOWN;
+		axisDir[ev->code] = dir;
+		if(!dir) { // Returned to center = release
+			if(key == heldKey) heldKey = ERR;
+			return ERR;
+		}
+	} else {
+		return ERR;
+	}
+
+	if((key == KEY_UP) || (key == KEY_DOWN) ||
+	   (key == KEY_PPAGE) || (key == KEY_NPAGE)) {
+		heldKey  = key;
+		repeatMs = REPEAT_RATE;
+		clock_gettime(CLOCK_MONOTONIC, &repeatTime);
+		repeatTime.tv_sec  += REPEAT_DELAY / 1000;
+		repeatTime.tv_nsec += (REPEAT_DELAY % 1000) * 1000000;
+		if(repeatTime.tv_nsec >= 1000000000) {
+			repeatTime.tv_sec++;
+			repeatTime.tv_nsec -= 1000000000;
+		}
+	}
+	return key;
+}
+
+// Get next input from evdev device (if any) or terminal.  Returns an
+// ncurses key code, or ERR if nothing arrives within timeout ms (0 =
+// don't wait, -1 = wait indefinitely).
+static int getInput(int timeout) {
+	struct pollfd   pfd[2];
+	struct timespec now;
+	int             key, ms, n;
+
+	if((evFd < 0) && evAuto && (time(NULL) - evRetry >= 2)) {
+		// Device may come (back) later, e.g. when retrogame
+		// reloads its config it destroys and recreates its own.
+		evdevOpen(evPath);
+	}
+
+	for(;;) {
+		// Events already read but not yet processed
+		while(evPos < evCount) {
+			if((key = evdevEvent(&evBuf[evPos++])) != ERR)
+				return key;
+		}
+
+		// Terminal input (ncurses may already have some buffered)
+		wtimeout(mainWin, (evFd < 0) ? timeout : 0);
+		if(((key = wgetch(mainWin)) != ERR) || (evFd < 0)) return key;
+
+		// Auto-repeat: is one due, or when will it be?
+		ms = timeout;
+		if(heldKey != ERR) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			n = (repeatTime.tv_sec  - now.tv_sec) * 1000 +
+			    (repeatTime.tv_nsec - now.tv_nsec) / 1000000;
+			if(n <= 0) {
+				repeatTime = now;
+				repeatTime.tv_nsec += repeatMs * 1000000;
+				if(repeatTime.tv_nsec >= 1000000000) {
+					repeatTime.tv_sec++;
+					repeatTime.tv_nsec -= 1000000000;
+				}
+				if(repeatMs > REPEAT_MIN) repeatMs -= 5;
+				return heldKey;
+			}
+			if((ms < 0) || (n < ms)) ms = n;
+		}
+
+		pfd[0].fd     = evFd;
+		pfd[1].fd     = STDIN_FILENO;
+		pfd[0].events = pfd[1].events = POLLIN;
+		if(poll(pfd, 2, ms) <= 0) {
+			if((heldKey != ERR) && (ms != timeout)) continue;
+			return ERR;
+		}
+		if(pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			close(evFd); // Device went away
+			evFd    = -1;
+			heldKey = ERR;
+		} else if(pfd[0].revents & POLLIN) {
+			n       = read(evFd, evBuf, sizeof(evBuf));
+			evCount = (n > 0) ? (n / sizeof(struct input_event)) : 0;
+			evPos   = 0;
+		}
+	}
+}
 
 // Main stuff ------------------------------------------------------------
 
 int main(int argc, char *argv[]) {
 
-	const char  title[] = "Game ROM Aggregator (GAMERA)";
-	char        cmdline[1024];
-	Game       *g;
-	int         i;
+	const char      title[] = "Game ROM Aggregator (GAMERA)";
+	char            cmdline[3 * PATH_MAX], *ptr;
+	Game           *g;
+	int             i, c, status[N_EMULATORS], sync = 0,
+	                timing = 0,    // -t: report time-to-menu and exit
+	                frameCost = 0, // -f: report output bytes per key
+	                scanning = 0;
+	long long       bytes = 0;
+	struct timespec startTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+	while((c = getopt(argc, argv, "c:de:fkr:tx:")) != -1) {
+		switch(c) {
+		   case 'c': // Alternate cache directory
+			cacheDir = optarg;
+			break;
+		   case 'd': // Flag duplicate and known-bad ROMs
+			checkDups = 1;
+			break;
+		   case 'e': // evdev input device
+			evPath = optarg;
+			break;
+		   case 'k': // Terminal input only
+			evAuto = 0;
+			break;
+		   case 'f': // Report terminal bytes written per keypress
+			frameCost = 1;
+			break;
+		   case 'r': // Alternate ROM folder(s), e.g. -r mame=/mnt/roms
+			if((ptr = strchr(optarg, '='))) {
+				for(i=0; i<N_EMULATORS; i++) {
+					if(!strncmp(optarg, emulator[i].tag,
+					  ptr - optarg) &&
+					  !emulator[i].tag[ptr - optarg])
+						emulator[i].romPath = &ptr[1];
+				}
+			}
+			break;
+		   case 't': // Benchmark: time to menu & background rescan
+			timing = 1;
+			break;
+		   case 'x': // Alternate MAME XML file
+			mameXmlFile = optarg;
+			break;
+		   default:
+			(void)fprintf(stderr, "Usage: %s [-c cachedir] [-d] "
+			  "[-e device] [-f] [-k] [-r emu=dir[:dir...]] [-t] "
+			  "[-x xmlfile]\n", argv[0]);
+			return 1;
+		}
+	}
 
 	// ncurses setup
 	initscr();
@@ -507,18 +2398,58 @@ int main(int argc, char *argv[]) {
 
 	mainWin = newwin(LINES-3, COLS, 1, 0);
 	keypad(mainWin, TRUE);
+	if(evAuto) evdevOpen(evPath);
 	box(mainWin, 0, 0);
 
 	refresh();
 
-	// Scan emulator ROM folders and load items[] list.  If more than
-	// one emulator is active (find_roms() > 0), move the default
-	// selection down one item -- the first is an emulator name, not
-	// a game title.
-	if(find_roms()) menu_driver(menu, REQ_DOWN_ITEM);
+	// Load cached ROM listings for immediate display.  Emulators with
+	// no cached listing are scanned now; those whose ROM folders have
+	// changed since it was cached are rescanned in the background.
+	for(i=0; i<N_EMULATORS; i++) {
+		if((status[i] = listLoad(i)) < 0) sync = 1;
+	}
+	if(sync) scanMessage();
+	for(i=0; i<N_EMULATORS; i++) {
+		if(status[i] <= 0) scanStart(i);
+		if(!status[i]) scanning = 1;
+	}
+	for(i=0; i<N_EMULATORS; i++) {
+		if(status[i] < 0) {
+			while(!scanStep(i, INT_MAX));
+			scanInstall(i);
+		}
+	}
+
+	// Load items[] list.  If more than one emulator is active
+	// (buildMenu() > 0), move the default selection down one item --
+	// the first is an emulator name, not a game title.
+	if(buildMenu()) menu_driver(menu, REQ_DOWN_ITEM);
+
+	if(timing) {
+		(void)fprintf(stderr, "%s: menu in %.1f ms, %d items\n",
+		  argv[0], msSince(&startTime), menu ? item_count(menu) : 0);
+		if(!scanning) {
+			endwin();
+			return 0;
+		}
+	}
 
 	for(;;) {
-		switch(wgetch(mainWin)) {
+		// Don't block for input while a background rescan remains
+		c = getInput(scanning ? 0 : -1);
+		if(frameCost && (c != ERR)) bytes = bytesWritten();
+		switch(c) {
+		   case ERR: // No input pending
+			if(scanning && !(scanning = scanIdle()) && timing) {
+				endwin();
+				(void)fprintf(stderr, "%s: rescan done in "
+				  "%.1f ms, %d items\n", argv[0],
+				  msSince(&startTime),
+				  menu ? item_count(menu) : 0);
+				return 0;
+			}
+			break;
 		   case KEY_DOWN:
 			menu_driver(menu, REQ_DOWN_ITEM);
 			if(!item_userptr(current_item(menu)))     // Emu name
@@ -535,8 +2466,9 @@ int main(int argc, char *argv[]) {
 		   case KEY_PPAGE:
 			menu_driver(menu, REQ_SCR_UPAGE);
 			break;
-		   case 'r': // Re-scan ROM folder
+		   case 'r': // Re-scan ROM folders
 			if(find_roms()) menu_driver(menu, REQ_DOWN_ITEM);
+			scanning = 0;
 			break;
 		   case 'R': // Rotate-and-reboot
 			if(!geteuid()) { // Must be root
@@ -577,6 +2509,7 @@ int main(int argc, char *argv[]) {
 				mvwprintw(launchWin, 1, 2, launchMsg);
 				wrefresh(launchWin);
 
+				evdevGrab(0); // Emulator gets the controls
 				def_prog_mode();
 				endwin();
 				(*emulator[g->emu].command)(g, cmdline);
@@ -588,12 +2521,18 @@ int main(int argc, char *argv[]) {
 					while(!getch());
 				}
 
+				evdevGrab(1);
+				flushinp();
 				delwin(launchWin);
 				redrawwin(mainWin);
 			}
 			break;
 		}
 		wrefresh(mainWin);
+		if(frameCost && (c != ERR)) {
+			(void)fprintf(stderr, "%s: key %d: %lld bytes\n",
+			  argv[0], c, bytesWritten() - bytes);
+		}
 	}
 
 	return 0;
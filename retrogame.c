@@ -13,23 +13,118 @@ command line argument.
 
 Connect one side of button(s) to GND pin (there are several on the GPIO
 header, but see later notes) and the other side to GPIO pin of interest.
-Internal pullups are used; no resistors required.  MCP23017 I2C port
-expanders are also supported (up to 8).  Pin mapping is:
+Internal pullups are used; no resistors required.  I2C port expanders are
+also supported (up to 8): MCP23017, PCA9555/TCA9555 and PCF8574/PCF8574A,
+in any mix.  Pin mapping is:
 
     0 -  31   GPIO header 'P5' (Broadcom pin numbers)
-   32 -  47   MCP23017 at address 0x20
-   48 -  63   MCP23017 at address 0x21
-   64 -  79   MCP23017 at address 0x22
-   80 -  95   MCP23017 at address 0x23
-   96 - 111   MCP23017 at address 0x24
-  112 - 127   MCP23017 at address 0x25
-  128 - 143   MCP23017 at address 0x26 *** Arcade Bonnet default address
-  144 - 159   MCP23017 at address 0x27 *** Arcade Bonnet alt address
+   32 -  47   Port expander at address 0x20
+   48 -  63   Port expander at address 0x21
+   64 -  79   Port expander at address 0x22
+   80 -  95   Port expander at address 0x23
+   96 - 111   Port expander at address 0x24
+  112 - 127   Port expander at address 0x25
+  128 - 143   Port expander at address 0x26 *** Arcade Bonnet default address
+  144 - 159   Port expander at address 0x27 *** Arcade Bonnet alt address
+  160 - 175   MCP3008/MCP3208 SPI ADC threshold 'pins' (2 per channel)
+  176 - 239   Codes from evdev input devices (USB encoders, trackballs)
+  240 - 261   GPIO 32-53 (Compute Module; Broadcom numbers + 208)
+
+Any native pin may also be given by name, GPIO0 to GPIO53 (e.g. 'GPIO40'
+is pin 248), so configs can use Broadcom numbers throughout.
+
+On a Pi 5 the header GPIO belongs to the RP1 I/O controller rather than
+the SoC; this is detected from the device tree, and pull-ups are then set
+in RP1's pad registers (through /dev/gpiomem0, else /dev/mem).  Its GPIO
+0-27 are the header pins, numbered as on earlier boards.  bench/rp1check.c
+checks that code against a file standing in for the registers.
 
 Config file IRQ command must be used to bind a GPIO pin to an I2C address!
+'IRQ 17 0x26' is an MCP23017 (the Arcade Bonnet); a chip name can follow
+the address for other types, e.g. 'IRQ 17 0x21 PCA9555'.  A PCF8574 uses
+only the first 8 pins of its range; PCF8574A addresses are 0x38-0x3F, for
+the same ranges as 0x20-0x27.
+
+Or an expander can be left to its kernel driver (pinctrl-mcp23s08,
+gpio-pca953x, gpio-pcf857x), bound by a device tree overlay that gives it
+an interrupt pin, e.g. 'dtoverlay=mcp23017,addr=0x20,gpiopin=17'.  The
+GPIOCHIP command ('GPIOCHIP 0x20', optionally followed by its
+/dev/gpiochipN) then takes the same pin range's edges from the GPIO
+character device: the kernel services the chip's interrupt, and each edge
+arrives with its own timestamp.  bench/explat.c compares the two.
+
+One MCP3008 (10-bit) or MCP3208 (12-bit) SPI ADC can be added with the
+config file ADC command.  All channels in use are sampled in one batched
+spidev ioctl() per scan, paced by a timerfd (1 KHz default).  A channel
+can drive an absolute axis on the virtual device (AXIS command) and/or a
+pair of threshold pins: 160 + channel * 2 is 'pressed' when the reading is
+in the bottom quarter of the range, 161 + channel * 2 in the top quarter
+(e.g. a thumbstick on channel 0 can be 'LEFT 160' and 'RIGHT 161').
+Readings can be smoothed per channel (FILTER command) by a fixed-point
+One-Euro filter ahead of both, trading jitter against lag by stick speed.
+
+Other input devices (USB button encoders, trackballs, etc.) can feed the
+same debounce/combo/repeat handling: the EVDEV command binds a device's
+button codes, or either end of its absolute axes, to pins 176-239.  Such
+devices are grabbed (EVIOCGRAB) so other programs don't also see their
+raw events; relative motion (trackball, spinner) is passed through to
+the retrogame device as-is.  A source may also be a FIFO or file of raw
+input_event records (not grabbed), for testing without hardware.
 
 Must be run as root, i.e. 'sudo ./retrogame &' or edit /etc/rc.local to
-launch automatically at system startup.
+launch automatically at system startup.  It can be started early in boot:
+if /dev/uinput, /dev/i2c-1 or the GPIO driver aren't there yet, it says
+so, enters its main loop regardless, and brings each one up when its
+device node appears (watched with inotify, no polling).
+
+To deploy a new build without disturbing running emulators, install the
+new binary over the old one and 'sudo pkill -USR2 retrogame'.  The running
+instance re-executes the binary, handing over its pin state and open
+uinput/GPIO/I2C/ADC/input device descriptors; the new instance adopts
+them, so the virtual device is never destroyed and pins aren't re-exported.
+(An incompatible new build instead starts afresh.)  kill -HUP reloads the
+config file, kill -USR1 prints output queue statistics.
+
+If retrogame is pinned to one core (e.g. 'taskset -c 3 retrogame'), and
+optionally given a real-time priority ('chrt -f 50'), the AFFINITY config
+command moves the GPIO interrupts behind its pins, and any threaded IRQ
+handlers, to that same core and priority, avoiding a cross-core wakeup
+per press.  Changes are reported, and undone when the config is unloaded.
+
+On boards with a USB device port (Pi Zero, etc.), the HID config command
+makes the Pi itself a USB keyboard/gamepad for another computer, in place
+of the local uinput device.  A gadget is set up through configfs and
+reports written to /dev/hidgN; the report descriptor is generated from
+the config (keys with a USB usage, BTN_* buttons, ADC axes X through
+WHEEL).  Reports go out at most once per millisecond, coalescing changes
+within that interval; a tap shorter than that is still reported.
+
+Each frame on the uinput device carries an EV_MSC/MSC_TIMESTAMP event
+giving when its input actually changed: the earliest edge among the
+frame's keys (ahead of debounce), an evdev source's own event time, or
+the ADC scan time.  Values are CLOCK_MONOTONIC microseconds, truncated to
+32 bits as for hardware timestamps, so a reader that selects that clock
+(EVIOCSCLOCKID) can subtract it from the event time for press-to-frame
+latency.  Key repeats and the Vulcan combo key are retrogame's own and
+carry none.
+
+The HEALTH config command keeps per-switch statistics (presses, edges
+per press, bounce time histogram, baseline and recent bounce) in a file
+that survives restarts; 'retrogame --health [file]' reports them and
+flags switches that bounce much longer than they used to, or for close
+to the debounce time, so they can be replaced before causing trouble.
+
+The RUN config command binds a program to a pin or chord of pins, held
+for a given time (e.g. Start+Select for 3 seconds to shut down).  It's
+started directly (posix_spawn(), no shell) and reaped via the signalfd,
+so input handling carries on unaffected while it runs; each command runs
+one at a time and at most every quarter second.  bench/runlat.c checks
+input latency while commands run.
+
+Inputs changing within one debounce interval are sent in the order they
+changed (by those same edge times), not pin order, so fast motion inputs
+such as quarter-circle + punch arrive as played.  The ORDER command can
+give each change a frame of its own, optionally at its original spacing.
 
 Early Raspberry Pi Linux distributions might not have the uinput kernel
 module installed by default.  To enable this, add a line to /etc/modules:
@@ -69,6 +164,8 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _GNU_SOURCE // memfd_create()
+#define _FILE_OFFSET_BITS 64 // mmap() offset of RP1 GPIO (Pi 5)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,63 +176,301 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <poll.h>
 #include <signal.h>
 #include <dirent.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <spawn.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/signalfd.h>
 #include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
 #include <bcm_host.h>
 #include "keyTable.h"
 
+#ifndef input_event_sec // Kernel headers before 4.16
+#define input_event_sec  time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+// Pin numbering (see table above) and poll() descriptor layout.
+#define N_GPIO      54                  // Native GPIO pins (0-53)
+#define ADC_PIN0    160                 // First ADC threshold pin
+#define EV_PIN0     176                 // First evdev source pin
+#define N_EVPINS    64                  // evdev source pins (176-239)
+#define GPIO_PIN1   240                 // Pin number of GPIO32 (bank 1)
+#define N_PINS      262                 // Native + MCP + ADC + evdev pins
+#define N_WORDS     ((N_PINS + 31) / 32) // 32-bit words in pin bitmasks
+#define VULCAN      N_PINS              // key[] index of 'pinch' key
+#define PFD_SIGNAL  N_GPIO              // signalfd
+#define PFD_CFGFILE (N_GPIO + 1)        // inotify, config file
+#define PFD_CFGDIR  (N_GPIO + 2)        // inotify, config directory
+#define PFD_ADC     (N_GPIO + 3)        // timerfd, ADC scan interval
+#define PFD_OUT     (N_GPIO + 4)        // keyfd, while output is backlogged
+#define PFD_HID     (N_GPIO + 5)        // timerfd, HID report interval
+#define N_EVDEV     8                   // Max evdev input sources
+#define PFD_DEV     (N_GPIO + 6)        // inotify, /dev (awaiting nodes)
+#define PFD_CHIP    (N_GPIO + 7)        // Kernel expander lines, 8 slots
+#define PFD_EVDEV   (N_GPIO + 15)       // First evdev input source
+#define N_PFD       (PFD_EVDEV + N_EVDEV) // Total poll() descriptors
+#define OUT_QUEUE   1024                // Output ring size (power of 2)
+#define I2C_BUS     "i2c-1"             // Port expander bus (node in /dev)
+#define DEV_GPIO    0x01                // devWait: Sysfs GPIO chip
+#define DEV_UINPUT  0x02                // devWait: /dev/uinput
+#define DEV_I2C     0x04                // devWait: /dev/I2C_BUS
+#define DEV_CHIP    0x08                // devWait: GPIOCHIP expander nodes
+#define STATE_ENV   "RETROGAME_STATE"   // Environment var, re-exec state fd
+#define STATE_MAGIC 0x52475331          // 'RGS1', re-exec state header
+#define STATE_VER   1                   // Bump when carried state changes
+#define MAX_IRQS    16                  // Max IRQs retuned by AFFINITY
+#define HID_GADGET  "/sys/kernel/config/usb_gadget/retrogame" // configfs
+#define HID_INTERVAL 1000               // Min. microseconds between reports
+#define HID_REPORT  32                  // Max. bytes in one HID report
+#define HID_BITS    320                 // Keyboard usages 0-255, buttons
+#define HEALTH_FILE "/var/lib/retrogame.health" // Default switch stats file
+#define HEALTH_MAGIC 0x52474832         // 'RGH2', switch stats file header
+#define HEALTH_BINS 16                  // Bounce histogram bins (log2 usec)
+#define HEALTH_BASE 256                 // Presses in a switch's baseline
+#define N_RUN       8                   // Max pin/chord commands (RUN)
+#define RUN_WORDS   16                  // Max program + argument words
+#define RUN_GAP     250                 // Min ms between a command's starts
+
+// One-Euro filter state for one ADC channel, all fixed-point.  Cutoff
+// frequency rises with stick speed: a resting stick is smoothed hard
+// (no jitter), fast motion passes with little lag.
+typedef struct {
+	int32_t minCut, // Minimum cutoff frequency, milliHz (0 = filter off)
+	        beta,   // Cutoff increase, milliHz per full-scale/second
+	        dCut;   // Cutoff for speed estimate, milliHz
+	int64_t x,      // Filtered value, ADC units Q16 (-1 = not primed)
+	        dx;     // Filtered speed, ADC units/second Q16
+} euroFilter;
+
+// Binding of one evdev source code to a virtual pin (EV_PIN0 and up)
+typedef struct {
+	int8_t   src;    // Index into evPath[] (-1 = pin unused)
+	int8_t   dir;    // 0 = key/button, -1/+1 = low/high end of axis
+	uint16_t code;   // Key/button or absolute axis code
+	int32_t  thresh; // Axes: 'pressed' beyond this value
+} evdevPin;
+
+// IRQ retuned by AFFINITY command, with prior settings for restore
+typedef struct {
+	int   irq,      // IRQ number
+	      policy,   // irq thread's original scheduling policy...
+	      prio;     // ...and priority
+	pid_t thread;   // irq/N-name kernel thread (0 = none/untouched)
+	char  mask[64]; // Original smp_affinity_list ("" = untouched)
+} irqSave;
+
+// Switch health record for one pin, kept in the HEALTH file.  Bounce is
+// the time from a press's first edge to its last before settling.
+typedef struct {
+	uint32_t presses,           // Debounced presses
+	         bounced,           // ...with more than one edge
+	         hist[HEALTH_BINS], // Bounce: bin 0 = none, n = 2^(n-1) usec+
+	         maxUs,             // Longest bounce, usec
+	         base,              // Mean bounce over first HEALTH_BASE presses
+	         recent;            // Recent bounce, usec Q4 (EWMA, 1/32)
+	uint64_t edges;             // Edges seen over all presses
+} pinHealth;
+
+// Layout of the HEALTH file (mmap()ed, so counts outlive the process)
+typedef struct {
+	uint32_t  magic,        // HEALTH_MAGIC
+	          nPins,        // N_PINS
+	          debounce,     // debounceTime when last written, ms
+	          pad;
+	uint8_t   expAddr[8],   // I2C address per expander slot (0 = unused)
+	          expBits[8];   // Its pins: 16 = ports A/B, 8, 0 = gpiochip
+	char      expName[8][8];// Chip type for the report, e.g. "PCF"
+	pinHealth pin[N_PINS];
+} healthFile;
+
+// Command bound to a pin or chord of pins (RUN command)
+typedef struct {
+	uint32_t mask[N_WORDS]; // Pins, all held together to run
+	int32_t  hold,          // Milliseconds held before running (0 = none)
+	         nArgs;         // Words in args[]
+	pid_t    pid;           // Running instance (0 = none)
+	int64_t  held,          // msNow() when chord completed (0 = not held,
+	                        // -1 = held and already run)
+	         last;          // msNow() when last started
+	char     args[200];     // Program and arguments, NUL-separated
+} runBind;
+
+// I2C port expander driver.  Pin levels are 16 bits, port A/0 in the low
+// byte; 8-bit chips report their missing upper pins as high (released).
+typedef struct {
+	const char *name;  // Chip name, as in IRQ command
+	uint8_t     base,  // I2C address of slot 0 (pins 32-47)
+	            bits;  // I/O pins
+	int       (*init)(int fd, uint16_t inputs, uint16_t gnds); // Levels
+	void      (*exit)(int fd, uint16_t gnds); // GNDs back to inputs
+	int       (*read)(int fd); // Interrupt service: levels, or -1
+} expDriver;
+
+// A debounced pin change, for output in edge-time order
+typedef struct {
+	int64_t t;     // Edge time (usec)
+	int16_t pin;   // Pin index
+	int8_t  value; // 1 = press, 0 = release
+} pinEdge;
+
+// Output of changes within one debounce interval (ORDER command)
+enum orderMode {
+	ORDER_FRAME,  // One frame, events in edge-time order (default)
+	ORDER_SPLIT,  // One frame per change, back-to-back
+	ORDER_SPACED  // One frame per change, at original spacing
+};
+
 // Global variables and such -----------------------------------------------
 
 bool
    running      = true,              // Signal handler will set false (exit)
-   isEarlyPi    = false;             // true=Pi1Rev1, false=all other
+   irqTune      = false,             // AFFINITY command given
+   hidOn        = false,             // HID command given
+   hidKbd       = false,             // HID keyboard report in use
+   hidIds       = false,             // HID reports need report IDs
+   hidDirty     = false,             // HID state changed since last report
+   isEarlyPi    = false,             // true=Pi1Rev1, false=all other
+   rp1          = false;             // GPIO is Pi 5 RP1 (else BCM283x/2711)
 extern char
   *__progname,                       // Program name (for error reporting)
-  *program_invocation_name;          // Full name as invoked (path, etc.)
+  *program_invocation_name,          // Full name as invoked (path, etc.)
+ **environ;                          // Environment, for RUN commands
 char
    sysfs_root[] = "/sys/class/gpio", // Location of Sysfs GPIO files
   *cfgPath,                          // Directory containing config file
   *cfgName      = NULL,              // Name (no path) of config
   *cfgPathname,                      // Full path/name to config file
+ **progArgv,                         // argv[] for live re-exec
+   execPath[256],                    // Program binary for live re-exec
    debug        = 0,                 // 0=off, 1=cfg file, 2=live buttons
-   startupDebug = 0,                 // Initial debug level before cfg load
-   readAddr     = 0x10;              // For MCP23017 reads (INTCAPA reg addr)
+   startupDebug = 0;                 // Initial debug level before cfg load
 int
-   key[161],                         // Keycodes assigned to GPIO pins
+   key[N_PINS + 1],                  // Keycodes assigned to GPIO pins
    fileWatch,                        // inotify file descriptor
    keyfd1       = -1,                // /dev/uinput file descriptor
    keyfd2       = -1,                // /dev/input/eventX file descriptor
    keyfd        = -1,                // = (keyfd2 >= 0) ? keyfd2 : keyfd1;
-   i2cfd[8],                         // /dev/i2c-1 MCP23017 file descriptors
+   i2cfd[8],                         // /dev/i2c-1 port expander descriptors
    vulcanTime   = 1500,              // Pinch time in milliseconds
    debounceTime = 20,                // 20 ms for button debouncing
    repTime1     = 500,               // Key hold time to begin repeat
-   repTime2     = 100;               // Time between key repetitions
+   repTime2     = 100,               // Time between key repetitions
+   adcFd        = -1,                // SPI ADC device file descriptor
+   adcRate      = 1000,              // ADC scans per second
+   adcBits      = 0,                 // ADC resolution (0 = no ADC)
+   adcN         = 0,                 // Number of ADC channels in use
+   adcChan[8],                       // ADC channel for each transfer
+   adcAxis[8],                       // ABS_* code per channel (-1 = none)
+   nEvdev       = 0,                 // Number of evdev input sources
+   nIrqs        = 0,                 // Number of entries in irqs[]
+   hidFd        = -1,                // /dev/hidgN file descriptor
+   hidBtns      = 0,                 // Buttons in HID gamepad report
+   nHidAxes     = 0,                 // Axes in HID gamepad report
+   hidAxisCode[8],                   // ABS_* code per HID report axis
+   hidLen[2],                        // HID keyboard, gamepad report bytes
+   order        = ORDER_FRAME,       // Output order mode (ORDER command)
+   nSeq         = 0,                 // Changes in seq[] from last debounce
+   seqPos       = 0,                 // Next seq[] change to output
+   nRun         = 0;                 // Number of RUN commands
    // Note: auto-repeat is for navigating the game-selection menu using the
    // 'gamera' utility; MAME disregards key repeat events (as it should).
 uint32_t
-   intstate[5],                      // Button last-read state (bitmask)
-   extstate[5],                      // Button debounced state
-   vulcanMask[5],                    // Bitmask of 'Vulcan nerve pinch' keys
-   mcpMask      = 0;                 // Bitmask of GPIOs assigned to MCP IRQs
+   outHead      = 0,                 // Output ring: next event in
+   outTail      = 0,                 // Output ring: next event out
+   outPart      = 0,                 // Bytes of tail event already written
+   outMax       = 0,                 // Output ring high-water mark
+   outRetries   = 0,                 // Writes deferred for POLLOUT
+   outDrops     = 0,                 // Events dropped on ring overflow
+   hidReports   = 0,                 // HID reports sent
+   hidRetries   = 0,                 // HID reports deferred for POLLOUT
+   hidErrors    = 0,                 // HID reports failed (host absent)
+   runDrops     = 0,                 // RUN starts refused by rate limit
+   intstate[N_WORDS],                // Button last-read state (bitmask)
+   extstate[N_WORDS],                // Button debounced state
+   vulcanMask[N_WORDS],              // Bitmask of 'Vulcan nerve pinch' keys
+   runMask[N_WORDS];                 // Bitmask of pins in RUN commands
+uint64_t
+   mcpMask      = 0;                 // Bitmask of GPIOs used as expander IRQs
+uint16_t
+   edgeCount[N_PINS],                // Edges since pin's last debounce pass
+   adcValue[8],                      // Last ADC sample per channel
+   hidAxis[8];                       // HID report axis values
+int64_t
+   hidLast      = 0,                 // Time of last HID report (usec)
+   wakeTime     = 0,                 // Time poll() last returned (usec)
+   edgeTime[N_PINS],                 // Time each pin left issued state
+   edgeLast[N_PINS],                 // Time of each pin's latest edge
+   seqBase      = 0,                 // Time first seq[] frame was output
+   runNext      = 0;                 // msNow() next RUN hold is up (0=none)
+euroFilter
+   adcFilter[8];                     // Per-channel ADC smoothing
+evdevPin
+   evPin[N_EVPINS];                  // evdev source bindings per pin
+irqSave
+   irqs[MAX_IRQS];                   // IRQs changed by AFFINITY
+pinEdge
+   seq[N_PINS];                      // Last debounce's changes, time order
+runBind
+   runs[N_RUN];                      // Pin/chord commands
 uint8_t
-   mcpI2C[32];                       // GPIO index to MCP23017 I2C addr
+   devWait      = 0,                 // DEV_* subsystems awaiting /dev nodes
+   mcpI2C[N_GPIO],                   // GPIO index to expander I2C addr
+   mcpChip[8],                       // expander[] driver per address slot
+   chipMask     = 0,                 // Slots run by kernel driver (GPIOCHIP)
+   chipAddr[8],                      // I2C address per GPIOCHIP slot
+   adcTx[8][3],                      // ADC SPI transmit buffers
+   adcRx[8][3],                      // ADC SPI receive buffers
+   hidDown[HID_BITS / 8],            // HID usages/buttons held
+   hidLatch[HID_BITS / 8],           // ...pressed since last report
+   hidSent[2][HID_REPORT];           // Last keyboard, gamepad reports
+bool
+   adcStub      = false;             // ADC 'device' is plain file/FIFO
+char
+   adcPath[100] = "/dev/spidev0.0",  // SPI ADC device
+   evPath[N_EVDEV][100],             // evdev input source devices
+   chipNode[8][32],                  // GPIOCHIP device ("" = find by addr)
+   hidUdc[100]  = "",                // USB device controller ("" = first)
+   healthPath[100] = "";             // Switch stats file ("" = none)
+healthFile
+  *health       = NULL;              // Switch stats (mmap()ed healthPath)
+struct spi_ioc_transfer
+   adcXfer[8];                       // Batched ADC transfers
 volatile unsigned int
   *gpio         = NULL;              // GPIO register table
 struct pollfd
-   p[35];                            // File descriptors for poll()
+   p[N_PFD];                         // File descriptors for poll()
+struct input_event
+   outQ[OUT_QUEUE];                  // Output ring (events to keyfd)
 
 enum commandNum {
-	CMD_NONE, // Used during config file read (no command ID'd yet)
-	CMD_KEY,  // Key-to-GPIO mapping command
-	CMD_IRQ,  // MCP23017 IRQ pin & address assignment
-	CMD_GND,  // Pin-to-ground assignment
-	CMD_DEBUG // Set debug level
+	CMD_NONE,   // Used during config file read (no command ID'd yet)
+	CMD_KEY,    // Key-to-GPIO mapping command
+	CMD_IRQ,    // Port expander IRQ pin, address & type assignment
+	CMD_GPIOCHIP,// Port expander run by kernel driver
+	CMD_GND,    // Pin-to-ground assignment
+	CMD_DEBUG,  // Set debug level
+	CMD_ADC,    // SPI ADC type, device & scan rate
+	CMD_AXIS,   // ADC channel-to-absolute-axis mapping
+	CMD_FILTER, // ADC channel smoothing parameters
+	CMD_EVDEV,  // evdev source code-to-pin mapping
+	CMD_AFFINITY,// Co-locate GPIO IRQs with retrogame's core/priority
+	CMD_HID,    // USB HID gadget output in place of uinput
+	CMD_ORDER,  // Output of changes within one debounce interval
+	CMD_HEALTH, // Per-pin switch bounce statistics file
+	CMD_RUN     // Command to run on a pin or chord
 };
 
 // dict of config file commands that AREN'T keys (KEY_*)
@@ -143,24 +478,139 @@ dict command[] = { // Struct is defined in keyTable.h
 	{ "GND"     , CMD_GND   },
 	{ "GROUND"  , CMD_GND   },
 	{ "IRQ"     , CMD_IRQ   },
+	{ "GPIOCHIP", CMD_GPIOCHIP },
 	{ "DEBUG"   , CMD_DEBUG },
+	{ "ADC"     , CMD_ADC   },
+	{ "AXIS"    , CMD_AXIS  },
+	{ "FILTER"  , CMD_FILTER},
+	{ "EVDEV"   , CMD_EVDEV },
+	{ "AFFINITY", CMD_AFFINITY },
+	{ "HID"     , CMD_HID   },
+	{ "ORDER"   , CMD_ORDER },
+	{ "HEALTH"  , CMD_HEALTH},
+	{ "RUN"     , CMD_RUN   },
 	// Might add commands here for fine-tuning debounce & repeat settings
 	{  NULL     , -1        } }; // END-OF-LIST
 
+// dict of supported SPI ADCs (value is resolution in bits)
+dict adcType[] = {
+	{ "MCP3008" , 10 },
+	{ "MCP3208" , 12 },
+	{  NULL     , -1 } };
+
+// dict of absolute axes an ADC channel may drive
+dict axisName[] = {
+	{ "X"       , ABS_X        },
+	{ "Y"       , ABS_Y        },
+	{ "Z"       , ABS_Z        },
+	{ "RX"      , ABS_RX       },
+	{ "RY"      , ABS_RY       },
+	{ "RZ"      , ABS_RZ       },
+	{ "THROTTLE", ABS_THROTTLE },
+	{ "RUDDER"  , ABS_RUDDER   },
+	{ "WHEEL"   , ABS_WHEEL    },
+	{ "GAS"     , ABS_GAS      },
+	{ "BRAKE"   , ABS_BRAKE    },
+	{ "HAT0X"   , ABS_HAT0X    },
+	{ "HAT0Y"   , ABS_HAT0Y    },
+	{  NULL     , -1           } };
+
+// dict of ORDER command modes
+dict orderName[] = {
+	{ "FRAME"   , ORDER_FRAME  },
+	{ "SPLIT"   , ORDER_SPLIT  },
+	{ "SPACED"  , ORDER_SPACED },
+	{  NULL     , -1           } };
+
+// dict of button codes (not in keyTable) for EVDEV sources
+dict btnName[] = {
+	{ "BTN_LEFT"   , BTN_LEFT    }, { "BTN_RIGHT"  , BTN_RIGHT   },
+	{ "BTN_MIDDLE" , BTN_MIDDLE  }, { "BTN_SIDE"   , BTN_SIDE    },
+	{ "BTN_EXTRA"  , BTN_EXTRA   }, { "BTN_TRIGGER", BTN_TRIGGER },
+	{ "BTN_THUMB"  , BTN_THUMB   }, { "BTN_THUMB2" , BTN_THUMB2  },
+	{ "BTN_TOP"    , BTN_TOP     }, { "BTN_TOP2"   , BTN_TOP2    },
+	{ "BTN_PINKIE" , BTN_PINKIE  }, { "BTN_BASE"   , BTN_BASE    },
+	{ "BTN_BASE2"  , BTN_BASE2   }, { "BTN_BASE3"  , BTN_BASE3   },
+	{ "BTN_BASE4"  , BTN_BASE4   }, { "BTN_BASE5"  , BTN_BASE5   },
+	{ "BTN_BASE6"  , BTN_BASE6   }, { "BTN_SOUTH"  , BTN_SOUTH   },
+	{ "BTN_EAST"   , BTN_EAST    }, { "BTN_NORTH"  , BTN_NORTH   },
+	{ "BTN_WEST"   , BTN_WEST    }, { "BTN_A"      , BTN_A       },
+	{ "BTN_B"      , BTN_B       }, { "BTN_C"      , BTN_C       },
+	{ "BTN_X"      , BTN_X       }, { "BTN_Y"      , BTN_Y       },
+	{ "BTN_Z"      , BTN_Z       }, { "BTN_TL"     , BTN_TL      },
+	{ "BTN_TR"     , BTN_TR      }, { "BTN_TL2"    , BTN_TL2     },
+	{ "BTN_TR2"    , BTN_TR2     }, { "BTN_SELECT" , BTN_SELECT  },
+	{ "BTN_START"  , BTN_START   }, { "BTN_MODE"   , BTN_MODE    },
+	{ "BTN_THUMBL" , BTN_THUMBL  }, { "BTN_THUMBR" , BTN_THUMBR  },
+	{  NULL        , -1          } };
+
+// USB HID keyboard usage for each key code below 128 (0 = none, E0-E7 =
+// modifiers).  Other keys have no place in a boot keyboard report.
+static const uint8_t hidUsage[] = {
+	0x00, 0x29, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, //   0-  7
+	0x24, 0x25, 0x26, 0x27, 0x2D, 0x2E, 0x2A, 0x2B, //   8- 15
+	0x14, 0x1A, 0x08, 0x15, 0x17, 0x1C, 0x18, 0x0C, //  16- 23
+	0x12, 0x13, 0x2F, 0x30, 0x28, 0xE0, 0x04, 0x16, //  24- 31
+	0x07, 0x09, 0x0A, 0x0B, 0x0D, 0x0E, 0x0F, 0x33, //  32- 39
+	0x34, 0x35, 0xE1, 0x31, 0x1D, 0x1B, 0x06, 0x19, //  40- 47
+	0x05, 0x11, 0x10, 0x36, 0x37, 0x38, 0xE5, 0x55, //  48- 55
+	0xE2, 0x2C, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, //  56- 63
+	0x3F, 0x40, 0x41, 0x42, 0x43, 0x53, 0x47, 0x5F, //  64- 71
+	0x60, 0x61, 0x56, 0x5C, 0x5D, 0x5E, 0x57, 0x59, //  72- 79
+	0x5A, 0x5B, 0x62, 0x63, 0x00, 0x00, 0x64, 0x44, //  80- 87
+	0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //  88- 95
+	0x58, 0xE4, 0x54, 0x46, 0xE6, 0x00, 0x4A, 0x52, //  96-103
+	0x4B, 0x50, 0x4F, 0x4D, 0x51, 0x4E, 0x49, 0x4C, // 104-111
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, // 112-119
+	0x00, 0x00, 0x00, 0x00, 0x00, 0xE3, 0xE7, 0x65 }; // 120-127
+
 #define GPIO_BASE              0x200000
 #define BLOCK_SIZE             (4*1024)
 #define GPPUD                  (0x94 / 4)
 #define GPPUDCLK0              (0x98 / 4)
+#define GPPUDCLK1              (0x9C / 4)
 #define PULLUPDN_OFFSET_2711_0 57
 #define PULLUPDN_OFFSET_2711_1 58
 #define PULLUPDN_OFFSET_2711_2 59
 #define PULLUPDN_OFFSET_2711_3 60
+#define GPLEV0                 (0x34 / 4)
+#define GPLEV1                 (0x38 / 4)
 
+// Pi 5: header GPIO is bank 0 of the RP1 I/O controller, behind PCIe.
+// /dev/gpiomem0 maps its IO_BANK0, SYS_RIO0 and PADS_BANK0 blocks, 64K
+// apart; through /dev/mem the same span is at RP1_GPIO_BASE.
+#define RP1_GPIO_BASE          0x1F000D0000LL
+#define RP1_MAP_SIZE           0x30000
+#define RP1_N_GPIO             28                    // Bank 0: GPIO 0-27
+#define RP1_RIO_IN             ((0x10000 + 0x0C) / 4) // RIO_SYNC_IN levels
+#define RP1_PADS               (0x20000 / 4)         // Then 1 per GPIO
+#define RP1_PAD_PUE            0x08                  // Pull-up enable
+#define RP1_PAD_PDE            0x04                  // Pull-down enable
+
+// MCP23017 registers (bank 0: port A, then B at the next address)
 #define IODIRA                 0x00
+#define IPOLA                  0x02
+#define GPINTENA               0x04
+#define INTCONA                0x08
 #define IOCONA                 0x0A
+#define GPPUA                  0x0C
+#define GPIOA                  0x12
+#define OLATA                  0x14
+
+// PCA9555/TCA9555 registers (port 0, then 1 at the next address)
+#define PCA_INPUT              0x00
+#define PCA_OUTPUT             0x02
+#define PCA_POLARITY           0x04
+#define PCA_CONFIG             0x06
 
 #define GND                    KEY_CNT
 
+// Default FILTER parameters: min cutoff (Hz), beta (Hz per full-scale
+// per second), speed cutoff (Hz)
+#define FILTER_MINCUT          1.0
+#define FILTER_BETA            16.0
+#define FILTER_DCUT            5.0
+
 // Debug levels: 0 = off, 1 = config file errors, 2 = + config file status,
 // 3 = + report button states 'live'.
 
@@ -208,6 +658,44 @@ static bool earlyPiDetect(void) {
 	return isEarly;
 }
 
+// Is the GPIO controller the Pi 5's RP1?  Going by the SoC (BCM2712) in
+// the device tree; its GPIO is the RP1 southbridge's, not the SoC's.
+static bool rp1Detect(void) {
+	FILE  *fp;
+	char   buf[256];
+	size_t n, i;
+	bool   found = false;
+
+	// NUL-separated list, e.g. "raspberrypi,5-model-b\0brcm,bcm2712\0"
+	if((fp = fopen("/proc/device-tree/compatible", "r"))) {
+		n = fread(buf, 1, sizeof(buf) - 1, fp);
+		buf[n] = 0;
+		for(i=0; !found && (i<n); i += strlen(&buf[i]) + 1)
+			found = !strncmp(&buf[i], "brcm,bcm2712", 12);
+		fclose(fp);
+	}
+	return found;
+}
+
+// Map len bytes of GPIO registers at offset in file path (/dev/gpiomem0,
+// /dev/mem, or a plain file standing in for the register block).
+// Returns NULL on failure.
+static volatile unsigned int *gpioMap(const char *path, off_t offset,
+  size_t len) {
+	void *map;
+	int   fd;
+	if((fd = open(path, O_RDWR | O_SYNC)) < 0) return NULL;
+	map = mmap(             // Memory-mapped I/O
+	  NULL,                 // Any adddress will do
+	  len,                  // Mapped block length
+	  PROT_READ|PROT_WRITE, // Enable read+write
+	  MAP_SHARED,           // Shared with other processes
+	  fd,                   // File to map
+	  offset);
+	close(fd);              // Not needed after mmap()
+	return (map == MAP_FAILED) ? NULL : (volatile unsigned int *)map;
+}
+
 // Set one GPIO pin attribute through the Sysfs interface.
 static int pinSetup(int pin, char *attr, char *value) {
 	char filename[50];
@@ -219,13 +707,64 @@ static int pinSetup(int pin, char *attr, char *value) {
 	return (w != len); // 0 = success
 }
 
-// Configure GPIO internal pull up/down/none
-static void pull(int bitmask, int state) {
-	if(gpio[PULLUPDN_OFFSET_2711_3] != 0x6770696f) {
+// Pin number of native GPIO g.  Bank 0 (GPIO 0-31) keeps pins 0-31 as
+// always; bank 1 (GPIO 32-53, Compute Module) follows the evdev pins, so
+// the MCP23017/ADC/evdev numbering of existing configs is unchanged.
+static int gpioPin(int g) {
+	return (g < 32) ? g : GPIO_PIN1 + g - 32;
+}
+
+// Native GPIO number of pin, or -1 if not a native pin
+static int pinGpio(int pin) {
+	if(pin < 32) return pin;
+	if((pin >= GPIO_PIN1) && (pin < GPIO_PIN1 + N_GPIO - 32))
+		return pin - GPIO_PIN1 + 32;
+	return -1;
+}
+
+// Set or clear pin's state bit in intstate[]; returns true if it changed
+static bool pinSet(int pin, bool on) {
+	uint32_t was = intstate[pin / 32];
+	if(on) intstate[pin / 32] |=  (1U << (pin & 31));
+	else   intstate[pin / 32] &= ~(1U << (pin & 31));
+	return was != intstate[pin / 32];
+}
+
+// Native GPIOs (bit per GPIO number) wanting pull-ups: key inputs,
+// 'Vulcan nerve pinch' and RUN inputs, and MCP23017 IRQ lines
+static uint64_t gpioInputs(void) {
+	uint64_t mask = mcpMask;
+	int      g, pin;
+	for(g=0; g<N_GPIO; g++) {
+		pin = gpioPin(g);
+		if(((key[pin] > KEY_RESERVED) && (key[pin] < GND)) ||
+		   ((vulcanMask[pin / 32] | runMask[pin / 32]) &
+		    (1U << (pin & 31))))
+			mask |= 1ULL << g;
+	}
+	return mask;
+}
+
+// Configure GPIO internal pull up/down/none; bitmask has a bit per GPIO
+// number (0-53), the upper word being bank 1 (GPPUDCLK1 or the 2711's
+// third and fourth pull registers)
+static void pull(uint64_t bitmask, int state) {
+	if(!gpio || !bitmask) return; // No native pins (or no /dev/mem)
+	if(rp1) {
+		// Pi 5: pull enables in each pad's control register (bank 0
+		// only; the other RP1 banks aren't on the header)
+		unsigned int pull = (state == 2) ? RP1_PAD_PUE :
+		                    (state == 1) ? RP1_PAD_PDE : 0;
+		for(int bit=0; bit<RP1_N_GPIO; bit++) {
+			if(!(bitmask & (1ULL << bit))) continue;
+			volatile unsigned int *pad = &gpio[RP1_PADS + 1 + bit];
+			*pad = (*pad & ~(RP1_PAD_PUE | RP1_PAD_PDE)) | pull;
+		}
+	} else if(gpio[PULLUPDN_OFFSET_2711_3] != 0x6770696f) {
 		// Pi 4 insights from RPi.GPIO:
 		unsigned int pull = state ? (3 - state) : state;
-		for(int bit=0; bit<32; bit++) {
-			if(!(bitmask & (1UL << bit))) continue;
+		for(int bit=0; bit<N_GPIO; bit++) {
+			if(!(bitmask & (1ULL << bit))) continue;
 			int pullreg = PULLUPDN_OFFSET_2711_0 + (bit >> 4);
 			int pullshift = (bit & 0xF) << 1;
 			unsigned int pullbits;
@@ -239,11 +778,571 @@ static void pull(int bitmask, int state) {
 		volatile unsigned char shortWait;
 		gpio[GPPUD]     = state;         // 2=up, 1=down, 0=none
 		for(shortWait=150;--shortWait;); // Min 150 cycle wait
-		gpio[GPPUDCLK0] = bitmask;       // Set pullup mask
+		gpio[GPPUDCLK0] = bitmask;       // Set pullup mask, bank 0
+		gpio[GPPUDCLK1] = bitmask >> 32; // ...and bank 1
 		for(shortWait=150;--shortWait;); // Wait again
 		gpio[GPPUD]     = 0;             // Reset pullup registers
 		gpio[GPPUDCLK0] = 0;
+		gpio[GPPUDCLK1] = 0;
+	}
+}
+
+// Levels of all native GPIOs at once (bit n set = GPIO n high), straight
+// from the level registers rather than a Sysfs read per pin.  Only pins
+// the controller has are valid (0-27 on RP1).  0 if GPIO isn't mapped.
+static uint64_t gpioLevels(void) {
+	if(!gpio) return 0;
+	if(rp1)   return gpio[RP1_RIO_IN] & ((1UL << RP1_N_GPIO) - 1);
+	return gpio[GPLEV0] | ((uint64_t)gpio[GPLEV1] << 32);
+}
+
+// IRQ affinity --------------------------------------------------------------
+
+// Read first line of a (sysfs/procfs) file into buf, newline stripped.
+// Returns false if unreadable.
+static bool readLine(char *path, char *buf, int len) {
+	FILE *fp;
+	bool  ok = false;
+	if((fp = fopen(path, "r"))) {
+		if(fgets(buf, len, fp)) {
+			buf[strcspn(buf, "\n")] = 0;
+			ok = true;
+		}
+		fclose(fp);
+	}
+	return ok;
+}
+
+// Write string to a (sysfs/procfs) file, returns true on success
+static bool writeLine(char *path, char *str) {
+	int  fd, len = strlen(str);
+	bool ok;
+	if((fd = open(path, O_WRONLY)) < 0) return false;
+	ok = (write(fd, str, len) == len);
+	close(fd);
+	return ok;
+}
+
+// Find the threaded handler (kernel thread 'irq/N-name') for an IRQ,
+// returns its pid or 0 if the IRQ isn't threaded.
+static pid_t irqThread(int irq) {
+	DIR           *dir;
+	struct dirent *d;
+	char           path[300], comm[32], prefix[16];
+	pid_t          pid = 0;
+	int            len = sprintf(prefix, "irq/%d-", irq);
+
+	if(!(dir = opendir("/proc"))) return 0;
+	while(!pid && (d = readdir(dir))) {
+		if(!isdigit(d->d_name[0])) continue;
+		sprintf(path, "/proc/%s/comm", d->d_name);
+		if(readLine(path, comm, sizeof(comm)) &&
+		   !strncmp(comm, prefix, len)) pid = atoi(d->d_name);
+	}
+	closedir(dir);
+	return pid;
+}
+
+// AFFINITY command: locate the IRQs behind native GPIO pins in use (per-
+// pin IRQs of the pinctrl-bcm* GPIO chip, and its bank IRQs) via sysfs,
+// and report them.  If this process is pinned to a single core, move
+// each IRQ there (bank IRQs; per-pin IRQs usually follow their bank and
+// refuse) and, if this process is real-time, give any irq threads the
+// same policy, priority and core.  Prior settings are kept in irqs[].
+static void irqAffinity(void) {
+	DIR               *dir;
+	struct dirent     *d;
+	struct sched_param sp;
+	cpu_set_t          set;
+	char               path[300], chip[64], actions[128], hw[16],
+	                   what[16], cpuStr[8];
+	int                irq, pin, core = -1, policy;
+	pid_t              pid;
+
+	if(!(sched_getaffinity(0, sizeof(set), &set)) &&
+	   (CPU_COUNT(&set) == 1)) {
+		for(core=0; !CPU_ISSET(core, &set); core++);
+	} else {
+		printf("%s: not pinned to one core; IRQs reported, not "
+		  "moved\n", __progname);
+	}
+	policy = sched_getscheduler(0);
+	sched_getparam(0, &sp);
+	sprintf(cpuStr, "%d", core);
+
+	if(!(dir = opendir("/sys/kernel/irq"))) return;
+	while((d = readdir(dir)) && (nIrqs < MAX_IRQS)) {
+		if(!isdigit(d->d_name[0])) continue;
+		irq = atoi(d->d_name);
+		sprintf(path, "/sys/kernel/irq/%d/chip_name", irq);
+		if(!readLine(path, chip, sizeof(chip))) continue;
+		sprintf(path, "/sys/kernel/irq/%d/hwirq", irq);
+		if(!readLine(path, hw, sizeof(hw))) continue;
+		sprintf(path, "/sys/kernel/irq/%d/actions", irq);
+		if(!readLine(path, actions, sizeof(actions))) actions[0] = 0;
+		pin = atoi(hw);
+		if(!strncmp(chip, "pinctrl-bcm", 11) && (pin < N_GPIO) &&
+		   (p[pin].fd >= 0)) {
+			sprintf(what, "GPIO%02d", pin);
+		} else if(strstr(actions, "pinctrl-bcm")) {
+			strcpy(what, "GPIO bank");
+		} else {
+			continue;
+		}
+
+		irqSave *s = &irqs[nIrqs++];
+		memset(s, 0, sizeof(*s));
+		s->irq = irq;
+		sprintf(path, "/proc/irq/%d/smp_affinity_list", irq);
+		readLine(path, s->mask, sizeof(s->mask));
+		printf("%s: IRQ %d (%s) on CPU %s", __progname, irq, what,
+		  s->mask);
+		if(core >= 0) {
+			if(strcmp(s->mask, cpuStr) && writeLine(path, cpuStr)) {
+				printf(", moved to CPU %d", core);
+			} else {
+				s->mask[0] = 0; // Nothing to restore
+			}
+		}
+		putchar('\n');
+
+		if((core >= 0) && (policy != SCHED_OTHER) &&
+		   (pid = irqThread(irq))) {
+			struct sched_param tp;
+			s->policy = sched_getscheduler(pid);
+			sched_getparam(pid, &tp);
+			s->prio   = tp.sched_priority;
+			if(!sched_setscheduler(pid, policy, &sp)) {
+				s->thread = pid;
+				sched_setaffinity(pid, sizeof(set), &set);
+				printf("%s: IRQ %d thread %d priority %d -> %d, "
+				  "CPU %d\n", __progname, irq, pid, s->prio,
+				  sp.sched_priority, core);
+			}
+		}
+	}
+	closedir(dir);
+}
+
+// Undo irqAffinity() changes (config unload)
+static void irqRestore(void) {
+	char               path[64];
+	struct sched_param sp;
+	for(int i=0; i<nIrqs; i++) {
+		if(irqs[i].mask[0]) {
+			sprintf(path, "/proc/irq/%d/smp_affinity_list",
+			  irqs[i].irq);
+			writeLine(path, irqs[i].mask);
+		}
+		if(irqs[i].thread) {
+			sp.sched_priority = irqs[i].prio;
+			sched_setscheduler(irqs[i].thread, irqs[i].policy, &sp);
+		}
+	}
+	nIrqs = 0;
+}
+
+// Port expanders ----------------------------------------------------------
+
+// Up to 8 I2C GPIO expanders (one per address slot, pins 32 + slot * 16),
+// of any mix of the types in expander[] below.  Each driver has its setup
+// and teardown, and the read that services its interrupt line, the least
+// bus traffic the chip allows: one combined transaction (register pointer,
+// repeated start, port data) for the 16-bit chips, a single byte with no
+// pointer at all for the PCF8574.  Everything goes through SMBus ioctls
+// rather than plain read()/write(), so that is exactly what's on the bus,
+// and so the i2c-stub module can stand in for real chips in testing, e.g.
+//   modprobe i2c-stub chip_addr=0x20
+//   i2cset -y N 0x20 0x12 0xfe  # MCP23017 GPIOA: pin 32 'pressed'
+
+// SMBus transfer on expander descriptor; returns ioctl() result
+static int smbus(int fd, char rw, uint8_t cmd, int size,
+  union i2c_smbus_data *data) {
+	struct i2c_smbus_ioctl_data x = { rw, cmd, size, data };
+	return ioctl(fd, I2C_SMBUS, &x);
+}
+
+static int regWrite8(int fd, uint8_t reg, uint8_t value) {
+	union i2c_smbus_data d;
+	d.byte = value;
+	return smbus(fd, I2C_SMBUS_WRITE, reg, I2C_SMBUS_BYTE_DATA, &d);
+}
+
+// Read register pair reg, reg+1 (port A/0 low byte); -1 on error
+static int regRead16(int fd, uint8_t reg) {
+	union i2c_smbus_data d;
+	d.block[0] = 2;
+	if(smbus(fd, I2C_SMBUS_READ, reg, I2C_SMBUS_I2C_BLOCK_DATA, &d) < 0)
+		return -1;
+	return d.block[1] | (d.block[2] << 8);
+}
+
+// Read-modify-write register pair: set bits, then clear bits
+static void regMod16(int fd, uint8_t reg, uint16_t set, uint16_t clear) {
+	union i2c_smbus_data d;
+	int                  v;
+	if((v = regRead16(fd, reg)) < 0) return;
+	v          = (v | set) & ~clear;
+	d.block[0] = 2;
+	d.block[1] = v;
+	d.block[2] = v >> 8;
+	(void)smbus(fd, I2C_SMBUS_WRITE, reg, I2C_SMBUS_I2C_BLOCK_DATA, &d);
+}
+
+// MCP23017: GPIOA,B read; reading GPIO also clears the interrupt
+static int mcpRead(int fd) {
+	return regRead16(fd, GPIOA);
+}
+
+// Configure chip as we need it (bank 0, mirrored open-drain INT, inputs
+// pulled up and interrupting on change, GNDs driven low).  Other pins are
+// left as found, but any other application also using the chip might be
+// clobbered if it uses a different IOCON config.
+static int mcpInit(int fd, uint16_t inputs, uint16_t gnds) {
+	regWrite8(fd, 0x05, 0x00);   // If bank 1 (IOCON there), switch to 0
+	regWrite8(fd, IOCONA, 0x44); // Bank 0, INTB=A, seq, OD IRQ
+	regMod16(fd, IODIRA, inputs, gnds);
+	regMod16(fd, IPOLA, 0, inputs | gnds); // Polarity matches input logic
+	regMod16(fd, GPINTENA, inputs, 0);
+	regMod16(fd, INTCONA, 0, 0xFFFF);      // Compare to prev pin value
+	regMod16(fd, GPPUA, inputs, 0);
+	regMod16(fd, OLATA, 0, gnds);
+	return mcpRead(fd);
+}
+
+static void mcpExit(int fd, uint16_t gnds) {
+	regMod16(fd, IODIRA, gnds, 0);
+}
+
+// PCA9555/TCA9555: input port 0,1 read, which clears the interrupt.  No
+// interrupt mask or pullup registers; every input interrupts on change
+// and all have fixed internal pullups.
+static int pcaRead(int fd) {
+	return regRead16(fd, PCA_INPUT);
+}
+
+static int pcaInit(int fd, uint16_t inputs, uint16_t gnds) {
+	regMod16(fd, PCA_OUTPUT, 0, gnds);
+	regMod16(fd, PCA_POLARITY, 0, inputs | gnds);
+	regMod16(fd, PCA_CONFIG, inputs, gnds);
+	return pcaRead(fd);
+}
+
+static void pcaExit(int fd, uint16_t gnds) {
+	regMod16(fd, PCA_CONFIG, gnds, 0);
+}
+
+// PCF8574(A): no registers, one byte each way.  A pin written high is an
+// input (weak pullup), written low is driven low; reading returns all pin
+// levels and clears the interrupt.
+static int pcfRead(int fd) {
+	union i2c_smbus_data d;
+	if(smbus(fd, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &d) < 0) return -1;
+	return d.byte | 0xFF00;
+}
+
+// Non-GND pins are all left as inputs (the power-on state), so the input
+// mask the other chips need for their pullups goes unused
+static int pcfInit(int fd, uint16_t inputs, uint16_t gnds) {
+	(void)inputs;
+	(void)smbus(fd, I2C_SMBUS_WRITE, ~gnds & 0xFF, I2C_SMBUS_BYTE, NULL);
+	return pcfRead(fd);
+}
+
+// All pins back to inputs, GND pins included; no per-pin state to restore
+static void pcfExit(int fd, uint16_t gnds) {
+	(void)gnds;
+	(void)smbus(fd, I2C_SMBUS_WRITE, 0xFF, I2C_SMBUS_BYTE, NULL);
+}
+
+// First entry is the default when the IRQ command doesn't name a chip
+static const expDriver expander[] = {
+	{ "MCP23017", 0x20, 16, mcpInit, mcpExit, mcpRead },
+	{ "PCA9555" , 0x20, 16, pcaInit, pcaExit, pcaRead },
+	{ "TCA9555" , 0x20, 16, pcaInit, pcaExit, pcaRead },
+	{ "PCF8574" , 0x20,  8, pcfInit, pcfExit, pcfRead },
+	{ "PCF8574A", 0x38,  8, pcfInit, pcfExit, pcfRead } };
+#define N_EXPANDERS (int)(sizeof(expander) / sizeof(expander[0]))
+
+// Store expander slot's pin levels in intstate[].  Buttons pull pins low,
+// so invert: set bits in intstate[] are buttons pressed.
+static void expState(int slot, uint16_t levels) {
+	uint32_t merged = (uint16_t)~levels;
+	uint8_t  i      = 1 + slot / 2; // Index of 32-bit state
+	if(slot & 1) { // Upper half of state
+		intstate[i] = (intstate[i] & 0x0000FFFF) | (merged << 16);
+	} else {       // Lower half of state
+		intstate[i] = (intstate[i] & 0xFFFF0000) | merged;
+	}
+}
+
+// Alternatively (GPIOCHIP command) an expander can be left to its kernel
+// driver -- pinctrl-mcp23s08, gpio-pca953x or gpio-pcf857x, bound by a
+// device tree overlay that gives it an interrupt line -- with retrogame
+// taking its pins' edges from the GPIO character device (see chipOpen()).
+// Is pin on such an expander?
+static bool chipPin(int pin) {
+	return (pin >= 32) && (pin < ADC_PIN0) &&
+	  (chipMask & (1 << ((pin - 32) / 16)));
+}
+
+// USB HID gadget setup ------------------------------------------------------
+
+// Write data to an attribute (path relative to HID_GADGET) of the configfs
+// gadget.  Returns true on success.
+static bool gadgetAttr(char *attr, void *data, int len) {
+	char path[200];
+	int  fd;
+	bool ok;
+	sprintf(path, "%s/%s", HID_GADGET, attr);
+	if((fd = open(path, O_WRONLY)) < 0) return false;
+	ok = (write(fd, data, len) == len);
+	close(fd);
+	return ok;
+}
+
+// Unbind and dismantle the configfs gadget, if present (configfs
+// directories must be removed innermost first)
+static void hidGadgetRemove(void) {
+	struct stat st;
+	if(stat(HID_GADGET, &st)) return;
+	gadgetAttr("UDC", "\n", 1);
+	unlink(HID_GADGET "/configs/c.1/hid.usb0");
+	rmdir(HID_GADGET "/configs/c.1/strings/0x409");
+	rmdir(HID_GADGET "/configs/c.1");
+	rmdir(HID_GADGET "/functions/hid.usb0");
+	rmdir(HID_GADGET "/strings/0x409");
+	rmdir(HID_GADGET);
+}
+
+// Create a single-function HID gadget through configfs (libcomposite
+// module) with the given report descriptor, and bind it to the USB
+// device controller (hidUdc[], or the first in /sys/class/udc).
+// Returns true on success; on failure, anything created is removed.
+static bool hidGadgetCreate(uint8_t *desc, int descLen, int reportLen) {
+	static const char *dirs[] = { "", "/strings/0x409", "/configs/c.1",
+	  "/configs/c.1/strings/0x409", "/functions/hid.usb0", NULL };
+	static const char *attrs[][2] = {
+		{ "idVendor"                              , "0x1d6b"    },
+		{ "idProduct"                             , "0x0104"    },
+		{ "bcdDevice"                             , "0x0100"    },
+		{ "bcdUSB"                                , "0x0200"    },
+		{ "strings/0x409/manufacturer"            , "Adafruit"  },
+		{ "strings/0x409/product"                 , "retrogame" },
+		{ "configs/c.1/strings/0x409/configuration", "retrogame" },
+		{ "configs/c.1/MaxPower"                  , "100"       },
+		{ "functions/hid.usb0/protocol"           , "0"         },
+		{ "functions/hid.usb0/subclass"           , "0"         },
+		{ NULL                                    , NULL        } };
+	DIR           *dir;
+	struct dirent *d;
+	char           path[200], udc[256], str[16];
+	int            i;
+
+	hidGadgetRemove(); // Leftover from an earlier run?
+	for(i=0; dirs[i]; i++) {
+		sprintf(path, "%s%s", HID_GADGET, dirs[i]);
+		if(mkdir(path, 0755) && (errno != EEXIST)) return false;
+	}
+	for(i=0; attrs[i][0]; i++) {
+		if(!gadgetAttr((char *)attrs[i][0], (char *)attrs[i][1],
+		  strlen(attrs[i][1]))) goto fail;
+	}
+	sprintf(str, "%d", reportLen);
+	if(!gadgetAttr("functions/hid.usb0/report_length", str, strlen(str)) ||
+	   !gadgetAttr("functions/hid.usb0/report_desc", desc, descLen) ||
+	   symlink(HID_GADGET "/functions/hid.usb0",
+	     HID_GADGET "/configs/c.1/hid.usb0")) goto fail;
+
+	strcpy(udc, hidUdc);
+	if(!udc[0] && (dir = opendir("/sys/class/udc"))) {
+		while((d = readdir(dir))) {
+			if(d->d_name[0] == '.') continue;
+			snprintf(udc, sizeof(udc), "%s", d->d_name);
+			break;
+		}
+		closedir(dir);
+	}
+	if(udc[0] && gadgetAttr("UDC", udc, strlen(udc))) {
+		if(debug >= 2) printf("%s: HID gadget bound to %s\n",
+		  __progname, udc);
+		return true;
+	}
+
+  fail:
+	hidGadgetRemove();
+	return false;
+}
+
+// Close HID output and remove the gadget (config unload)
+static void hidClose(void) {
+	if(hidFd >= 0) {
+		close(hidFd);
+		hidFd = -1;
+		hidGadgetRemove();
+	}
+	if(p[PFD_HID].fd >= 0) {
+		close(p[PFD_HID].fd);
+		p[PFD_HID].fd = -1;
+	}
+	p[PFD_HID].events = p[PFD_HID].revents = 0;
+	hidOn     = false;
+	hidUdc[0] = 0;
+}
+
+// Switch health -----------------------------------------------------------
+
+// With the HEALTH command, each debounced press of a native or expander
+// pin updates that pin's record in a memory-mapped file: a few counters,
+// one histogram bin and two running averages, so O(1) per press and
+// nothing at all per edge beyond the count kept above.  The file keeps
+// accumulating across restarts; 'retrogame --health' reports from it.
+
+// Map healthPath, starting afresh if it's new or of another layout
+static void healthOpen(void) {
+	struct stat st;
+	bool        fresh;
+	int         fd, i, slot;
+
+	if((fd = open(healthPath, O_RDWR | O_CREAT, 0644)) < 0) {
+		if(debug >= 1) printf("%s: can't open health file '%s' (not "
+		  "fatal, continuing)\n", __progname, healthPath);
+		return;
+	}
+	fresh = fstat(fd, &st) || (st.st_size != sizeof(healthFile));
+	if((fresh && ftruncate(fd, 0)) ||
+	   ftruncate(fd, sizeof(healthFile)) ||
+	   ((health = mmap(NULL, sizeof(healthFile), PROT_READ | PROT_WRITE,
+	   MAP_SHARED, fd, 0)) == MAP_FAILED)) {
+		if(debug >= 1) printf("%s: can't map health file '%s' (not "
+		  "fatal, continuing)\n", __progname, healthPath);
+		health = NULL;
+	} else if(fresh || (health->magic != HEALTH_MAGIC) ||
+	  (health->nPins != N_PINS)) {
+		memset(health, 0, sizeof(healthFile));
+		health->magic = HEALTH_MAGIC;
+		health->nPins = N_PINS;
+	}
+	if(health) {
+		health->debounce = debounceTime;
+		// Expander slots in use label their pins in the report (other
+		// slots keep labels from earlier configs, as do their counts)
+		for(i=0; i<N_GPIO; i++) {
+			if(!mcpI2C[i]) continue;
+			slot = mcpI2C[i] & 7;
+			health->expAddr[slot] = mcpI2C[i];
+			health->expBits[slot] = expander[mcpChip[slot]].bits;
+			snprintf(health->expName[slot], sizeof(health->expName[0]),
+			  "%.3s", expander[mcpChip[slot]].name);
+		}
+		for(slot=0; slot<8; slot++) {
+			if(!(chipMask & (1 << slot))) continue;
+			health->expAddr[slot] = chipAddr[slot];
+			health->expBits[slot] = 0;
+			strcpy(health->expName[slot], "CHP"); // GPIOCHIP
+		}
+	}
+	close(fd);
+}
+
+static void healthClose(void) {
+	if(health) {
+		munmap(health, sizeof(healthFile));
+		health = NULL;
+	}
+}
+
+// Record a debounced press of pin (edges and times from edgeMark())
+static void healthNote(int pin) {
+	pinHealth *h  = &health->pin[pin];
+	int64_t    d  = edgeLast[pin] - edgeTime[pin];
+	uint32_t   us = (d < 0) ? 0 : (d > 1000000) ? 1000000 : d;
+	int        b  = us ? 32 - __builtin_clz(us) : 0;
+
+	h->presses++;
+	h->edges += edgeCount[pin];
+	if(edgeCount[pin] > 1) h->bounced++;
+	h->hist[(b < HEALTH_BINS) ? b : HEALTH_BINS - 1]++;
+	if(us > h->maxUs) h->maxUs = us;
+	if(h->presses <= HEALTH_BASE) // Running mean, then frozen
+		h->base += ((int32_t)us - (int32_t)h->base) / (int32_t)h->presses;
+	if(h->presses == 1) h->recent = us << 4;
+	else h->recent += ((int32_t)(us << 4) - (int32_t)h->recent) / 32;
+}
+
+// Bounce (usec) at or below which fraction q of a pin's presses fall,
+// to the resolution of the histogram (upper edge of the bin, or the
+// longest seen if less)
+static uint32_t healthPercentile(pinHealth *h, double q) {
+	uint32_t n = 0;
+	int      b;
+	for(b=0; b<HEALTH_BINS-1; b++) {
+		n += h->hist[b];
+		if(n >= q * h->presses) break;
+	}
+	n = b ? (1 << b) - 1 : 0;
+	return (n < h->maxUs) ? n : h->maxUs;
+}
+
+// 'retrogame --health [file]': print the switch stats in file and flag
+// switches needing attention: WORN if recent bounce has more than doubled
+// against the switch's own baseline (and exceeds 1 ms), LIMIT if 1 in 100
+// presses bounces for half the debounce time or more (double presses
+// likely soon).  Returns 0 if all OK, 2 if any flagged, 1 on error.
+static int healthReport(char *path) {
+	static healthFile f;
+	pinHealth        *h;
+	char              name[24];
+	int               fd, i, slot, status = 0;
+	uint32_t          p99, rec;
+
+	if(((fd = open(path, O_RDONLY)) < 0) ||
+	   (read(fd, &f, sizeof(f)) != sizeof(f)) ||
+	   (f.magic != HEALTH_MAGIC) || (f.nPins != N_PINS)) {
+		fprintf(stderr, "%s: no switch stats in '%s'\n", __progname,
+		  path);
+		return 1;
+	}
+	close(fd);
+	printf("pin      presses bounced edges/press  p50 ms  p95 ms  p99 ms"
+	  "  max ms base ms  now ms\n");
+	for(i=0; i<N_PINS; i++) {
+		h = &f.pin[i];
+		if(!h->presses) continue;
+		slot = (i - 32) / 16 & 7; // Expander pins 32-159
+		if(pinGpio(i) >= 0) {
+			sprintf(name, "GPIO%d", pinGpio(i));
+		} else if(!f.expAddr[slot]) { // Not seen in any config
+			sprintf(name, "EXP%02X:%d", 0x20 + slot, (i - 32) & 15);
+		} else if(f.expBits[slot] == 16) { // Two 8-bit ports
+			sprintf(name, "%s%02X:%c%d", f.expName[slot],
+			  f.expAddr[slot], ((i - 32) & 8) ? 'B' : 'A',
+			  (i - 32) & 7);
+		} else { // One port, or kernel gpiochip line number
+			sprintf(name, "%s%02X:%d", f.expName[slot],
+			  f.expAddr[slot], (i - 32) & 15);
+		}
+		p99 = healthPercentile(h, 0.99);
+		rec = h->recent >> 4;
+		printf("%-8s %7u %6.1f%% %11.2f %7.2f %7.2f %7.2f %7.2f %7.2f "
+		  "%7.2f", name, h->presses, h->bounced * 100.0 / h->presses,
+		  (double)h->edges / h->presses,
+		  healthPercentile(h, 0.50) / 1000.0,
+		  healthPercentile(h, 0.95) / 1000.0, p99 / 1000.0,
+		  h->maxUs / 1000.0, h->base / 1000.0, rec / 1000.0);
+		if(h->presses < 50) {
+			printf("  (too few presses)\n");
+		} else if(p99 * 2 >= f.debounce * 1000) {
+			printf("  LIMIT\n");
+			status = 2;
+		} else if((rec > 2 * h->base) && (rec > 1000)) {
+			printf("  WORN\n");
+			status = 2;
+		} else {
+			printf("  ok\n");
+		}
 	}
+	return status;
 }
 
 // Restore GPIO and uinput to startup state; un-export any Sysfs pins used,
@@ -251,13 +1350,26 @@ static void pull(int bitmask, int state) {
 // disable previously-set pull-ups.  Write errors are ignored as pins may be
 // in a partially-initialized state.
 static void pinConfigUnload() {
-	char buf[50];
+	char buf[100];
 	int  fd, i;
 
 	if(debug >= 2) printf("%s: Unloading config\n", __progname);
 
+	irqRestore();
+	irqTune = false;
+	healthClose();
+
+	// Stop watching /dev; anything still awaited is moot
+	if(p[PFD_DEV].fd >= 0) {
+		close(p[PFD_DEV].fd);
+		p[PFD_DEV].fd = -1;
+	}
+	p[PFD_DEV].events = p[PFD_DEV].revents = 0;
+	devWait = 0;
+	healthPath[0] = 0;
+
 	// Close GPIO file descriptors
-	for(i=0; i<32; i++) {
+	for(i=0; i<N_GPIO; i++) {
 		if(p[i].fd >= 0) {
 			close(p[i].fd);
 			p[i].fd = -1;
@@ -265,8 +1377,12 @@ static void pinConfigUnload() {
 		p[i].events = p[i].revents = 0;
 	}
 
-	// Close uinput file descriptors
-	keyfd = -1;
+	// Close uinput file descriptors; anything still queued is moot
+	keyfd   = -1;
+	outTail = outHead;
+	outPart = 0;
+	p[PFD_OUT].fd     = -1;
+	p[PFD_OUT].events = p[PFD_OUT].revents = 0;
 	if(keyfd2 >= 0) {
 		close(keyfd2);
 		keyfd2 = -1;
@@ -276,13 +1392,50 @@ static void pinConfigUnload() {
 		close(keyfd1);
 		keyfd1 = -1;
 	}
+	hidClose();
+
+	// Close ADC device and its scan timer
+	if(adcFd >= 0) {
+		close(adcFd);
+		adcFd = -1;
+	}
+	if(p[PFD_ADC].fd >= 0) {
+		close(p[PFD_ADC].fd);
+		p[PFD_ADC].fd = -1;
+	}
+	p[PFD_ADC].events = p[PFD_ADC].revents = 0;
+
+	// Close (and so release grab on) evdev input sources
+	for(i=PFD_EVDEV; i<PFD_EVDEV+N_EVDEV; i++) {
+		if(p[i].fd >= 0) {
+			close(p[i].fd);
+			p[i].fd = -1;
+		}
+		p[i].events = p[i].revents = 0;
+	}
+
+	// Release lines of kernel-driven expanders, GNDs back to inputs
+	for(i=PFD_CHIP; i<PFD_CHIP+8; i++) {
+		if(p[i].fd >= 0) {
+			struct gpio_v2_line_config c;
+			memset(&c, 0, sizeof(c));
+			c.flags = GPIO_V2_LINE_FLAG_INPUT;
+			(void)ioctl(p[i].fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &c);
+			close(p[i].fd);
+			p[i].fd = -1;
+		}
+		p[i].events = p[i].revents = 0;
+	}
 
-	// Un-export GPIO pins (0-31)
+	// Un-export GPIO pins (0-31, and any of 32-53 in use)
+	uint64_t mask = gpioInputs();
 	sprintf(buf, "%s/unexport", sysfs_root);
 	if((fd = open(buf, O_WRONLY)) >= 0) {
-		for(i=0; i<32; i++) {
+		for(i=0; i<N_GPIO; i++) {
+			if((i >= 32) && (key[gpioPin(i)] == KEY_RESERVED) &&
+			   !(mask & (1ULL << i))) continue;
 			// Restore GND items to inputs
-			if(key[i] >= GND) pinSetup(i, "direction", "in");
+			if(key[gpioPin(i)] >= GND) pinSetup(i, "direction", "in");
 			// And un-export all items regardless
 			sprintf(buf, "%d", i);
 			write(fd, buf, strlen(buf));
@@ -290,15 +1443,9 @@ static void pinConfigUnload() {
 		close(fd);
 	}
 
-	// Disable GPIO pullups (0-31)
-	uint32_t mask = vulcanMask[0] | mcpMask;
-	for(i=0; i<32; i++) {
-		if((key[i] > KEY_RESERVED) && (key[i] < GND))
-			mask |= (1 << i);
-	}
-	pull(mask, 0); // Disable pullups
+	pull(mask, 0); // Disable GPIO pullups
 
-	// Do some GPIO dis-configuration for any MCO23017(s).
+	// Do some GPIO dis-configuration for any port expander(s).
 	// GNDs are set back to inputs; other config (pullups, etc.)
 	// are currently left in whatever state.
 	for(i=0; i<8; i++) {
@@ -306,33 +1453,41 @@ static void pinConfigUnload() {
 			// Determine which bits were previously set GND
 			uint8_t  j;
 			uint16_t gndMask = 0;
-			for(j=0; j<16; j++) { // 16 bits per MCP
+			for(j=0; j<16; j++) { // 16 bits per expander
 				if(key[32 + i * 16 + j] == GND)
 				  gndMask |= (1 << j);
 			}
-			// Read chip config
-			uint8_t cfg[3];
-			cfg[0] = IODIRA;
-			write(i2cfd[i], cfg, 1);
-			read(i2cfd[i], &cfg[1], sizeof(cfg) - 1);
-			// Change IODIRA,B GND bits back to inputs
-			cfg[1] = (cfg[1] |  gndMask      );
-			cfg[2] = (cfg[2] | (gndMask >> 8));
-			// Write to chip, close device
-			write(i2cfd[i], cfg, sizeof(cfg));
+			expander[mcpChip[i]].exit(i2cfd[i], gndMask);
 			close(i2cfd[i]);
 			i2cfd[i] = 0;
 		}
 	}
 
 	// Reset pin-and-key-related globals
-	for(i=0; i<161; i++) key[i] = KEY_RESERVED;
+	for(i=0; i<=N_PINS; i++) key[i] = KEY_RESERVED;
+	for(i=0; i<8; i++) adcAxis[i] = -1;
+	for(i=0; i<N_EVPINS; i++) evPin[i].src = -1;
 	memset(intstate  , 0, sizeof(intstate));
 	memset(extstate  , 0, sizeof(extstate));
 	memset(vulcanMask, 0, sizeof(vulcanMask));
 	memset(mcpI2C    , 0, sizeof(mcpI2C));
+	memset(mcpChip   , 0, sizeof(mcpChip));
+	memset(chipNode  , 0, sizeof(chipNode));
 	memset(i2cfd     , 0, sizeof(i2cfd));
+	memset(adcValue  , 0, sizeof(adcValue));
+	memset(adcFilter , 0, sizeof(adcFilter));
 	mcpMask = 0;
+	chipMask = 0;
+	adcBits = adcN = 0;
+	adcRate = 1000;
+	adcStub = false;
+	strcpy(adcPath, "/dev/spidev0.0");
+	nEvdev  = 0;
+	order   = ORDER_FRAME;
+	nSeq    = seqPos = 0; // Frames not yet output are moot
+	nRun    = runNext = 0; // Running commands are left to finish
+	memset(runMask   , 0, sizeof(runMask));
+	memset(edgeCount , 0, sizeof(edgeCount));
 }
 
 // Quick-n-dirty error reporter; print message, clean up and exit.
@@ -350,7 +1505,7 @@ static int filter1(const struct dirent *d) {
 		// Read contents of 'name' file inside this subdirectory,
 		// if it matches the retrogame executable, that's probably
 		// the device we want...
-		char  filename[100], line[100];
+		char  filename[300], line[100];
 		FILE *fp;
 		sprintf(filename, "/sys/devices/virtual/input/%s/name",
 		  d->d_name);
@@ -388,70 +1543,1310 @@ static int pinRemap(int i) {
 	return i;
 }
 
-// Config file handlage ----------------------------------------------------
+// Print a pin bitmask (most significant word first) for debug output
+static void printMask(uint32_t *mask) {
+	for(int i=N_WORDS-1; i>=0; i--) printf("%08X", mask[i]);
+	putchar('\n');
+}
 
-// Load pin/key configuration from cfgPathname.
-static void pinConfigLoad() {
+// Monotonic time in milliseconds; basis for main loop timeouts
+static int64_t msNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
 
-	// Config file format is super simple, just per-line keyword and
-	// argument(s) with whitespace delimiters...can parse it ourselves
-	// here.  Configuration libraries such as libconfig, libconfuse
-	// have some potent features but enforce a correspondingly more
-	// exacting syntax on the user; do not want if we can avoid it.
+// Monotonic time in microseconds
+static int64_t usNow(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
 
-	FILE            *fp;
-	char             buf[50];
-	enum commandNum  cmd = CMD_NONE;
-	int              stringLen      = 0,
-	                 wordCount      = 0,
-	                 keyCode        = KEY_RESERVED,
-	                 i, c, k, fd, bitmask, dLevel = -1,
-	                 mcpPin = -1, mcpAddr = -1;
-	bool             readingString  = false,
-	                 isComment      = false;
-	uint32_t         pinMask[5];
+// Count edge of pin at time t.  The first since the pin's last debounce
+// pass sets its edge time, so a bouncing press keeps its first edge; the
+// count and latest time are for switch health.
+static void edgeNote(int pin, int64_t t) {
+	if(!edgeCount[pin]++) edgeTime[pin] = t;
+	edgeLast[pin] = t;
+}
 
-	if(debug >= 2) printf("%s: Loading config\n", __progname);
+// Note time t for pin changes from prev[] to intstate[], except evdev
+// and GPIOCHIP pins (noted with their own event times as they're read)
+static void edgeMark(uint32_t *prev, int64_t t) {
+	uint32_t m;
+	int      a, pin;
+	for(a=0; a<N_WORDS; a++) {
+		m = prev[a] ^ intstate[a];
+		while(m) {
+			pin = a * 32 + __builtin_ctz(m);
+			m  &= m - 1;
+			if(((pin < EV_PIN0) || (pin >= EV_PIN0 + N_EVPINS)) &&
+			   !chipPin(pin)) edgeNote(pin, t);
+		}
+	}
+}
 
-	// Read config file into key[] table -------------------------------
+// USB HID gadget output ---------------------------------------------------
 
-	if(NULL == (fp = fopen(cfgPathname, "r"))) {
-		if(debug >= 1) printf("%s: could not open config file '%s' "
-		  "(not fatal, continuing)\n", __progname, cfgPathname);
-		return; // Not fatal; file might be created later
+// With the HID command, events bound for keyfd instead update a held-
+// usage bitmap (hidDown[]): bits 0-255 are keyboard usages, 256 and up
+// gamepad buttons.  Each SYN sends whichever of the keyboard and gamepad
+// reports changed, no more than once per HID_INTERVAL.
+
+// Bit in hidDown[] for a key or button code, or -1 if none.  Gamepad
+// buttons (BTN_SOUTH...) become buttons 1-15, which a Linux host maps
+// back to the same codes; other BTN_* codes follow as buttons 16-63.
+static int hidBit(int code) {
+	if(code < (int)sizeof(hidUsage))
+		return hidUsage[code] ? hidUsage[code] : -1;
+	if((code >= BTN_GAMEPAD) && (code <= BTN_THUMBR))
+		return 256 + code - BTN_GAMEPAD;
+	if((code >= BTN_MISC) && (code < BTN_GAMEPAD))
+		return 256 + 15 + code - BTN_MISC;
+	return -1;
+}
+
+// Generate HID report descriptor from the key[] table and ADC axes into
+// d[], returning its length.  A keyboard collection (boot report layout)
+// if any key has a usage, a gamepad collection if any buttons or axes;
+// report IDs only if both.  Also sets the report lengths in hidLen[].
+static int hidDescribe(uint8_t *d) {
+	static const uint8_t kbd[] = {
+	  0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, // Modifiers, 8 x 1 bit
+	  0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+	  0x75, 0x08, 0x95, 0x01, 0x81, 0x01, // Reserved byte
+	  0x19, 0x00, 0x29, 0x65, 0x15, 0x00, // Key array, 6 x 8 bits
+	  0x25, 0x65, 0x75, 0x08, 0x95, 0x06, 0x81, 0x00 };
+	int i, bit, n = 0, max = (1 << adcBits) - 1;
+
+	hidKbd  = false;
+	hidBtns = nHidAxes = 0;
+	for(i=0; i<=N_PINS; i++) {
+		if((key[i] <= KEY_RESERVED) || (key[i] >= GND)) continue;
+		if((bit = hidBit(key[i])) < 0) {
+			if(debug >= 1) printf("%s: key code %d has no HID "
+			  "usage (not fatal, continuing)\n", __progname,
+			  key[i]);
+		} else if(bit < 256) {
+			hidKbd = true;
+		} else if(bit - 255 > hidBtns) {
+			hidBtns = bit - 255;
+		}
 	}
+	for(i=0; (adcFd >= 0) && (i<8); i++) {
+		if(adcAxis[i] < 0) continue;
+		if(adcAxis[i] > ABS_WHEEL) { // X-WHEEL are usages 0x30-0x38
+			if(debug >= 1) printf("%s: axis code %d has no HID "
+			  "usage (not fatal, continuing)\n", __progname,
+			  adcAxis[i]);
+		} else {
+			hidAxisCode[nHidAxes++] = adcAxis[i];
+		}
+	}
+	hidIds    = hidKbd && (hidBtns || nHidAxes);
+	hidLen[0] = hidKbd ? hidIds + 8 : 0;
+	hidLen[1] = (hidBtns || nHidAxes) ?
+	  hidIds + (hidBtns + 7) / 8 + nHidAxes * 2 : 0;
 
-	do { // Deep nesting, please excuse shift to two-space indents...
-	  c = getc(fp);
-	  if(isspace(c) || (c <= 0)) { // If whitespace char...
-	    if(readingString && !isComment) {
-	      // Switching from string-reading to whitespace-skipping.
-	      // Cap off & process current string, reset readingString flag.
-	      buf[stringLen] = 0;
-	      if(wordCount == 1) {
-	        // First word on line.  Search key dict, then command dict
-	        memset(pinMask, 0, sizeof(pinMask));
-	        keyCode = KEY_RESERVED;
-	        if((k = dictSearch(buf, keyTable)) >= 0) {
-	          // Start of key command
-	          cmd     = CMD_KEY;
-	          keyCode = k;
-	        } else if((k = dictSearch(buf, command)) >= 0) {
-	          // Not a key, is other command (e.g. GND, DEBUG)
-	          cmd = k;
-	        } else if(debug >= 1) {
-	          printf("%s: unknown key or command '%s' (not fatal, "
-	            "continuing)\n", __progname, buf);
+	if(hidKbd) {
+		d[n++] = 0x05; d[n++] = 0x01; // Generic desktop page
+		d[n++] = 0x09; d[n++] = 0x06; // Keyboard
+		d[n++] = 0xA1; d[n++] = 0x01; // Application collection
+		if(hidIds) { d[n++] = 0x85; d[n++] = 1; } // Report ID
+		memcpy(&d[n], kbd, sizeof(kbd));
+		n += sizeof(kbd);
+		d[n++] = 0xC0;                // End collection
+	}
+	if(hidLen[1]) {
+		d[n++] = 0x05; d[n++] = 0x01; // Generic desktop page
+		d[n++] = 0x09; d[n++] = 0x05; // Gamepad
+		d[n++] = 0xA1; d[n++] = 0x01; // Application collection
+		if(hidIds) { d[n++] = 0x85; d[n++] = 2; } // Report ID
+		if(hidBtns) {
+			d[n++] = 0x05; d[n++] = 0x09;    // Button page
+			d[n++] = 0x19; d[n++] = 0x01;    // Buttons 1...
+			d[n++] = 0x29; d[n++] = hidBtns; // ...to hidBtns
+			d[n++] = 0x15; d[n++] = 0x00;    // 0 to 1,
+			d[n++] = 0x25; d[n++] = 0x01;
+			d[n++] = 0x75; d[n++] = 0x01;    // 1 bit each
+			d[n++] = 0x95; d[n++] = hidBtns;
+			d[n++] = 0x81; d[n++] = 0x02;    // Input (var)
+			if(hidBtns & 7) {                // Pad to byte
+				d[n++] = 0x95; d[n++] = 8 - (hidBtns & 7);
+				d[n++] = 0x81; d[n++] = 0x03;
+			}
+		}
+		if(nHidAxes) {
+			d[n++] = 0x05; d[n++] = 0x01;    // Generic desktop
+			for(i=0; i<nHidAxes; i++) {
+				d[n++] = 0x09;
+				d[n++] = 0x30 + hidAxisCode[i];
+			}
+			d[n++] = 0x15; d[n++] = 0x00;    // 0 to ADC max
+			d[n++] = 0x26; d[n++] = max & 0xFF; d[n++] = max >> 8;
+			d[n++] = 0x75; d[n++] = 0x10;    // 16 bits each
+			d[n++] = 0x95; d[n++] = nHidAxes;
+			d[n++] = 0x81; d[n++] = 0x02;    // Input (var)
+		}
+		d[n++] = 0xC0;                   // End collection
+	}
+	return n;
+}
+
+// Build keyboard and gamepad reports in r[] from usage bitmap 'down'
+static void hidReport(uint8_t r[2][HID_REPORT], uint8_t *down) {
+	uint8_t *k = r[0], *g = r[1];
+	int      i, n;
+
+	memset(r, 0, 2 * HID_REPORT);
+	if(hidIds) {
+		*k++ = 1;
+		*g++ = 2;
+	}
+	k[0] = down[0xE0 / 8]; // Modifiers are usages E0-E7
+	for(i=1, n=0; i<=0x65; i++) {
+		if(!(down[i / 8] & (1 << (i & 7)))) continue;
+		if(n < 6) k[2 + n] = i;
+		n++;
+	}
+	if(n > 6) memset(&k[2], 0x01, 6); // Rollover error
+	memcpy(g, &down[256 / 8], (hidBtns + 7) / 8);
+	g += (hidBtns + 7) / 8;
+	for(i=0; i<nHidAxes; i++) {
+		*g++ = hidAxis[i] & 0xFF;
+		*g++ = hidAxis[i] >> 8;
+	}
+}
+
+// Arm HID interval timer for 'us' microseconds from now
+static void hidTimer(int64_t us) {
+	struct itimerspec t;
+	memset(&t, 0, sizeof(t));
+	t.it_value.tv_nsec = us * 1000;
+	timerfd_settime(p[PFD_HID].fd, 0, &t, NULL);
+}
+
+// Send changed report(s), unless within HID_INTERVAL of the last, in
+// which case the timer resumes this later (coalescing everything in
+// between).  A press already released again is latched into this report
+// and its release follows an interval later.  If the host hasn't yet
+// collected the previous report (EAGAIN), resume on POLLOUT.  Other
+// errors (no host) leave hidSent[] as it was, so the next change resends.
+static void hidSend(void) {
+	uint8_t r[2][HID_REPORT], down[HID_BITS / 8];
+	int64_t now = usNow(), wait;
+	int     i;
+
+	if(!hidDirty) return;
+	if((wait = hidLast + HID_INTERVAL - now) > 0) {
+		hidTimer(wait);
+		return;
+	}
+	p[PFD_OUT].fd     = -1;
+	p[PFD_OUT].events = 0;
+	for(i=0; i<HID_BITS/8; i++) down[i] = hidDown[i] | hidLatch[i];
+	hidReport(r, down);
+	for(i=0; i<2; i++) {
+		if(!hidLen[i] || !memcmp(r[i], hidSent[i], hidLen[i])) continue;
+		if(write(hidFd, r[i], hidLen[i]) == hidLen[i]) {
+			memcpy(hidSent[i], r[i], hidLen[i]);
+			hidLast = now;
+			hidReports++;
+		} else if(errno == EAGAIN) {
+			hidRetries++;
+			p[PFD_OUT].fd     = hidFd;
+			p[PFD_OUT].events = POLLOUT;
+			return;
+		} else {
+			hidErrors++;
+		}
+	}
+	hidDirty = false;
+	for(i=0; i<HID_BITS/8; i++) {
+		if(hidLatch[i] & ~hidDown[i]) hidDirty = true;
+		hidLatch[i] = 0;
+	}
+	if(hidDirty) hidTimer(HID_INTERVAL);
+}
+
+// Apply one input event to the HID state; SYN sends.  Key repeats are
+// left to the host.
+static void hidEvent(int type, int code, int value) {
+	int bit, i;
+
+	if(type == EV_KEY) {
+		if((value == 2) || ((bit = hidBit(code)) < 0)) return;
+		if(value) {
+			hidDown[bit / 8]  |=  (1 << (bit & 7));
+			hidLatch[bit / 8] |=  (1 << (bit & 7));
+		} else {
+			hidDown[bit / 8]  &= ~(1 << (bit & 7));
+		}
+		hidDirty = true;
+	} else if(type == EV_ABS) {
+		for(i=0; i<nHidAxes; i++) {
+			if(hidAxisCode[i] != code) continue;
+			hidAxis[i] = value;
+			hidDirty   = true;
+		}
+	} else if(type == EV_SYN) {
+		hidSend();
+	}
+}
+
+// Set up HID gadget output per config; on failure (no configfs, no
+// device controller) output falls back to uinput
+static void hidOpen(void) {
+	uint8_t desc[128];
+	char    path[200], str[16];
+	int     len, maj, min;
+
+	if(!(len = hidDescribe(desc))) {
+		if(debug >= 1) printf("%s: nothing to report over HID (not "
+		  "fatal, continuing)\n", __progname);
+		return;
+	}
+	if(!hidGadgetCreate(desc, len,
+	  (hidLen[0] > hidLen[1]) ? hidLen[0] : hidLen[1])) {
+		if(debug >= 1) printf("%s: can't create USB HID gadget, using "
+		  "uinput (not fatal, continuing)\n", __progname);
+		return;
+	}
+	// Device node is /dev/hidg<minor>; make it if udev hasn't (yet)
+	sprintf(path, "%s/functions/hid.usb0/dev", HID_GADGET);
+	if(readLine(path, str, sizeof(str)) &&
+	   (sscanf(str, "%d:%d", &maj, &min) == 2)) {
+		sprintf(path, "/dev/hidg%d", min);
+		if(((hidFd = open(path, O_RDWR | O_NONBLOCK)) < 0) &&
+		   (errno == ENOENT) &&
+		   !mknod(path, S_IFCHR | 0600, makedev(maj, min)))
+			hidFd = open(path, O_RDWR | O_NONBLOCK);
+	}
+	if(hidFd < 0) {
+		if(debug >= 1) printf("%s: can't open HID device, using "
+		  "uinput (not fatal, continuing)\n", __progname);
+		hidGadgetRemove();
+		return;
+	}
+
+	memset(hidDown , 0, sizeof(hidDown));
+	memset(hidLatch, 0, sizeof(hidLatch));
+	memset(hidSent , 0, sizeof(hidSent));
+	memset(hidAxis , 0, sizeof(hidAxis));
+	hidReport(hidSent, hidDown); // Host starts out with nothing held
+	hidDirty          = false;
+	hidLast           = 0;
+	p[PFD_HID].fd     = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	p[PFD_HID].events = POLLIN;
+	if(debug >= 2) printf("%s: HID output on %s, %d byte descriptor\n",
+	  __progname, path, len);
+}
+
+// Output queue ------------------------------------------------------------
+
+// All events bound for keyfd pass through a bounded ring, normally
+// written out once per main loop pass (one write() per frame).  If the
+// input layer is congested (EAGAIN or short write), the remainder waits
+// for POLLOUT on keyfd rather than being lost.
+
+// Make room in a full ring for a release and the rest of its frame (need
+// slots): drop queued key repeats first, then axis/motion events, then
+// presses.  Releases are never dropped, so no key is left stuck down.  SYNs
+// left adjacent are squeezed out too.  A partly-written tail event is
+// kept.  Returns true if there's room for at least one event.
+static bool outCompact(uint32_t need) {
+	struct input_event *ev;
+	uint32_t            src, dst;
+	bool                drop;
+
+	for(int pass=0; (pass<3) && ((outHead - outTail) > OUT_QUEUE - need);
+	  pass++) {
+		src = dst = outTail + (outPart > 0);
+		for(; src != outHead; src++) {
+			ev = &outQ[src & (OUT_QUEUE - 1)];
+			if(ev->type == EV_KEY) {
+				drop = (ev->value == 2) ||
+				       ((pass >= 2) && (ev->value == 1));
+			} else if(ev->type == EV_SYN) {
+				drop = (dst != outTail) && (outQ[(dst - 1) &
+				  (OUT_QUEUE - 1)].type == EV_SYN);
+			} else {
+				drop = (pass >= 1);
+			}
+			if(drop) {
+				if(ev->type != EV_SYN) outDrops++;
+			} else {
+				outQ[dst++ & (OUT_QUEUE - 1)] = *ev;
+			}
+		}
+		outHead = dst;
+	}
+	return (outHead - outTail) < OUT_QUEUE;
+}
+
+// Append one event to the output ring.  If full, a release makes room
+// per outCompact() for itself, its MSC_TIMESTAMP and SYN, and a SYN makes
+// room for itself, so a queued release always gets its frame closed.
+// Anything else is itself dropped (and counted).
+static void outQueue(int type, int code, int value) {
+	struct input_event *ev;
+
+	if(hidFd >= 0) { // USB HID output instead
+		hidEvent(type, code, value);
+		return;
+	}
+	if(keyfd < 0) return; // No output device
+	if(((outHead - outTail) >= OUT_QUEUE) &&
+	  !((type == EV_KEY) && (value == 0) && outCompact(3)) &&
+	  !((type == EV_SYN) && outCompact(1))) {
+		outDrops++;
+		return;
+	}
+	ev = &outQ[outHead++ & (OUT_QUEUE - 1)];
+	memset(ev, 0, sizeof(*ev));
+	ev->type  = type;
+	ev->code  = code;
+	ev->value = value;
+	if((outHead - outTail) > outMax) outMax = outHead - outTail;
+}
+
+// Write queued events to keyfd, as many as it will take.  On EAGAIN or a
+// short write, the rest stay queued and keyfd is watched for POLLOUT
+// (PFD_OUT slot) to resume.  Other errors (device gone) discard the ring.
+static void outFlush(void) {
+	int i, n, len, w;
+
+	if(hidFd >= 0) return; // HID output doesn't use the ring
+
+	while(outHead != outTail) {
+		i = outTail & (OUT_QUEUE - 1);
+		n = outHead - outTail;
+		if(n > (OUT_QUEUE - i)) n = OUT_QUEUE - i; // Contiguous run
+		len = n * sizeof(outQ[0]) - outPart;
+		if((w = write(keyfd, (char *)&outQ[i] + outPart, len)) < 0) {
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN) break;
+			outDrops += outHead - outTail;
+			outTail   = outHead;
+			outPart   = 0;
+			break;
+		}
+		outPart += w;
+		outTail += outPart / sizeof(outQ[0]);
+		outPart %= sizeof(outQ[0]);
+		if(w < len) break;
+	}
+	if(outHead != outTail) { // Backlogged; resume on POLLOUT
+		outRetries++;
+		p[PFD_OUT].fd     = keyfd;
+		p[PFD_OUT].events = POLLOUT;
+	} else {
+		p[PFD_OUT].fd     = -1;
+		p[PFD_OUT].events = 0;
+	}
+}
+
+// Debounced changes go out in the order the inputs actually changed (edge
+// time), not pin order, so fast sequences (e.g. quarter-circle + punch)
+// arrive as played.  ORDER SPLIT gives each change its own frame; ORDER
+// SPACED also holds each frame back by its original interval from the
+// first (in all, at most the debounce time) rather than sending them
+// back-to-back.
+
+// Time seq[k] is due for output (ORDER SPACED), microseconds
+static int64_t seqDue(int k) {
+	int64_t d = seq[k].t - seq[0].t;
+	return seqBase + ((d < debounceTime * 1000) ? d : debounceTime * 1000);
+}
+
+// Output seq[k] as a frame of its own
+static void seqFrame(int k) {
+	outQueue(EV_KEY, key[seq[k].pin], seq[k].value);
+	outQueue(EV_MSC, MSC_TIMESTAMP, (int32_t)seq[k].t);
+	outQueue(EV_SYN, SYN_REPORT, 0);
+}
+
+// Output pending seq[] frames due by time t (INT64_MAX = all)
+static void seqRun(int64_t t) {
+	while((seqPos < nSeq) && (seqDue(seqPos) <= t)) seqFrame(seqPos++);
+}
+
+// SPI ADC handling --------------------------------------------------------
+
+// Read all ADC channels in use into s[] (one per transfer, adcChan[] order).
+// A real chip gets a single batched ioctl() with chip select released
+// between conversions.  If the configured device is a plain file or FIFO
+// (for testing without hardware), each scan instead reads one 16-bit
+// native-endian sample per channel, rewinding files at EOF.
+static bool adcSample(uint16_t *s) {
+	int i;
+
+	if(adcStub) {
+		int n, len = adcN * sizeof(s[0]);
+		if(!(n = read(adcFd, s, len))) {
+			lseek(adcFd, 0, SEEK_SET);
+			n = read(adcFd, s, len);
+		}
+		if(n != len) return false;
+		for(i=0; i<adcN; i++) s[i] &= (1 << adcBits) - 1;
+	} else {
+		if(ioctl(adcFd, SPI_IOC_MESSAGE(adcN), adcXfer) < 0) return false;
+		for(i=0; i<adcN; i++) {
+			s[i] = ((adcRx[i][1] << 8) | adcRx[i][2]) &
+			  ((1 << adcBits) - 1);
+		}
+	}
+	return true;
+}
+
+// EMA coefficient (Q16) for cutoff frequency 'cut' (milliHz) at sample
+// interval dt (microseconds): alpha = 1 / (1 + tau / dt), with tau =
+// 1 / (2 * pi * cut).  Here w = 2 * pi * cut * dt, scaled by 10^9.
+static int64_t euroAlpha(int64_t cut, int32_t dt) {
+	int64_t w = cut * dt * 6283 / 1000;
+	return (w << 16) / (w + 1000000000);
+}
+
+// Run one sample v through channel filter f, dt microseconds after the
+// previous one, returning the smoothed value.  Cutoff is capped at the
+// Nyquist frequency of the sample interval.
+static int euroStep(euroFilter *f, int v, int32_t dt) {
+	int64_t x = (int64_t)v << 16, dx, cut;
+
+	if(!f->minCut) return v;
+	if(f->x < 0) { // First sample primes the filter
+		f->x  = x;
+		f->dx = 0;
+		return v;
+	}
+	dx     = (x - f->x) * 1000000 / dt;
+	f->dx += ((dx - f->dx) * euroAlpha(f->dCut, dt)) >> 16;
+	cut    = f->minCut + (llabs(f->dx) >> 16) * f->beta / (1 << adcBits);
+	if(cut > 500000000 / dt) cut = 500000000 / dt;
+	f->x  += ((x - f->x) * euroAlpha(cut, dt)) >> 16;
+	return (f->x + 0x8000) >> 16;
+}
+
+// Update channel c's threshold pins in intstate[] from sample v.  Low pin
+// is pressed below 1/4 of the range, released above 5/16; high pin pressed
+// above 3/4, released below 11/16.  Hysteresis keeps noise near a
+// threshold from chattering the key.
+static void adcThreshold(int c, int v) {
+	int       full = (1 << adcBits) - 1;
+	uint32_t  lo   = 1 << ((ADC_PIN0 + c * 2) & 31),
+	          hi   = lo << 1,
+	         *w    = &intstate[(ADC_PIN0 + c * 2) / 32];
+	if(v < full / 4)             *w |=  lo;
+	else if(v > full * 5 / 16)   *w &= ~lo;
+	if(v > full * 3 / 4)         *w |=  hi;
+	else if(v < full * 11 / 16)  *w &= ~hi;
+}
+
+// Open ADC (if one is configured), build the transfer list for channels
+// in use (assigned an axis or a threshold key) and start the scan timer.
+// Initial threshold states are read here so that sticks already deflected
+// at load don't register a press, same as GPIO buttons.
+static void adcOpen(void) {
+	uint8_t           mode  = SPI_MODE_0, bits = 8;
+	uint32_t          speed = (adcBits == 12) ? 1000000 : 1350000;
+	uint16_t          s[8];
+	long              ns;
+	struct itimerspec t;
+	int               c, k0, k1;
+
+	if(!adcBits) return;
+
+	for(adcN=c=0; c<8; c++) {
+		k0 = key[ADC_PIN0 + c * 2];
+		k1 = key[ADC_PIN0 + c * 2 + 1];
+		if((adcAxis[c] < 0) &&
+		   ((k0 <= KEY_RESERVED) || (k0 >= GND)) &&
+		   ((k1 <= KEY_RESERVED) || (k1 >= GND))) continue;
+		if(adcBits == 12) { // MCP3208: start, single-ended, D2 | D1, D0
+			adcTx[adcN][0] = 0x06 | (c >> 2);
+			adcTx[adcN][1] = c << 6;
+		} else {            // MCP3008: start | single-ended, D2-D0
+			adcTx[adcN][0] = 0x01;
+			adcTx[adcN][1] = 0x80 | (c << 4);
+		}
+		adcTx[adcN][2] = 0;
+		memset(&adcXfer[adcN], 0, sizeof(adcXfer[0]));
+		adcXfer[adcN].tx_buf        = (uintptr_t)adcTx[adcN];
+		adcXfer[adcN].rx_buf        = (uintptr_t)adcRx[adcN];
+		adcXfer[adcN].len           = 3;
+		adcXfer[adcN].speed_hz      = speed;
+		adcXfer[adcN].bits_per_word = bits;
+		adcXfer[adcN].cs_change     = 1; // Deselect between channels
+		adcChan[adcN++]             = c;
+	}
+	if(!adcN) return; // ADC declared but nothing uses it
+	adcXfer[adcN - 1].cs_change = 0;
+
+	if((adcFd = open(adcPath, O_RDWR | O_NONBLOCK)) < 0) {
+		if(debug >= 1) printf("%s: can't open ADC device '%s' (not "
+		  "fatal, continuing)\n", __progname, adcPath);
+		return;
+	}
+	if(ioctl(adcFd, SPI_IOC_WR_MODE, &mode) < 0) {
+		adcStub = (errno == ENOTTY); // Not a spidev node
+	} else {
+		(void)ioctl(adcFd, SPI_IOC_WR_BITS_PER_WORD, &bits);
+		(void)ioctl(adcFd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+	}
+
+	for(c=0; c<8; c++) {
+		adcFilter[c].x = -1;     // Prime filters on 1st sample
+		adcValue[c]    = 0xFFFF; // Issue axes on 1st scan
+	}
+	if(adcSample(s)) {
+		for(c=0; c<adcN; c++) {
+			adcThreshold(adcChan[c],
+			  euroStep(&adcFilter[adcChan[c]], s[c], 0));
+		}
+	}
+
+	ns                     = 1000000000L / adcRate;
+	t.it_interval.tv_sec   = ns / 1000000000L;
+	t.it_interval.tv_nsec  = ns % 1000000000L;
+	t.it_value             = t.it_interval;
+	p[PFD_ADC].fd          = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	p[PFD_ADC].events      = POLLIN;
+	timerfd_settime(p[PFD_ADC].fd, 0, &t, NULL);
+	if(debug >= 3) printf("%s: ADC init OK\n", __progname);
+}
+
+// ADC timer tick: sample channels in use, issue changed axis values
+// immediately (no debounce needed; one frame for all axes) and update
+// threshold pins.  Missed ticks are not made up; one scan per
+// wakeup.  Returns true if any threshold pin changed, so the main loop
+// will begin a debounce interval.
+static bool adcScan(void) {
+	uint64_t ticks = 1;
+	uint32_t prev[N_WORDS];
+	uint16_t s[8];
+	int32_t  dt;
+	int      i, c, n = 0;
+
+	// Timer expirations since last read give the true sample interval
+	// (for the filters) if any scans were missed
+	read(p[PFD_ADC].fd, &ticks, sizeof(ticks));
+	if((adcFd < 0) || !adcSample(s)) return false;
+	if(ticks > 100) ticks = 100;
+	dt = (int32_t)ticks * 1000000 / adcRate;
+
+	memcpy(prev, intstate, sizeof(prev));
+	for(i=0; i<adcN; i++) {
+		c    = adcChan[i];
+		s[i] = euroStep(&adcFilter[c], s[i], dt);
+		if((adcAxis[c] >= 0) && (s[i] != adcValue[c])) {
+			outQueue(EV_ABS, adcAxis[c], s[i]);
+			n++;
+		}
+		adcValue[c] = s[i];
+		adcThreshold(c, s[i]);
+	}
+	if(n) {
+		outQueue(EV_MSC, MSC_TIMESTAMP, (int32_t)wakeTime);
+		outQueue(EV_SYN, SYN_REPORT, 0);
+	}
+	return memcmp(prev, intstate, sizeof(prev)) != 0;
+}
+
+// evdev input sources -----------------------------------------------------
+
+// Parse an EVDEV source code: key name (as in keyTable), BTN_* name or
+// number, or an absolute axis name followed by '-' or '+' (low or high
+// end of axis, e.g. X- or HAT0Y+).  Sets *dir; returns code, -1 if bad.
+static int evdevCode(char *str, int *dir) {
+	int   len = strlen(str), k;
+	char *end;
+
+	*dir = 0;
+	if((len > 1) && ((str[len-1] == '-') || (str[len-1] == '+'))) {
+		*dir        = (str[len-1] == '-') ? -1 : 1;
+		str[len-1]  = 0;
+		k           = dictSearch(str, axisName);
+		str[len-1]  = (*dir < 0) ? '-' : '+';
+		return k;
+	}
+	if((k = dictSearch(str, keyTable)) >= 0) return k;
+	if((k = dictSearch(str, btnName))  >= 0) return k;
+	k = strtol(str, &end, 0);
+	return ((*end) || (k < 0) || (k >= KEY_CNT)) ? -1 : k;
+}
+
+// Set or clear state of evdev pin j (index from EV_PIN0) in intstate[];
+// t is the source event time, for the pin's edge time if it changes
+// (0 = initial state, not an edge)
+static void evdevPinSet(int j, bool on, int64_t t) {
+	if(pinSet(EV_PIN0 + j, on) && t) edgeNote(EV_PIN0 + j, t);
+}
+
+// Is axis value v past the threshold of evdev pin e?
+static bool evdevAxisOn(evdevPin *e, int v) {
+	return (e->dir < 0) ? (v <= e->thresh) : (v >= e->thresh);
+}
+
+// Open and grab each evdev input source, set axis thresholds (1/4 of
+// the axis range in from either end) and read initial button and axis
+// states, so inputs already held at load don't register a press.
+static void evdevOpen(void) {
+	struct input_absinfo abs;
+	uint8_t              keys[KEY_CNT / 8 + 1];
+	int                  i, j, fd, range, clk;
+
+	for(i=0; i<nEvdev; i++) {
+		if((fd = open(evPath[i], O_RDONLY | O_NONBLOCK)) < 0) {
+			if(debug >= 1) printf("%s: can't open input '%s' (not "
+			  "fatal, continuing)\n", __progname, evPath[i]);
+			continue;
+		}
+		// ENOTTY = FIFO or plain file standing in for a device
+		if((ioctl(fd, EVIOCGRAB, 1) < 0) && (errno != ENOTTY) &&
+		   (debug >= 1)) printf("%s: can't grab input '%s' (not "
+		  "fatal, continuing)\n", __progname, evPath[i]);
+		clk = CLOCK_MONOTONIC; // Event times on same clock as usNow()
+		(void)ioctl(fd, EVIOCSCLOCKID, &clk);
+		memset(keys, 0, sizeof(keys));
+		(void)ioctl(fd, EVIOCGKEY(sizeof(keys)), keys);
+		for(j=0; j<N_EVPINS; j++) {
+			evdevPin *e = &evPin[j];
+			if(e->src != i) continue;
+			if(!e->dir) {
+				evdevPinSet(j, keys[e->code / 8] &
+				  (1 << (e->code & 7)), 0);
+				continue;
+			}
+			if(ioctl(fd, EVIOCGABS(e->code), &abs) < 0) {
+				abs.minimum = 0; // Typical encoder range
+				abs.maximum = 255;
+				abs.value   = 128;
+			}
+			range     = abs.maximum - abs.minimum;
+			e->thresh = (e->dir < 0) ? abs.minimum + range / 4 :
+			                           abs.maximum - range / 4;
+			evdevPinSet(j, evdevAxisOn(e, abs.value), 0);
+		}
+		p[PFD_EVDEV + i].fd     = fd;
+		p[PFD_EVDEV + i].events = POLLIN;
+		if(debug >= 2) {
+			printf("%s: input '%s' open\n", __progname, evPath[i]);
+		}
+	}
+}
+
+// Read a batch of events from evdev source s, update its pins and pass
+// relative motion straight through (one frame per batch).  A source
+// that's unplugged or reaches EOF is closed until the next config load.
+// Returns true if any pin changed, so the main loop begins debounce.
+static bool evdevRead(int s) {
+	struct input_event  ev[64];
+	struct pollfd      *pf = &p[PFD_EVDEV + s];
+	uint32_t            prev[N_WORDS];
+	int64_t             t = wakeTime;
+	int                 i, j, n, nRel = 0;
+
+	if((n = read(pf->fd, ev, sizeof(ev))) <= 0) {
+		if((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+			return false;
+		if(debug >= 2) {
+			printf("%s: input '%s' closed\n", __progname, evPath[s]);
+		}
+		close(pf->fd);
+		pf->fd     = -1;
+		pf->events = 0;
+		return false;
+	}
+
+	memcpy(prev, intstate, sizeof(prev));
+	n /= sizeof(ev[0]);
+	for(i=0; i<n; i++) {
+		// Kernel event time (file/FIFO stand-ins may leave it zero)
+		if(ev[i].input_event_sec || ev[i].input_event_usec) {
+			t = (int64_t)ev[i].input_event_sec * 1000000 +
+			  ev[i].input_event_usec;
+		}
+		if(ev[i].type == EV_REL) {
+			outQueue(EV_REL, ev[i].code, ev[i].value);
+			nRel++;
+		} else if((ev[i].type == EV_KEY) || (ev[i].type == EV_ABS)) {
+			for(j=0; j<N_EVPINS; j++) {
+				evdevPin *e = &evPin[j];
+				if((e->src != s) || (e->code != ev[i].code) ||
+				   ((e->dir != 0) != (ev[i].type == EV_ABS)))
+					continue;
+				evdevPinSet(j, e->dir ?
+				  evdevAxisOn(e, ev[i].value) : ev[i].value, t);
+			}
+		}
+	}
+	if(nRel) {
+		outQueue(EV_MSC, MSC_TIMESTAMP, (int32_t)t);
+		outQueue(EV_SYN, SYN_REPORT, 0);
+	}
+	return memcmp(prev, intstate, sizeof(prev)) != 0;
+}
+
+// Kernel port expanders --------------------------------------------------
+
+// GPIO character device of the GPIOCHIP expander in slot, into path: as
+// given in the config, else the gpiochipN device under its I2C client in
+// Sysfs.  Returns false if not (yet) there.
+static bool chipFind(int slot, char *path) {
+	DIR           *dir;
+	struct dirent *d;
+	char           buf[100];
+	if(chipNode[slot][0]) {
+		strcpy(path, chipNode[slot]);
+		return !access(path, F_OK);
+	}
+	path[0] = 0;
+	sprintf(buf, "/sys/bus/i2c/devices/%s-%04x", I2C_BUS + 4,
+	  chipAddr[slot]);
+	if((dir = opendir(buf))) {
+		while((d = readdir(dir))) {
+			if(!strncmp(d->d_name, "gpiochip", 8)) {
+				sprintf(path, "/dev/%.32s", d->d_name);
+				break;
+			}
+		}
+		closedir(dir);
+	}
+	return path[0] && !access(path, F_OK);
+}
+
+// Request the pins in use on each GPIOCHIP expander, one line request
+// per chip: inputs pulled up with both edges reported, GNDs outputs
+// driven low.  The kernel driver services the chip's interrupt (reading
+// INTCAP etc.), so each event read here is one edge of one pin with the
+// kernel's timestamp, batched per read.  Initial input levels are read
+// so buttons already held at load don't register a press.
+static void chipOpen(void) {
+	struct gpio_v2_line_request r;
+	struct gpio_v2_line_values  v;
+	char                        path[48];
+	uint64_t                    gnds;
+	int                         slot, j, k, fd;
+
+	for(slot=0; slot<8; slot++) {
+		if(!(chipMask & (1 << slot))) continue;
+		memset(&r, 0, sizeof(r));
+		gnds = 0;
+		for(j=0; j<16; j++) {
+			k = key[32 + slot * 16 + j];
+			if(k == KEY_RESERVED) continue;
+			if(k == GND) gnds |= 1ULL << r.num_lines;
+			r.offsets[r.num_lines++] = j;
+		}
+		if(!r.num_lines) continue; // Not referenced in config
+		if(!chipFind(slot, path) || ((fd = open(path, O_RDONLY)) < 0)) {
+			if(debug >= 1) printf("%s: can't find expander 0x%02X "
+			  "GPIO chip (not fatal, continuing)\n", __progname,
+			  chipAddr[slot]);
+			continue;
+		}
+		strcpy(r.consumer, "retrogame");
+		r.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+		  GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING |
+		  GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+		if(gnds) {
+			r.config.attrs[0].attr.id    = GPIO_V2_LINE_ATTR_ID_FLAGS;
+			r.config.attrs[0].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+			r.config.attrs[0].mask       = gnds;
+			r.config.attrs[1].attr.id    =
+			  GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+			r.config.attrs[1].attr.values = 0;
+			r.config.attrs[1].mask       = gnds;
+			r.config.num_attrs           = 2;
+		}
+		k = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &r);
+		close(fd);
+		if(k < 0) {
+			if(debug >= 1) printf("%s: can't get lines of %s (%s) "
+			  "(not fatal, continuing)\n", __progname, path,
+			  strerror(errno));
+			continue;
+		}
+		v.bits = 0;
+		v.mask = ((1ULL << r.num_lines) - 1) & ~gnds;
+		if(!ioctl(r.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v)) {
+			for(j=0; j<r.num_lines; j++) {
+				if(v.mask & (1ULL << j))
+					pinSet(32 + slot * 16 + r.offsets[j],
+					  !(v.bits & (1ULL << j)));
+			}
+		}
+		fcntl(r.fd, F_SETFL, O_NONBLOCK);
+		p[PFD_CHIP + slot].fd     = r.fd;
+		p[PFD_CHIP + slot].events = POLLIN;
+		if(debug >= 2) printf("%s: expander 0x%02X lines from %s\n",
+		  __progname, chipAddr[slot], path);
+	}
+}
+
+// Read a batch of edge events from GPIOCHIP expander in slot.  Every
+// edge is noted (bounce included, as for switch health), with its kernel
+// timestamp as edge time.  Returns true if any pin changed.
+static bool chipRead(int slot) {
+	struct gpio_v2_line_event  ev[16];
+	struct pollfd             *pf = &p[PFD_CHIP + slot];
+	uint32_t                   prev[N_WORDS];
+	int                        i, n, pin;
+
+	if((n = read(pf->fd, ev, sizeof(ev))) <= 0) {
+		if((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+			return false;
+		if(debug >= 2) printf("%s: expander 0x%02X lines closed\n",
+		  __progname, chipAddr[slot]);
+		close(pf->fd);
+		pf->fd     = -1;
+		pf->events = 0;
+		return false;
+	}
+
+	memcpy(prev, intstate, sizeof(prev));
+	n /= sizeof(ev[0]);
+	for(i=0; i<n; i++) {
+		pin = 32 + slot * 16 + ev[i].offset;
+		pinSet(pin, ev[i].id == GPIO_V2_LINE_EVENT_FALLING_EDGE);
+		edgeNote(pin, ev[i].timestamp_ns / 1000);
+	}
+	return memcmp(prev, intstate, sizeof(prev)) != 0;
+}
+
+// Device bring-up ---------------------------------------------------------
+
+// At boot, retrogame may well start before the uinput and i2c-dev modules
+// have created their device nodes, or before the GPIO driver is up.
+// Rather than failing (or polling), /dev is watched with inotify (PFD_DEV
+// slot) while any of these is missing, and each subsystem is brought up
+// the moment its node appears -- independently, so keys are output as
+// early as possible even if expanders are still on their way.
+
+// Any native GPIO in use (keys, GNDs, Vulcan/RUN inputs, MCP IRQ lines)?
+static bool gpioUsed(void) {
+	for(int i=0; i<N_GPIO; i++) {
+		if(key[gpioPin(i)] != KEY_RESERVED) return true;
+	}
+	return gpioInputs() != 0;
+}
+
+// Does directory contain an entry whose name starts with prefix?
+static bool dirHas(const char *path, const char *prefix) {
+	DIR           *dir;
+	struct dirent *d;
+	bool           found = false;
+	if((dir = opendir(path))) {
+		while(!found && (d = readdir(dir)))
+			found = !strncmp(d->d_name, prefix, strlen(prefix));
+		closedir(dir);
+	}
+	return found;
+}
+
+// Subsystem dev (DEV_*) whose node is name, or 0 if none
+static int devMatch(const char *name) {
+	if(!strcmp(name, "uinput"))       return DEV_UINPUT;
+	if(!strcmp(name, I2C_BUS))        return DEV_I2C;
+	if(!strncmp(name, "gpiochip", 8)) return DEV_GPIO | DEV_CHIP;
+	return 0;
+}
+
+// Description of subsystem dev, for messages
+static const char *devName(int dev) {
+	return (dev == DEV_UINPUT) ? "/dev/uinput" :
+	       (dev == DEV_I2C)    ? "/dev/" I2C_BUS :
+	       (dev == DEV_CHIP)   ? "expander GPIO chip(s)" : "GPIO";
+}
+
+// Can subsystem dev be brought up now?  Native pins are handled through
+// Sysfs, which is usable once the export file and a GPIO chip are there
+// (chips register a moment after their /dev/gpiochipN node appears).
+// GPIOCHIP expanders all need their nodes (drivers may probe late).
+static bool devPresent(int dev) {
+	char buf[100];
+	int  slot;
+	if(dev == DEV_GPIO) {
+		sprintf(buf, "%s/export", sysfs_root);
+		return !access(buf, F_OK) && dirHas(sysfs_root, "gpiochip");
+	}
+	if(dev == DEV_CHIP) {
+		for(slot=0; slot<8; slot++) {
+			if((chipMask & (1 << slot)) && !chipFind(slot, buf))
+				return false;
+		}
+		return true;
+	}
+	return !access(devName(dev), F_OK);
+}
+
+// Start watching /dev for new nodes, if not already
+static void devWatch(void) {
+	if(p[PFD_DEV].fd >= 0) return;
+	if((p[PFD_DEV].fd = inotify_init1(IN_NONBLOCK)) >= 0) {
+		if(inotify_add_watch(p[PFD_DEV].fd, "/dev", IN_CREATE) >= 0) {
+			p[PFD_DEV].events = POLLIN;
+		} else {
+			close(p[PFD_DEV].fd);
+			p[PFD_DEV].fd = -1;
+		}
+	}
+}
+
+// Stop watching /dev
+static void devUnwatch(void) {
+	if(p[PFD_DEV].fd >= 0) {
+		close(p[PFD_DEV].fd);
+		p[PFD_DEV].fd = -1;
+	}
+	p[PFD_DEV].events = p[PFD_DEV].revents = 0;
+	devWait = 0;
+}
+
+// Export and configure native GPIO pins through Sysfs, read their
+// initial state
+static void gpioOpen(void) {
+	uint64_t bitmask = gpioInputs();
+	char     buf[100];
+	int      i, fd, pin;
+
+	sprintf(buf, "%s/export", sysfs_root);
+	if((fd = open(buf, O_WRONLY)) < 0) { // Open Sysfs export file
+		err("Can't open GPIO export file");
+	}
+	for(i=0; i<N_GPIO; i++) { // i = GPIO number
+		pin = gpioPin(i);
+		pinSet(pin, false);
+		if((key[pin] == KEY_RESERVED) && !(bitmask & (1ULL << i)))
+			continue;
+		sprintf(buf, "%d", i);
+		write(fd, buf, strlen(buf));    // Export pin
+		pinSetup(i, "active_low", "0"); // Don't invert
+		if(key[pin] >= GND) {
+			// Set pin to output, value 0 (ground)
+			if(pinSetup(i, "direction", "out") ||
+			   pinSetup(i, "value"    , "0"))
+				err("Pin config failed (GND)");
+		} else {
+			// Set pin to input, detect edge events
+			char x;
+			// Plain GPIOs: detect both RISING and FALLING
+			// edges.  Port expanders: detect FALLING only.
+			if(pinSetup(i, "direction", "in") ||
+			   pinSetup(i, "edge",
+			    (mcpMask & (1ULL << i)) ? "falling" : "both")) {
+				err("Pin config failed");
+			}
+			// Get initial pin value.  This is for plain GPIOs
+			// only; MCP23017 will be a separate pass later.
+			sprintf(buf, "%s/gpio%d/value", sysfs_root, i);
+			if((p[i].fd = open(buf, O_RDONLY | O_NONBLOCK)) < 0)
+				err("Can't access pin value");
+			if((read(p[i].fd, &x, 1) == 1) && (x == '0'))
+				pinSet(pin, true);
+			p[i].events  = POLLPRI | POLLERR | POLLHUP | POLLNVAL;
+			p[i].revents = 0;
+		}
+	}
+	close(fd); // Done w/Sysfs exporting
+}
+
+// Create uinput virtual keyboard and locate its event device
+static void uinputOpen(void) {
+	char buf[100];
+	int  i, k;
+
+	// Attempt to create uidev virtual keyboard
+	if((keyfd1 = open("/dev/uinput", O_WRONLY | O_NONBLOCK)) >= 0) {
+		(void)ioctl(keyfd1, UI_SET_EVBIT, EV_KEY);
+		(void)ioctl(keyfd1, UI_SET_EVBIT, EV_MSC); // Edge timestamps
+		(void)ioctl(keyfd1, UI_SET_MSCBIT, MSC_TIMESTAMP);
+		for(i=0; i<=N_PINS; i++) {
+			if((key[i] >= KEY_RESERVED) && (key[i] < GND))
+				(void)ioctl(keyfd1, UI_SET_KEYBIT, key[i]);
+		}
+		struct uinput_user_dev uidev;
+		memset(&uidev, 0, sizeof(uidev));
+		if(adcFd >= 0) { // ADC channels assigned to axes
+			for(i=0; i<8; i++) {
+				if(adcAxis[i] < 0) continue;
+				(void)ioctl(keyfd1, UI_SET_EVBIT, EV_ABS);
+				(void)ioctl(keyfd1, UI_SET_ABSBIT, adcAxis[i]);
+				uidev.absmax[adcAxis[i]] = (1 << adcBits) - 1;
+			}
+		}
+		for(i=PFD_EVDEV; i<PFD_EVDEV+N_EVDEV; i++) {
+			// Relative axes of input sources are passed through
+			uint8_t rel[REL_CNT / 8 + 1];
+			memset(rel, 0, sizeof(rel));
+			if(p[i].fd < 0) continue;
+			(void)ioctl(p[i].fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel);
+			for(k=0; k<REL_CNT; k++) {
+				if(!(rel[k / 8] & (1 << (k & 7)))) continue;
+				(void)ioctl(keyfd1, UI_SET_EVBIT, EV_REL);
+				(void)ioctl(keyfd1, UI_SET_RELBIT, k);
+			}
+		}
+		snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "retrogame");
+		uidev.id.bustype = BUS_USB;
+		uidev.id.vendor  = 0x1;
+		uidev.id.product = 0x1;
+		uidev.id.version = 1;
+		if(write(keyfd1, &uidev, sizeof(uidev)) < 0)
+			err("write failed");
+		if(ioctl(keyfd1, UI_DEV_CREATE) < 0)
+			err("DEV_CREATE failed");
+		if(debug >= 3) printf("%s: uidev init OK\n", __progname);
+	}
+
+	// SDL2 (used by some newer emulators) wants /dev/input/eventX
+	// instead -- BUT -- this only exists if there's a physical USB
+	// keyboard attached or if the above code has run and created a
+	// virtual keyboard.  On older systems this method doesn't apply,
+	// events can be sent to the keyfd1 virtual keyboard above...so,
+	// this code looks for an eventX device and (if present) will use
+	// that as the destination for events, else fallback on keyfd1.
+
+	// The 'X' in eventX is a unique identifier (typically a numeric
+	// digit or two) for each input device, dynamically assigned as
+	// USB input devices are plugged in or disconnected (or when the
+	// above code runs, creating a virtual keyboard).  As it's
+	// dynamically assigned, we can't rely on a fixed number -- it
+	// will vary if there's a keyboard connected at startup.
+
+	struct dirent **namelist;
+	int             n;
+	char            evName[300] = "";
+
+	if((n = scandir("/sys/devices/virtual/input",
+	  &namelist, filter1, NULL)) > 0) {
+		// Got a list of device(s).  In theory there should
+		// be only one that makes it through the filter (name
+		// matches retrogame)...if there's multiples, only
+		// the first is used.  (namelist can then be freed)
+		char path[300];
+		sprintf(path, "/sys/devices/virtual/input/%s",
+		  namelist[0]->d_name);
+		for(i=0; i<n; i++) free(namelist[i]);
+		free(namelist);
+		// Within the given device path should be a subpath with
+		// the name 'eventX' (X varies), again theoretically
+		// should be only one, first in list is used.
+		if((n = scandir(path, &namelist, filter2, NULL)) > 0) {
+			sprintf(evName, "/dev/input/%s",
+			  namelist[0]->d_name);
+			for(i=0; i<n; i++) free(namelist[i]);
+			free(namelist);
+		}
+	}
+
+	if(!evName[0]) { // Nothing found?  Use fallback method...
+		// Kinda lazy skim for last item in /dev/input/event*
+		// This is NOT guaranteed to be retrogame, but if the
+		// above method fails for some reason, this may be
+		// adequate.  If there's a USB keyboard attached at
+		// boot, it usually instantiates in /dev/input before
+		// retrogame, so even if it's then removed, the index
+		// assigned to retrogame stays put...thus the last
+		// index mmmmight be what we need.
+		struct stat st;
+		for(i=99; i>=0; i--) {
+			sprintf(buf, "/dev/input/event%d", i);
+			if(!stat(buf, &st)) break; // last valid device
+		}
+		strcpy(evName, (i >= 0) ? buf : "/dev/input/event0");
+	}
+
+	keyfd2 = open(evName, O_WRONLY | O_NONBLOCK);
+	keyfd  = (keyfd2 >= 0) ? keyfd2 : keyfd1;
+	// keyfd1 and 2 are global and are held open (as a destination for
+	// key events) until pinConfigUnload() is called.
+	if((debug >= 3) && keyfd2) printf("%s: SDL2 init OK\n", __progname);
+}
+
+// Configure port expander(s)
+static void mcpOpen(void) {
+	const expDriver *d;
+	uint16_t         inputMask, gndMask;
+	int              i, j, k, levels;
+
+	if(!mcpMask) return; // No port expanders mentioned in config
+
+	for(i=0; i<8; i++) { // 8 possible expander slots
+		inputMask = gndMask = 0; // Bitmasks of keys, gnds on this device
+		for(j=0; j<16; j++) { // 16 bits per expander
+			k = key[32 + i * 16 + j];
+			if(k == GND)              gndMask   |= (1 << j);
+			else if(k > KEY_RESERVED) inputMask |= (1 << j);
+		}
+		if(!(inputMask | gndMask) || (chipMask & (1 << i)))
+			continue; // Not referenced in config, or kernel's
+
+		d = &expander[mcpChip[i]];
+		if(((inputMask | gndMask) >> d->bits) && (debug >= 1)) {
+			printf("%s: %s at 0x%02X has only %d pins (not fatal, "
+			  "continuing)\n", __progname, d->name, d->base + i,
+			  d->bits);
+		}
+		// Each expander is assigned a separate file descriptor;
+		// each bonded once to a specific I2C address (via ioctl)
+		// so that the ioctl isn't required for every transaction.
+		if((i2cfd[i] = open("/dev/" I2C_BUS, O_RDWR | O_NONBLOCK)) > 0) {
+			ioctl(i2cfd[i], I2C_SLAVE, d->base + i);
+			if((levels = d->init(i2cfd[i], inputMask, gndMask)) >= 0)
+				expState(i, levels);
+		}
+	}
+}
+
+// Bring up subsystem dev.  late = its node has just appeared, after the
+// config was loaded: buttons already held then are taken as the starting
+// state (as at config load) rather than as presses, and AFFINITY is
+// redone for the new GPIO IRQs.
+static void devStart(int dev, bool late) {
+	int pin;
+
+	if(dev == DEV_GPIO)        gpioOpen();
+	else if(dev == DEV_UINPUT) uinputOpen();
+	else if(dev == DEV_CHIP)   chipOpen();
+	else                       mcpOpen();
+	if(!late) return;
+
+	if(debug >= 1) printf("%s: %s ready\n", __progname, devName(dev));
+	for(pin=0; pin<N_PINS; pin++) {
+		if((dev == DEV_GPIO) ? (pinGpio(pin) < 0) :
+		   ((dev == DEV_UINPUT) || (pin < 32) || (pin >= ADC_PIN0) ||
+		    (chipPin(pin) != (dev == DEV_CHIP))))
+			continue;
+		extstate[pin / 32] = (extstate[pin / 32] & ~(1U << (pin & 31)))
+		  | (intstate[pin / 32] & (1U << (pin & 31)));
+	}
+	if((dev == DEV_GPIO) && irqTune) {
+		irqRestore();
+		irqAffinity();
+	}
+}
+
+// Bring up subsystem dev now if possible, else once its node appears
+static void devOpen(int dev) {
+	if(!devPresent(dev)) {
+		devWatch(); // Watch, then check again so nothing is missed
+		if(!devPresent(dev)) {
+			// GPIO chip present but no Sysfs export: proceed,
+			// and fail in gpioOpen() as before
+			if((dev != DEV_GPIO) || !dirHas("/dev", "gpiochip")) {
+				devWait |= dev;
+				if(debug >= 1) printf("%s: waiting for %s\n",
+				  __progname, devName(dev));
+				return;
+			}
+		}
+		if(!devWait) devUnwatch();
+	}
+	devStart(dev, false);
+}
+
+// New node(s) in /dev (PFD_DEV): bring up any subsystem waiting on one
+static void devNode(void) {
+	char    evBuf[2048] __attribute__((aligned(8)));
+	int     dev, pos = 0;
+	ssize_t n = read(p[PFD_DEV].fd, evBuf, sizeof(evBuf));
+
+	while(pos < n) {
+		struct inotify_event *ev = (struct inotify_event *)&evBuf[pos];
+		if(ev->len && (dev = devMatch(ev->name) & devWait) &&
+		   devPresent(dev)) {
+			devWait &= ~dev;
+			devStart(dev, true);
+		}
+		pos += sizeof(struct inotify_event) + ev->len;
+	}
+	if(!devWait) devUnwatch();
+}
+
+// Config file handlage ----------------------------------------------------
+
+// Load pin/key configuration from cfgPathname.
+static void pinConfigLoad() {
+
+	// Config file format is super simple, just per-line keyword and
+	// argument(s) with whitespace delimiters...can parse it ourselves
+	// here.  Configuration libraries such as libconfig, libconfuse
+	// have some potent features but enforce a correspondingly more
+	// exacting syntax on the user; do not want if we can avoid it.
+
+	FILE            *fp;
+	char             buf[100];
+	enum commandNum  cmd = CMD_NONE;
+	int              stringLen      = 0,
+	                 wordCount      = 0,
+	                 keyCode        = KEY_RESERVED,
+	                 i, c, k, dLevel = -1,
+	                 mcpPin = -1, mcpAddr = -1, mcpType = 0,
+	                 adcB = -1, adcR = 0, axisCode = -1, axisChan = -1,
+	                 filtChan = -1, evSrc = -1, evCode = -1, evDir = 0,
+	                 ord = -1, runHold = -1, runLen = 0;
+	runBind         *rb = &runs[nRun]; // RUN command being read
+	double           filtArg[3] = { FILTER_MINCUT, FILTER_BETA,
+	                   FILTER_DCUT };
+	bool             readingString  = false,
+	                 isComment      = false;
+	uint32_t         pinMask[N_WORDS];
+	uint64_t         bitmask;
+
+	if(debug >= 2) printf("%s: Loading config\n", __progname);
+
+	// Read config file into key[] table -------------------------------
+
+	if(NULL == (fp = fopen(cfgPathname, "r"))) {
+		if(debug >= 1) printf("%s: could not open config file '%s' "
+		  "(not fatal, continuing)\n", __progname, cfgPathname);
+		return; // Not fatal; file might be created later
+	}
+
+	do { // Deep nesting, please excuse shift to two-space indents...
+	  c = getc(fp);
+	  if(isspace(c) || (c <= 0)) { // If whitespace char...
+	    if(readingString && !isComment) {
+	      // Switching from string-reading to whitespace-skipping.
+	      // Cap off & process current string, reset readingString flag.
+	      buf[stringLen] = 0;
+	      if(wordCount == 1) {
+	        // First word on line.  Search key dict, then command dict
+	        memset(pinMask, 0, sizeof(pinMask));
+	        keyCode = KEY_RESERVED;
+	        if((k = dictSearch(buf, keyTable)) >= 0) {
+	          // Start of key command
+	          cmd     = CMD_KEY;
+	          keyCode = k;
+	        } else if((k = dictSearch(buf, btnName)) >= 0) {
+	          // Button (BTN_*) mapped like a key
+	          cmd     = CMD_KEY;
+	          keyCode = k;
+	        } else if((k = dictSearch(buf, command)) >= 0) {
+	          // Not a key, is other command (e.g. GND, DEBUG)
+	          cmd = k;
+	        } else if(debug >= 1) {
+	          printf("%s: unknown key or command '%s' (not fatal, "
+	            "continuing)\n", __progname, buf);
 	        }
 	      } else {
 	        // Word #2+ on line; Certain commands may accumulate
 	        // values (e.g. keys w/pinch).
 	        char *endptr;
-	        int   arg = strtol(buf, &endptr, 0);
+	        int   arg;
+	        if(!strncasecmp(buf, "GPIO", 4) && isdigit(buf[4])) {
+	          // Native GPIO by Broadcom number, either bank
+	          arg = strtol(&buf[4], &endptr, 10);
+	          arg = (arg < N_GPIO) ? gpioPin(arg) : -1;
+	        } else {
+	          arg = strtol(buf, &endptr, 0);
+	        }
 	        switch(cmd) {
 	         case CMD_KEY:
 	         case CMD_GND:
-	          if((*endptr) || (arg < 0) || (arg > 159)) {
+	          if((*endptr) || (arg < 0) || (arg >= N_PINS)) {
 	            // Non-NUL character indicates not full string
 	            // was parsed, i.e. bad numeric input.
 	            if(debug >= 1) {
@@ -461,48 +2856,288 @@ static void pinConfigLoad() {
 	          } else {
 	            // Add pin # (in 'arg') to list
 	            arg = pinRemap(arg); // Handle early Pi boards
-	            pinMask[arg/32] |= (1 << (arg&31));
+	            pinMask[arg/32] |= (1U << (arg&31));
+	          }
+	          break;
+	         case CMD_IRQ:
+	          switch(wordCount) {
+	           case 2: // word 2 = GPIO pin number for IRQ, MUST be native
+	            if((*endptr) || (arg < 0) || (pinGpio(arg) < 0)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid pin '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              mcpPin = pinGpio(pinRemap(arg)); // Handle early Pi
+	            }
+	            break;
+	           case 3: // word 3 = I2C addr, 0-7 or chip's (e.g. 0x20-0x27)
+	            if((*endptr) || (arg < 0) || (arg > 0x7F)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid I2C address '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              mcpAddr = arg; // Checked against chip at end of line
+	            }
+	            break;
+	           case 4: // word 4 (optional) = chip type, default MCP23017
+	            for(k=0; (k < N_EXPANDERS) &&
+	              strcasecmp(buf, expander[k].name); k++);
+	            if(k < N_EXPANDERS) {
+	              mcpType = k;
+	            } else if(debug >= 1) {
+	              printf("%s: unknown port expander '%s' (not fatal, "
+	                "continuing)\n", __progname, buf);
+	            }
+	            break;
+	           default:
+	            if(debug >= 1) {
+	              printf("%s: extraneous parameter '%s' (not fatal, "
+		        "continuing)\n", __progname, buf);
+	            }
+	            break;
+	          }
+	          break;
+	         case CMD_DEBUG:
+	          if((*endptr) || (arg < 0) || (arg > 3)) {
+	            if(debug >= 1) {
+	              printf("%s: invalid debug level '%s' "
+	                "(not fatal, continuing)\n", __progname, buf);
+	            }
+	          } else {
+	            dLevel = arg;
+	          }
+	          break;
+	         case CMD_ADC:
+	          switch(wordCount) {
+	           case 2: // word 2 = chip type (MCP3008, MCP3208)
+	            if((adcB = dictSearch(buf, adcType)) < 0) {
+	              if(debug >= 1) {
+	                printf("%s: unknown ADC type '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            }
+	            break;
+	           case 3: // word 3 = SPI device (optional)
+	            strcpy(adcPath, buf);
+	            break;
+	           case 4: // word 4 = scans per second (optional)
+	            if((*endptr) || (arg < 1) || (arg > 10000)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid ADC rate '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              adcR = arg;
+	            }
+	            break;
+	           default:
+	            if(debug >= 1) {
+	              printf("%s: extraneous parameter '%s' (not fatal, "
+		        "continuing)\n", __progname, buf);
+	            }
+	            break;
+	          }
+	          break;
+	         case CMD_AXIS:
+	          switch(wordCount) {
+	           case 2: // word 2 = axis name (X, Y, RX, etc.)
+	            if((axisCode = dictSearch(buf, axisName)) < 0) {
+	              if(debug >= 1) {
+	                printf("%s: unknown axis '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            }
+	            break;
+	           case 3: // word 3 = ADC channel, 0-7
+	            if((*endptr) || (arg < 0) || (arg > 7)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid ADC channel '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              axisChan = arg;
+	            }
+	            break;
+	           default:
+	            if(debug >= 1) {
+	              printf("%s: extraneous parameter '%s' (not fatal, "
+		        "continuing)\n", __progname, buf);
+	            }
+	            break;
+	          }
+	          break;
+	         case CMD_FILTER:
+	          if(wordCount == 2) { // word 2 = ADC channel, 0-7
+	            if((*endptr) || (arg < 0) || (arg > 7)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid ADC channel '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              filtChan = arg;
+	            }
+	          } else if(wordCount <= 5) { // min cutoff, beta, speed cutoff
+	            double d = strtod(buf, &endptr);
+	            if((*endptr) || (d < 0.0) || (d > 1000.0)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid filter parameter '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else {
+	              filtArg[wordCount - 3] = d;
+	            }
+	          } else if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+		      "continuing)\n", __progname, buf);
 	          }
 	          break;
-	         case CMD_IRQ:
-	          switch(wordCount) {
-	           case 2: // word 2 = GPIO pin number for IRQ, MUST be 0-31
-	            if((*endptr) || (arg < 0) || (arg > 31)) {
+	         case CMD_GPIOCHIP:
+	          if(wordCount == 2) { // word 2 = I2C addr, 0-7 = 0x20-0x27
+	            // Else must be in a supported chip's range (0x20-0x27,
+	            // 0x38-0x3F): slots go by the low 3 bits alone
+	            for(k=0; (k < N_EXPANDERS) && ((arg < expander[k].base) ||
+	              (arg > expander[k].base + 7)); k++);
+	            if((*endptr) || (arg < 0) || ((arg > 7) &&
+	              (k >= N_EXPANDERS))) {
 	              if(debug >= 1) {
-	                printf("%s: invalid pin '%s' (not fatal, "
+	                printf("%s: invalid I2C address '%s' (not fatal, "
 		          "continuing)\n", __progname, buf);
 	              }
 	            } else {
-	              mcpPin = pinRemap(arg); // Handle early Pi boards
+	              if(arg < 8) arg += 0x20;
+	              if((chipMask & (1 << (arg & 7))) &&
+	                (chipAddr[arg & 7] != arg)) {
+	                if(debug >= 1) { // e.g. 0x21 and 0x39: pins 48-63
+	                  printf("%s: expander 0x%02X pins already used by "
+	                    "0x%02X (not fatal, continuing)\n", __progname,
+	                    arg, chipAddr[arg & 7]);
+	                }
+	              } else {
+	                mcpAddr = arg;
+	              }
 	            }
-	            break;
-	           case 3: // word 3 = I2C addr, must be 0-7 or 0x20-0x27
-	            if((*endptr) || (arg < 0) || (arg > 0x27) ||
-	              ((arg > 7) && (arg < 0x20))) {
+	          } else if((wordCount == 3) && (mcpAddr >= 0)) {
+	            // word 3 (optional) = GPIO chip device
+	            snprintf(chipNode[mcpAddr & 7], sizeof(chipNode[0]),
+	              "%s", buf);
+	          } else if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+	              "continuing)\n", __progname, buf);
+	          }
+	          break;
+	         case CMD_EVDEV:
+	          if(wordCount == 2) { // word 2 = device path
+	            for(evSrc=0; (evSrc < nEvdev) &&
+	              strcmp(buf, evPath[evSrc]); evSrc++);
+	            if(evSrc == nEvdev) { // New source
+	              if(nEvdev < N_EVDEV) {
+	                strcpy(evPath[nEvdev++], buf);
+	              } else {
+	                evSrc = -1;
+	                if(debug >= 1) {
+	                  printf("%s: too many input devices, '%s' ignored "
+	                    "(not fatal, continuing)\n", __progname, buf);
+	                }
+	              }
+	            }
+	          } else if(wordCount & 1) { // words 3, 5... = event code
+	            if((evCode = evdevCode(buf, &evDir)) < 0) {
 	              if(debug >= 1) {
-	                printf("%s: invalid I2C address '%s' (not fatal, "
+	                printf("%s: unknown input code '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            }
+	          } else { // words 4, 6... = pin number
+	            if((*endptr) || (arg < EV_PIN0) ||
+	              (arg >= EV_PIN0 + N_EVPINS)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid input pin '%s' (not fatal, "
+		          "continuing)\n", __progname, buf);
+	              }
+	            } else if((evSrc >= 0) && (evCode >= 0)) {
+	              evPin[arg - EV_PIN0].src  = evSrc;
+	              evPin[arg - EV_PIN0].dir  = evDir;
+	              evPin[arg - EV_PIN0].code = evCode;
+	              if(debug >= 2) {
+	                printf("%s: input '%s' code %d%s assigned pin %d\n",
+	                  __progname, evPath[evSrc], evCode,
+	                  (evDir < 0) ? "-" : (evDir > 0) ? "+" : "", arg);
+	              }
+	            }
+	            evCode = -1;
+	          }
+	          break;
+	         case CMD_HID:
+	          if(wordCount == 2) { // word 2 = USB device controller
+	            snprintf(hidUdc, sizeof(hidUdc), "%s", buf);
+	          } else if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+		      "continuing)\n", __progname, buf);
+	          }
+	          break;
+	         case CMD_AFFINITY:
+	          if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+		      "continuing)\n", __progname, buf);
+	          }
+	          break;
+	         case CMD_HEALTH:
+	          if(wordCount == 2) { // word 2 = stats file
+	            snprintf(healthPath, sizeof(healthPath), "%s", buf);
+	          } else if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+		      "continuing)\n", __progname, buf);
+	          }
+	          break;
+	         case CMD_RUN:
+	          if(wordCount == 2) { // word 2 = hold time, milliseconds
+	            if(nRun >= N_RUN) {
+	              if(debug >= 1) {
+	                printf("%s: too many RUN commands (not fatal, "
+	                  "continuing)\n", __progname);
+	              }
+	            } else if((*endptr) || (arg < 0) || (arg > 60000)) {
+	              if(debug >= 1) {
+	                printf("%s: invalid hold time '%s' (not fatal, "
 		          "continuing)\n", __progname, buf);
 	              }
 	            } else {
-	              mcpAddr = (arg < 0x20) ? (arg + 0x20) : arg;
+	              rb      = &runs[nRun];
+	              runHold = arg;
+	              runLen  = 0;
+	              memset(rb, 0, sizeof(runBind));
 	            }
-	            break;
-	           default:
+	          } else if(runHold < 0) {
+	            // Skip rest of a bad line
+	          } else if(!rb->nArgs && !(*endptr) &&
+	            (arg >= 0) && (arg < N_PINS)) { // Pins, up to program
+	            arg = pinRemap(arg);
+	            pinMask[arg/32] |= (1U << (arg&31));
+	          } else if((rb->nArgs < RUN_WORDS) &&
+	            (runLen + stringLen < sizeof(rb->args))) { // Command
+	            memcpy(&rb->args[runLen], buf, stringLen + 1);
+	            runLen += stringLen + 1;
+	            rb->nArgs++;
+	          } else {
 	            if(debug >= 1) {
-	              printf("%s: extraneous parameter '%s' (not fatal, "
-		        "continuing)\n", __progname, buf);
+	              printf("%s: RUN command too long (not fatal, "
+	                "continuing)\n", __progname);
 	            }
-	            break;
+	            runHold = -1;
 	          }
 	          break;
-	         case CMD_DEBUG:
-	          if((*endptr) || (arg < 0) || (arg > 3)) {
-	            if(debug >= 1) {
-	              printf("%s: invalid debug level '%s' "
-	                "(not fatal, continuing)\n", __progname, buf);
+	         case CMD_ORDER:
+	          if(wordCount == 2) { // word 2 = FRAME, SPLIT or SPACED
+	            if(((ord = dictSearch(buf, orderName)) < 0) &&
+	              (debug >= 1)) {
+	              printf("%s: unknown order '%s' (not fatal, "
+		        "continuing)\n", __progname, buf);
 	            }
-	          } else {
-	            dLevel = arg;
+	          } else if(debug >= 1) {
+	            printf("%s: extraneous parameter '%s' (not fatal, "
+		      "continuing)\n", __progname, buf);
 	          }
 	          break;
 	         default:
@@ -516,15 +3151,15 @@ static void pinConfigLoad() {
 	      switch(cmd) {
 	       case CMD_KEY:
 	        // Count number of pins on line (k)
-	        for(k=i=0; i<160; i++) {
-	          if(pinMask[i/32] & (1 << (i&31))) {
+	        for(k=i=0; i<N_PINS; i++) {
+	          if(pinMask[i/32] & (1U << (i&31))) {
 	            k++;
 	            // Un-assign any pins previously assigned GND.
 	            if(key[i] == GND) key[i] = KEY_RESERVED;
 	          }
 		}
 	        if(k == 1) { // Key assigned to one pin
-	          for(i=0; !(pinMask[i/32] & (1<<(i&31))); i++); // Find bit
+	          for(i=0; !(pinMask[i/32] & (1U<<(i&31))); i++); // Find bit
 	          key[i] = keyCode;
 	          if(debug >= 2) {
 	            printf("%s: virtual key %d assigned to GPIO%02d\n",
@@ -532,30 +3167,53 @@ static void pinConfigLoad() {
 	          }
 	        } else if(k > 1) {
 	          memcpy(vulcanMask, pinMask, sizeof(pinMask));
-	          key[160] = keyCode;
+	          key[VULCAN] = keyCode;
 	          if(debug >= 2) {
-	            printf("%s: virtual key %d has GPIO bitmask "
-	              "%04X%04X%04X%04X%04X\n", __progname, key[160],
-	              vulcanMask[4], vulcanMask[3], vulcanMask[2],
-	              vulcanMask[1], vulcanMask[0]);
+	            printf("%s: virtual key %d has GPIO bitmask ",
+	              __progname, key[VULCAN]);
+	            printMask(vulcanMask);
 	          }
 	        }
 	        break;
 	       case CMD_IRQ:
 	        if((mcpPin >= 0) && (mcpAddr >= 0)) { // Got all params?
+	          const expDriver *d = &expander[mcpType];
+	          if(mcpAddr < 8) mcpAddr += d->base;
+	          if((mcpAddr < d->base) || (mcpAddr > d->base + 7)) {
+	            if(debug >= 1) {
+	              printf("%s: %s address must be 0x%02X-0x%02X (not "
+	                "fatal, continuing)\n", __progname, d->name, d->base,
+	                d->base + 7);
+	            }
+	          } else {
+	            if(debug >= 2) {
+	              printf("%s: %s on GPIO%02d, I2C address 0x%02X\n",
+	                __progname, d->name, mcpPin, mcpAddr);
+	            }
+	            mcpI2C[mcpPin] = mcpAddr; // GPIO pin # to I2C address
+	            mcpChip[mcpAddr & 7] = mcpType; // Slot's driver
+	            mcpMask |= 1ULL << mcpPin;
+	          }
+	        }
+	        mcpPin = mcpAddr = -1;
+	        mcpType = 0;
+	        break;
+	       case CMD_GPIOCHIP:
+	        if(mcpAddr >= 0) {
 	          if(debug >= 2) {
-	            printf("%s: MCP23017 on GPIO%02d, I2C address 0x%02X\n",
-	              __progname, mcpPin, mcpAddr);
+	            printf("%s: expander 0x%02X pins %d-%d via kernel driver\n",
+	              __progname, mcpAddr, 32 + (mcpAddr & 7) * 16,
+	              47 + (mcpAddr & 7) * 16);
 	          }
-	          mcpI2C[mcpPin] = mcpAddr; // GPIO pin # to I2C address
-	          mcpMask |= (1 << mcpPin);
-	          mcpPin = mcpAddr = -1;
+	          chipAddr[mcpAddr & 7] = mcpAddr;
+	          chipMask |= 1 << (mcpAddr & 7);
+	          mcpAddr   = -1;
 	        }
 	        break;
 	       case CMD_GND:
 	        // One or more GND pins
-	        for(i=0; i<160; i++) {
-	          if(pinMask[i/32] & (1 << (i&31))) {
+	        for(i=0; i<N_PINS; i++) {
+	          if(pinMask[i/32] & (1U << (i&31))) {
 	            key[i] = GND;
 	            if(debug >= 2) {
 	              printf("%s: GPIO%02d assigned GND\n", __progname, i);
@@ -563,11 +3221,11 @@ static void pinConfigLoad() {
 	          }
 	        }
 	        // Clear any vulcanMask bits that are now GNDs
-	        for(i=k=0; i<5; i++) {
+	        for(i=k=0; i<N_WORDS; i++) {
 	          vulcanMask[i] &= ~pinMask[i];
 	          if(vulcanMask[i]) k = 1;
 	        }
-	        if(!k) key[160] = KEY_RESERVED; // All vulcan bits clobbered
+	        if(!k) key[VULCAN] = KEY_RESERVED; // All vulcan bits clobbered
 	        break;
 	       case CMD_DEBUG:
 	        if(debug || (dLevel > 0)) {
@@ -575,6 +3233,81 @@ static void pinConfigLoad() {
 	        }
 	        debug = dLevel;
 	        break;
+	       case CMD_ADC:
+	        if(adcB > 0) {
+	          adcBits = adcB;
+	          if(adcR) adcRate = adcR;
+	          if(debug >= 2) {
+	            printf("%s: %d-bit ADC on %s, %d scans/sec\n",
+	              __progname, adcBits, adcPath, adcRate);
+	          }
+	        }
+	        adcB = -1;
+	        adcR = 0;
+	        break;
+	       case CMD_AXIS:
+	        if((axisCode >= 0) && (axisChan >= 0)) { // Got all params?
+	          adcAxis[axisChan] = axisCode;
+	          if(debug >= 2) {
+	            printf("%s: ADC channel %d assigned axis %d\n",
+	              __progname, axisChan, axisCode);
+	          }
+	        }
+	        axisCode = axisChan = -1;
+	        break;
+	       case CMD_FILTER:
+	        if(filtChan >= 0) {
+	          // Min cutoff 0 turns the filter off for this channel
+	          adcFilter[filtChan].minCut = filtArg[0] * 1000.0;
+	          adcFilter[filtChan].beta   = filtArg[1] * 1000.0;
+	          adcFilter[filtChan].dCut   = filtArg[2] * 1000.0;
+	          if(debug >= 2) {
+	            printf("%s: ADC channel %d filter %g Hz, beta %g, "
+	              "speed cutoff %g Hz\n", __progname, filtChan,
+	              filtArg[0], filtArg[1], filtArg[2]);
+	          }
+	        }
+	        filtChan   = -1;
+	        filtArg[0] = FILTER_MINCUT;
+	        filtArg[1] = FILTER_BETA;
+	        filtArg[2] = FILTER_DCUT;
+	        break;
+	       case CMD_AFFINITY:
+	        irqTune = true;
+	        break;
+	       case CMD_HID:
+	        hidOn = true;
+	        break;
+	       case CMD_HEALTH:
+	        if(!healthPath[0]) strcpy(healthPath, HEALTH_FILE);
+	        break;
+	       case CMD_RUN:
+	        for(i=k=0; i<N_WORDS; i++) {
+	          if(pinMask[i]) k = 1;
+	        }
+	        if((runHold >= 0) && k && rb->nArgs) { // Got all params?
+	          memcpy(rb->mask, pinMask, sizeof(pinMask));
+	          rb->hold = runHold;
+	          for(i=0; i<N_WORDS; i++) runMask[i] |= pinMask[i];
+	          nRun++;
+	          if(debug >= 2) {
+	            printf("%s: command '%s' after %d ms on GPIO bitmask ",
+	              __progname, rb->args, runHold);
+	            printMask(pinMask);
+	          }
+	        }
+	        runHold = -1;
+	        break;
+	       case CMD_ORDER:
+	        if(ord >= 0) {
+	          order = ord;
+	          if(debug >= 2) {
+	            printf("%s: output order %s\n", __progname,
+	              orderName[ord].name);
+	          }
+	        }
+	        ord = -1;
+	        break;
 	       default:
 	        break;
 	      }
@@ -617,238 +3350,389 @@ static void pinConfigLoad() {
 
 	// Set up GPIO -----------------------------------------------------
 
-	bitmask = vulcanMask[0] | mcpMask;
-	for(i=0; i<32; i++) {
-		if((key[i] > KEY_RESERVED) && (key[i] < GND))
-			bitmask |= (1 << i);
-	}
+	bitmask = gpioInputs();
+	if(gpioUsed() && !gpio) err("Can't access GPIO (/dev/mem)");
 	pull(bitmask, 2); // Enable pullups on input pins
-	for(i=0; (i<5) && !vulcanMask[i]; i++); // If no vulcanMask bits,
-	if(i >= 5) key[160] = KEY_RESERVED;     // make sure no vulcanKey
+	for(i=0; (i<N_WORDS) && !vulcanMask[i]; i++); // If no vulcanMask bits,
+	if(i >= N_WORDS) key[VULCAN] = KEY_RESERVED;  // make sure no vulcanKey
 	// Pullups on MCP23017 devices will be a separate pass later
 
-	// All other GPIO config is handled through the sysfs interface.
+	// Native pins, uinput and port expanders each depend on a device
+	// node that early in boot may not exist yet (driver or module not
+	// loaded); each is brought up now if it can be, else as soon as
+	// its node appears in /dev.
+	if(gpioUsed()) devOpen(DEV_GPIO);
 
-	sprintf(buf, "%s/export", sysfs_root);
-	if((fd = open(buf, O_WRONLY)) < 0) // Open Sysfs export file
-		err("Can't open GPIO export file");
-	intstate[0] = 0;
-	for(i=0; i<32; i++) {
-		if((key[i] == KEY_RESERVED) && !(bitmask & (1<<i)))
-			continue;
-		sprintf(buf, "%d", i);
-		write(fd, buf, strlen(buf));    // Export pin
-		pinSetup(i, "active_low", "0"); // Don't invert
-		if(key[i] >= GND) {
-			// Set pin to output, value 0 (ground)
-			if(pinSetup(i, "direction", "out") ||
-			   pinSetup(i, "value"    , "0"))
-				err("Pin config failed (GND)");
-		} else {
-			// Set pin to input, detect edge events
-			char x;
-			// Plain GPIOs: detect both RISING and FALLING
-			// edges.  Port expanders: detect FALLING only.
-			if(pinSetup(i, "direction", "in") ||
-			   pinSetup(i, "edge",
-			    (mcpMask & (1<<i)) ? "falling" : "both")) {
-				err("Pin config failed");
-			}
-			// Get initial pin value.  This is for plain GPIOs
-			// only; MCP23017 will be a separate pass later.
-			sprintf(buf, "%s/gpio%d/value", sysfs_root, i);
-			if((p[i].fd = open(buf, O_RDONLY | O_NONBLOCK)) < 0)
-				err("Can't access pin value");
-			if((read(p[i].fd, &x, 1) == 1) && (x == '0'))
-				intstate[0] |= 1 << i;
-			p[i].events  = POLLPRI | POLLERR | POLLHUP | POLLNVAL;
-			p[i].revents = 0;
-		}
+	adcOpen();
+	evdevOpen();
+	if(hidOn) hidOpen();
+
+	if(hidFd < 0) devOpen(DEV_UINPUT); // Unless output is to USB HID
+	if(mcpMask)   devOpen(DEV_I2C);
+	if(chipMask)  devOpen(DEV_CHIP);
+
+	if(irqTune) irqAffinity();
+	if(healthPath[0]) healthOpen();
+
+	memcpy(extstate, intstate, sizeof(extstate));
+}
+
+// Live upgrade ------------------------------------------------------------
+
+// Globals carried across a live re-exec.  Any change here (or to their
+// sizes) changes the state layout; sizes are checked, but bump STATE_VER
+// for changes that keep the total size.
+static const struct {
+	void   *ptr;
+	size_t  size;
+} stateVars[] = {
+	{ &debug       , sizeof(debug)        },
+	{ &startupDebug, sizeof(startupDebug) },
+	{ key          , sizeof(key)          },
+	{ intstate     , sizeof(intstate)     },
+	{ extstate     , sizeof(extstate)     },
+	{ edgeTime     , sizeof(edgeTime)     },
+	{ edgeLast     , sizeof(edgeLast)     },
+	{ edgeCount    , sizeof(edgeCount)    },
+	{ healthPath   , sizeof(healthPath)   },
+	{ runs         , sizeof(runs)         },
+	{ &nRun        , sizeof(nRun)         },
+	{ runMask      , sizeof(runMask)      },
+	{ &runNext     , sizeof(runNext)      },
+	{ &runDrops    , sizeof(runDrops)     },
+	{ &order       , sizeof(order)        },
+	{ seq          , sizeof(seq)          },
+	{ &nSeq        , sizeof(nSeq)         },
+	{ &seqPos      , sizeof(seqPos)       },
+	{ &seqBase     , sizeof(seqBase)      },
+	{ vulcanMask   , sizeof(vulcanMask)   },
+	{ &mcpMask     , sizeof(mcpMask)      },
+	{ &devWait     , sizeof(devWait)      },
+	{ mcpI2C       , sizeof(mcpI2C)       },
+	{ mcpChip      , sizeof(mcpChip)      },
+	{ &chipMask    , sizeof(chipMask)     },
+	{ chipAddr     , sizeof(chipAddr)     },
+	{ chipNode     , sizeof(chipNode)     },
+	{ i2cfd        , sizeof(i2cfd)        },
+	{ &keyfd1      , sizeof(keyfd1)       },
+	{ &keyfd2      , sizeof(keyfd2)       },
+	{ &keyfd       , sizeof(keyfd)        },
+	{ &adcFd       , sizeof(adcFd)        },
+	{ &adcRate     , sizeof(adcRate)      },
+	{ &adcBits     , sizeof(adcBits)      },
+	{ &adcN        , sizeof(adcN)         },
+	{ adcChan      , sizeof(adcChan)      },
+	{ adcAxis      , sizeof(adcAxis)      },
+	{ adcValue     , sizeof(adcValue)     },
+	{ adcFilter    , sizeof(adcFilter)    },
+	{ adcTx        , sizeof(adcTx)        },
+	{ adcXfer      , sizeof(adcXfer)      },
+	{ &adcStub     , sizeof(adcStub)      },
+	{ adcPath      , sizeof(adcPath)      },
+	{ evPin        , sizeof(evPin)        },
+	{ evPath       , sizeof(evPath)       },
+	{ &nEvdev      , sizeof(nEvdev)       },
+	{ outQ         , sizeof(outQ)         },
+	{ &outHead     , sizeof(outHead)      },
+	{ &outTail     , sizeof(outTail)      },
+	{ &outPart     , sizeof(outPart)      },
+	{ &outMax      , sizeof(outMax)       },
+	{ &outRetries  , sizeof(outRetries)   },
+	{ &outDrops    , sizeof(outDrops)     },
+	{ p            , sizeof(p)            },
+	{ irqs         , sizeof(irqs)         },
+	{ &nIrqs       , sizeof(nIrqs)        },
+	{ &irqTune     , sizeof(irqTune)      },
+	{ &hidOn       , sizeof(hidOn)        },
+	{ hidUdc       , sizeof(hidUdc)       },
+	{ &hidFd       , sizeof(hidFd)        },
+	{ &hidKbd      , sizeof(hidKbd)       },
+	{ &hidIds      , sizeof(hidIds)       },
+	{ &hidBtns     , sizeof(hidBtns)      },
+	{ &nHidAxes    , sizeof(nHidAxes)     },
+	{ hidAxisCode  , sizeof(hidAxisCode)  },
+	{ hidLen       , sizeof(hidLen)       },
+	{ hidAxis      , sizeof(hidAxis)      },
+	{ hidDown      , sizeof(hidDown)      },
+	{ hidLatch     , sizeof(hidLatch)     },
+	{ hidSent      , sizeof(hidSent)      },
+	{ &hidDirty    , sizeof(hidDirty)     },
+	{ &hidLast     , sizeof(hidLast)      },
+	{ &hidReports  , sizeof(hidReports)   },
+	{ &hidRetries  , sizeof(hidRetries)   },
+	{ &hidErrors   , sizeof(hidErrors)    },
+	{ NULL         , 0                    } };
+
+// Is poll() slot i one that each instance sets up for itself?
+static bool stateOwnSlot(int i) {
+	return (i == PFD_SIGNAL) || (i == PFD_CFGFILE) || (i == PFD_CFGDIR);
+}
+
+// List open descriptors into fds[] (room for N_PFD + 12), each once;
+// all = false leaves out the stateOwnSlot() ones.  Returns count.
+static int ownFds(int *fds, bool all) {
+	int i, n = 0;
+	if(keyfd1 >= 0) fds[n++] = keyfd1;
+	if(keyfd2 >= 0) fds[n++] = keyfd2;
+	if(adcFd  >= 0) fds[n++] = adcFd;
+	if(hidFd  >= 0) fds[n++] = hidFd;
+	for(i=0; i<8; i++) {
+		if(i2cfd[i] > 0) fds[n++] = i2cfd[i];
 	}
-	close(fd); // Done w/Sysfs exporting
+	for(i=0; i<N_PFD; i++) { // (PFD_OUT is keyfd or hidFd again)
+		if((p[i].fd >= 0) && (all || !stateOwnSlot(i)) &&
+		   (i != PFD_OUT)) fds[n++] = p[i].fd;
+	}
+	return n;
+}
 
-	// Set up uinput
+// Re-execute program binary (live upgrade, SIGUSR2).  State goes to an
+// in-memory file: header (magic, version, descriptor list, state size)
+// then the stateVars[] in order.  Descriptors stay open across exec()
+// except the signalfd and inotify ones, which are flagged close-on-exec
+// and recreated by the new instance.  Returns only if exec() fails, in
+// which case this instance simply carries on.
+static void reExec(void) {
+	uint32_t hdr[4], size = 0;
+	int      fd, i, fds[N_PFD + 12], nFds;
+	char     str[16];
 
-	// Attempt to create uidev virtual keyboard
-	if((keyfd1 = open("/dev/uinput", O_WRONLY | O_NONBLOCK)) >= 0) {
-		(void)ioctl(keyfd1, UI_SET_EVBIT, EV_KEY);
-		for(i=0; i<161; i++) {
-			if((key[i] >= KEY_RESERVED) && (key[i] < GND))
-				(void)ioctl(keyfd1, UI_SET_KEYBIT, key[i]);
-		}
-		struct uinput_user_dev uidev;
-		memset(&uidev, 0, sizeof(uidev));
-		snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "retrogame");
-		uidev.id.bustype = BUS_USB;
-		uidev.id.vendor  = 0x1;
-		uidev.id.product = 0x1;
-		uidev.id.version = 1;
-		if(write(keyfd1, &uidev, sizeof(uidev)) < 0)
-			err("write failed");
-		if(ioctl(keyfd1, UI_DEV_CREATE) < 0)
-			err("DEV_CREATE failed");
-		if(debug >= 3) printf("%s: uidev init OK\n", __progname);
+	outFlush(); // Anything left is carried over in outQ[]
+
+	// Collect descriptors to hand over (a list any build can parse,
+	// so an incompatible successor can still close them)
+	nFds = ownFds(fds, false);
+	for(i=0; stateVars[i].ptr; i++) size += stateVars[i].size;
+
+	if((fd = memfd_create("retrogame-state", 0)) < 0) {
+		if(debug >= 1) printf("%s: can't create upgrade state\n",
+		  __progname);
+		return;
 	}
+	hdr[0] = STATE_MAGIC;
+	hdr[1] = STATE_VER;
+	hdr[2] = nFds;
+	hdr[3] = size;
+	write(fd, hdr, sizeof(hdr));
+	write(fd, fds, nFds * sizeof(fds[0]));
+	for(i=0; stateVars[i].ptr; i++)
+		write(fd, stateVars[i].ptr, stateVars[i].size);
+	lseek(fd, 0, SEEK_SET);
 
-	// SDL2 (used by some newer emulators) wants /dev/input/eventX
-	// instead -- BUT -- this only exists if there's a physical USB
-	// keyboard attached or if the above code has run and created a
-	// virtual keyboard.  On older systems this method doesn't apply,
-	// events can be sent to the keyfd1 virtual keyboard above...so,
-	// this code looks for an eventX device and (if present) will use
-	// that as the destination for events, else fallback on keyfd1.
+	for(i=0; i<N_PFD; i++) {
+		if(stateOwnSlot(i) && (p[i].fd >= 0))
+			fcntl(p[i].fd, F_SETFD, FD_CLOEXEC);
+	}
+	sprintf(str, "%d", fd);
+	setenv(STATE_ENV, str, 1);
+	if(debug >= 2) printf("%s: re-executing %s\n", __progname, execPath);
+	fflush(stdout);
+	execv(execPath, progArgv);
 
-	// The 'X' in eventX is a unique identifier (typically a numeric
-	// digit or two) for each input device, dynamically assigned as
-	// USB input devices are plugged in or disconnected (or when the
-	// above code runs, creating a virtual keyboard).  As it's
-	// dynamically assigned, we can't rely on a fixed number -- it
-	// will vary if there's a keyboard connected at startup.
+	// Still here?  exec() failed, keep running as before
+	if(debug >= 1) printf("%s: can't re-execute '%s'\n", __progname,
+	  execPath);
+	unsetenv(STATE_ENV);
+	close(fd);
+	for(i=0; i<N_PFD; i++) {
+		if(stateOwnSlot(i) && (p[i].fd >= 0))
+			fcntl(p[i].fd, F_SETFD, 0);
+	}
+}
 
-	struct dirent **namelist;
-	int             n;
-	char            evName[100] = "";
+// If this instance was started by reExec(), adopt the previous one's
+// state and descriptors.  Returns true if adopted; false for a normal
+// start.  If the state is from an incompatible build, its descriptors
+// are closed (which destroys the old virtual device) and false returned.
+static bool stateLoad(void) {
+	struct pollfd own[N_PFD];
+	uint32_t      hdr[4], size = 0;
+	int           fd, i, fds[N_PFD + 12];
+	uint64_t      levels;
+	char          c, *env = getenv(STATE_ENV);
 
-	if((n = scandir("/sys/devices/virtual/input",
-	  &namelist, filter1, NULL)) > 0) {
-		// Got a list of device(s).  In theory there should
-		// be only one that makes it through the filter (name
-		// matches retrogame)...if there's multiples, only
-		// the first is used.  (namelist can then be freed)
-		char path[100];
-		sprintf(path, "/sys/devices/virtual/input/%s",
-		  namelist[0]->d_name);
-		for(i=0; i<n; i++) free(namelist[i]);
-		free(namelist);
-		// Within the given device path should be a subpath with
-		// the name 'eventX' (X varies), again theoretically
-		// should be only one, first in list is used.
-		if((n = scandir(path, &namelist, filter2, NULL)) > 0) {
-			sprintf(evName, "/dev/input/%s",
-			  namelist[0]->d_name);
-			for(i=0; i<n; i++) free(namelist[i]);
-			free(namelist);
-		}
+	if(!env) return false;
+	fd = atoi(env);
+	unsetenv(STATE_ENV);
+
+	for(i=0; stateVars[i].ptr; i++) size += stateVars[i].size;
+	if((read(fd, hdr, sizeof(hdr)) != sizeof(hdr)) ||
+	   (hdr[0] != STATE_MAGIC) || (hdr[2] > (N_PFD + 12)) ||
+	   (read(fd, fds, hdr[2] * sizeof(fds[0])) !=
+	    (int)(hdr[2] * sizeof(fds[0])))) {
+		close(fd);
+		return false;
+	}
+	if((hdr[1] != STATE_VER) || (hdr[3] != size)) {
+		if(debug >= 1) printf("%s: previous state incompatible, "
+		  "starting afresh\n", __progname);
+		for(i=0; i<hdr[2]; i++) close(fds[i]);
+		close(fd);
+		return false;
 	}
 
-	if(!evName[0]) { // Nothing found?  Use fallback method...
-		// Kinda lazy skim for last item in /dev/input/event*
-		// This is NOT guaranteed to be retrogame, but if the
-		// above method fails for some reason, this may be
-		// adequate.  If there's a USB keyboard attached at
-		// boot, it usually instantiates in /dev/input before
-		// retrogame, so even if it's then removed, the index
-		// assigned to retrogame stays put...thus the last
-		// index mmmmight be what we need.
-		struct stat st;
-		for(i=99; i>=0; i--) {
-			sprintf(buf, "/dev/input/event%d", i);
-			if(!stat(buf, &st)) break; // last valid device
+	memcpy(own, p, sizeof(own)); // Keep this instance's signal, etc.
+	for(i=0; stateVars[i].ptr; i++)
+		read(fd, stateVars[i].ptr, stateVars[i].size);
+	close(fd);
+	for(i=0; i<N_PFD; i++) {
+		if(stateOwnSlot(i)) p[i] = own[i];
+		p[i].revents = 0;
+	}
+	for(i=0; i<adcN; i++) { // Buffer addresses differ in new image
+		adcXfer[i].tx_buf = (uintptr_t)adcTx[i];
+		adcXfer[i].rx_buf = (uintptr_t)adcRx[i];
+	}
+
+	// Catch up on native pin changes during the handover (expander
+	// and input device changes are still pending on their descriptors).
+	// All at once from the level registers if mapped, else via Sysfs.
+	levels = gpioLevels();
+	for(i=0; i<N_GPIO; i++) {
+		if((p[i].fd < 0) || mcpI2C[i]) continue;
+		if(gpio && (!rp1 || (i < RP1_N_GPIO))) {
+			pinSet(gpioPin(i), !(levels & (1ULL << i)));
+			continue;
+		}
+		lseek(p[i].fd, 0, SEEK_SET);
+		if(read(p[i].fd, &c, 1) == 1) {
+			if(c == '0')      pinSet(gpioPin(i), true);
+			else if(c == '1') pinSet(gpioPin(i), false);
 		}
-		strcpy(evName, (i >= 0) ? buf : "/dev/input/event0");
 	}
 
-	keyfd2 = open(evName, O_WRONLY | O_NONBLOCK);
-	keyfd  = (keyfd2 >= 0) ? keyfd2 : keyfd1;
-	// keyfd1 and 2 are global and are held open (as a destination for
-	// key events) until pinConfigUnload() is called.
-	if((debug >= 3) && keyfd2) printf("%s: SDL2 init OK\n", __progname);
+	if(debug >= 1) printf("%s: adopted state of previous instance\n",
+	  __progname);
+	return true;
+}
 
-	// Configure MCP23017 port expander(s)
-
-	uint8_t  cfg1[] = { 0x05  , 0x00 }, // If bank 1, switch to 0
-	         cfg2[] = { IOCONA, 0x44 }, // Bank 0, INTB=A, seq, OD IRQ
-	         cfg3[23];                  // Read-modify-write chip cfg
-	uint16_t inputMask, gndMask;
-
-	if(mcpMask) { // Any port expanders mentioned in config?
-	  for(i=0; i<8; i++) { // 8 possible MCP23017 indices
-	    uint8_t j;
-	    inputMask = gndMask = 0; // Bitmasks of keys, gnds on this device
-	    for(j=0; j<16; j++) { // 16 bits per MCP
-	      k = key[32 + i * 16 + j];
-	      if(k == GND)              gndMask   |= (1 << j);
-	      else if(k > KEY_RESERVED) inputMask |= (1 << j);
-	    }
+// Command actions ---------------------------------------------------------
 
-	    if(inputMask || gndMask) { // Referenced in config?
-	      // Each MCP23017 is assigned a separate file descriptor;
-	      // each bonded once to a specific I2C address (via ioctl)
-	      // so that the ioctl isn't required for every transaction.
-	      if((i2cfd[i] = open("/dev/i2c-1", O_RDWR | O_NONBLOCK)) > 0) {
-	        ioctl(i2cfd[i], I2C_SLAVE, 0x20 + i);
-	        // Configure chip as we need it (sequential addr, etc.).
-	        // This does mean any other application also using the
-	        // chip might be clobbered if it uses a different config.
-	        write(i2cfd[i], cfg1, sizeof(cfg1));
-	        write(i2cfd[i], cfg2, sizeof(cfg2));
-	        // Some bits are preserved as best we can...read
-	        // registers, change bits for retrogame, write back.
-	        // This is done in two passes; first one does some
-	        // polarity stuff, second pass sets more and reads state.
-	        cfg3[0] = IODIRA;
-	        write(i2cfd[i], cfg3, 1);
-	        read(i2cfd[i], &cfg3[1], 4); // Read partial config
-	        // Change IODIRA,B bits for inputs & GNDs (leave others)
-	        cfg3[1] = (cfg3[1] |  inputMask      ) &  ~gndMask;
-	        cfg3[2] = (cfg3[2] | (inputMask >> 8)) & ~(gndMask >> 8);
-	        // Set IPOLA,B for inputs+GNDs (polarity matches input logic)
-	        cfg3[3] &= ~( inputMask | gndMask);
-	        cfg3[4] &= ~((inputMask | gndMask) >> 8);
-	        write(i2cfd[i], cfg3, 5); // Write partial config
-	        write(i2cfd[i], cfg3, 1); // Next read is from IODIRA
-	        read(i2cfd[i], &cfg3[1], sizeof(cfg3) - 1); // Read full cfg
-	        // Enable interrupts on input pins (GPINTENA,B)
-	        cfg3[5] |= inputMask;
-	        cfg3[6] |= inputMask >> 8;
-	        // Skip DEFVALA,B
-	        cfg3[9] = cfg3[10] = 0; // INTCONA,B: compre prev pin value
-	        // Skip IOCON (x2)
-	        // Set GPPUA,B bits on input pins
-	        cfg3[13] |= inputMask;
-	        cfg3[14] |= inputMask >> 8;
-	        // Skip INTFA,B, INTCAPA,B, read GPIOA,B into int/extstate[]
-	        int      idx = 1 + i / 2; // Index (1-4) into int/extstate[]
-	        uint8_t  bit;             // Bit to read in GPIOA/B
-	        uint32_t abit, bbit;      // Bit to set in int/ext state
-	        if(i & 1) {               // In upper half of int/ext state
-	          abit = 0x00800000;
-	          bbit = 0x80000000;
-	        } else {                  // In lower half
-	          abit = 0x00000080;
-	          bbit = 0x00008000;
-	        }
-	        for(bit=0x80; bit; bit >>= 1, abit >>= 1, bbit >>= 1) {
-	          // Invert logic; set bits in intstate[] are buttons
-	          // pressed, while set bits in config are pulled up.
-	          if(cfg3[19] & bit) intstate[idx] &= ~abit;
-	          else               intstate[idx] |=  abit;
-	          if(cfg3[20] & bit) intstate[idx] &= ~bbit;
-	          else               intstate[idx] |=  bbit;
-	        }
-	        // Clear OLATA,B bits on GND outputs
-	        cfg3[21] &=  ~gndMask;
-	        cfg3[22] &= ~(gndMask >> 8);
-	        write(i2cfd[i], cfg3, sizeof(cfg3));
-	        // Clear interrupt by reading GPIOA/B+INTCAPA/B
-	        write(i2cfd[i], &readAddr, 1);
-	        read(i2cfd[i], cfg3, 4);
-	      }
-	    }
-	  }
+// RUN binds a program to a pin or chord, run when all its pins have been
+// held for its hold time (once per hold).  It's started with
+// posix_spawnp() -- no shell, and no fork() copying this process -- and
+// reaped on SIGCHLD via the signalfd, so the input loop never waits on
+// it.  Rate limit: one instance of each command at a time, started at
+// most once per RUN_GAP ms; refused starts are counted in runDrops.
+
+// Start command r (time now, msNow()) if the rate limit allows
+static void runStart(runBind *r, int64_t now) {
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t          attr;
+	sigset_t                   none;
+	char                      *argv[RUN_WORDS + 1], *a = r->args;
+	int                        fds[N_PFD + 12], i, n;
+
+	if(r->pid || (r->last && (now - r->last < RUN_GAP))) {
+		runDrops++;
+		if(debug >= 2) printf("%s: '%s' still running or too soon, "
+		  "not started\n", __progname, r->args);
+		return;
 	}
+	for(i=0; i<r->nArgs; i++, a += strlen(a) + 1) argv[i] = a;
+	argv[i] = NULL;
 
-	memcpy(extstate, intstate, sizeof(extstate));
+	// Child gets an empty signal mask (everything is blocked here,
+	// for the signalfd) and none of our descriptors beyond stdio
+	sigemptyset(&none);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+	posix_spawn_file_actions_init(&fa);
+	n = ownFds(fds, true);
+	for(i=0; i<n; i++) posix_spawn_file_actions_addclose(&fa, fds[i]);
+	if((i = posix_spawnp(&r->pid, argv[0], &fa, &attr, argv, environ))) {
+		r->pid = 0;
+		if(debug >= 1) printf("%s: can't run '%s': %s (not fatal, "
+		  "continuing)\n", __progname, argv[0], strerror(i));
+	} else {
+		r->last = now;
+		if(debug >= 2) printf("%s: started '%s', pid %d\n",
+		  __progname, argv[0], r->pid);
+	}
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&attr);
+}
+
+// Check commands at time now (msNow()): settled = at a debounce pass,
+// re-evaluate which chords are held.  Starts those held long enough;
+// returns time the next hold is up (0 = none, for runNext).
+static int64_t runCheck(int64_t now, bool settled) {
+	runBind *r;
+	int64_t  next = 0;
+	int      a, i;
+	for(i=0; i<nRun; i++) {
+		r = &runs[i];
+		if(settled) {
+			for(a=0; (a<N_WORDS) &&
+			  ((intstate[a] & r->mask[a]) == r->mask[a]); a++);
+			if(a < N_WORDS) r->held = 0;   // Chord not held
+			else if(!r->held) r->held = now; // Just completed
+		}
+		if(r->held <= 0) continue; // Not held or already run
+		if(now - r->held >= r->hold) {
+			runStart(r, now);
+			r->held = -1;
+		} else if(!next || (r->held + r->hold < next)) {
+			next = r->held + r->hold;
+		}
+	}
+	return next;
+}
+
+// SIGCHLD: reap finished commands (also any left from a previous config)
+static void runReap(void) {
+	pid_t pid;
+	int   status, i;
+	while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for(i=0; i<nRun; i++) {
+			if(runs[i].pid == pid) runs[i].pid = 0;
+		}
+		if(debug >= 2) printf("%s: pid %d done, status %d\n",
+		  __progname, pid,
+		  WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+	}
 }
 
-// Handle signal events (i=32), config file change events (33) or
-// config directory contents change events (34).
-static void pollHandler(int i) {
+// Handle signal events (PFD_SIGNAL), config file change events (CFGFILE),
+// config directory contents change events (CFGDIR), ADC scan timer ticks
+// (ADC), output device writable (OUT), HID report timer (HID), new device
+// nodes (DEV) or evdev input (EVDEV+).  Returns true if button state
+// changed (begin debounce).
+static bool pollHandler(int i) {
 
-	if(i == 32) { // Signal event
+	if(i >= PFD_EVDEV) { // evdev input source
+		return evdevRead(i - PFD_EVDEV);
+	} else if(i >= PFD_CHIP) { // Kernel-driven expander edges
+		return chipRead(i - PFD_CHIP);
+	} else if(i == PFD_OUT) { // keyfd writable again
+		if(hidFd >= 0) hidSend();
+		else           outFlush();
+	} else if(i == PFD_HID) { // HID report interval elapsed
+		uint64_t ticks;
+		read(p[i].fd, &ticks, sizeof(ticks));
+		hidSend();
+	} else if(i == PFD_ADC) { // ADC scan timer
+		return adcScan();
+	} else if(i == PFD_DEV) { // Awaited device node(s) may have appeared
+		devNode();
+	} else if(i == PFD_SIGNAL) { // Signal event
 		struct signalfd_siginfo info;
 		read(p[i].fd, &info, sizeof(info));
-		if(info.ssi_signo == SIGHUP) { // kill -1 = force reload
+		if(info.ssi_signo == SIGUSR1) { // kill -USR1 = output stats
+			printf("%s: output queue %u now, %u max, %u retries, "
+			  "%u dropped\n", __progname, outHead - outTail, outMax,
+			  outRetries, outDrops);
+			if(hidFd >= 0) printf("%s: HID %u reports, %u retries, "
+			  "%u failed\n", __progname, hidReports, hidRetries,
+			  hidErrors);
+			if(nRun) printf("%s: RUN %u starts refused\n",
+			  __progname, runDrops);
+		} else if(info.ssi_signo == SIGCHLD) { // RUN command finished
+			runReap();
+		} else if(info.ssi_signo == SIGUSR2) { // Live upgrade
+			reExec();
+		} else if(info.ssi_signo == SIGHUP) { // kill -1 = force reload
 			if(debug >= 2) {
 				printf("%s: SIGHUP received; force config "
 				  "reload\n", __progname);
@@ -886,14 +3770,14 @@ static void pollHandler(int i) {
 					printf("%s: Config file removed\n",
 					  __progname);
 				}
-				inotify_rm_watch(p[1].fd, fileWatch);
+				inotify_rm_watch(p[PFD_CFGFILE].fd, fileWatch);
 				// Closing the descriptor turns out to be
 				// important, as removing the watch itself
 				// creates another IN_IGNORED event.
 				// Avoids turtles all the way down.
-				close(p[33].fd);
-				p[33].fd     = -1;
-				p[33].events =  0;
+				close(p[PFD_CFGFILE].fd);
+				p[PFD_CFGFILE].fd     = -1;
+				p[PFD_CFGFILE].events =  0;
 				// Pin config is NOT unloaded...
 				// keep using prior values for now.
 			} else if(ev->mask & IN_MOVED_FROM) {
@@ -905,10 +3789,11 @@ static void pollHandler(int i) {
 						printf("%s: Config file "
 						  "moved out\n", __progname);
 					}
-					inotify_rm_watch(p[33].fd, fileWatch);
-					close(p[33].fd);
-					p[33].fd     = -1;
-					p[33].events =  0;
+					inotify_rm_watch(p[PFD_CFGFILE].fd,
+					  fileWatch);
+					close(p[PFD_CFGFILE].fd);
+					p[PFD_CFGFILE].fd     = -1;
+					p[PFD_CFGFILE].events =  0;
 					// Pin config is NOT unloaded...
 					// keep using prior values for now.
 				} else {
@@ -923,16 +3808,16 @@ static void pollHandler(int i) {
 						printf("%s: Config file "
 						  "moved in\n", __progname);
 					}
-					if(p[33].fd >= 0) { // Existing file?
+					if(p[PFD_CFGFILE].fd >= 0) { // Existing?
 						inotify_rm_watch(
-						  p[33].fd, fileWatch);
-						close(p[33].fd);
+						  p[PFD_CFGFILE].fd, fileWatch);
+						close(p[PFD_CFGFILE].fd);
 					}
-					p[33].fd   = inotify_init();
+					p[PFD_CFGFILE].fd = inotify_init();
 					fileWatch = inotify_add_watch(
-					  p[33].fd, cfgPathname,
+					  p[PFD_CFGFILE].fd, cfgPathname,
 					  IN_MODIFY | IN_IGNORED);
-					p[33].events = POLLIN;
+					p[PFD_CFGFILE].events = POLLIN;
 					pinConfigUnload();
 					pinConfigLoad();
 				} else {
@@ -943,6 +3828,7 @@ static void pollHandler(int i) {
 			bufPos += sizeof(struct inotify_event) + ev->len;
 		}
 	}
+	return false;
 }
 
 
@@ -951,14 +3837,21 @@ static void pollHandler(int i) {
 int main(int argc, char *argv[]) {
 
 	char               c;            // Pin input value ('0'/'1')
-	int                fd,           // For mmap, sysfs
-	                   i,            // Generic counter
-	                   timeout = -1, // poll() timeout
+	int                i,            // Generic counter
+	                   timeout = -1, // Current timeout interval (or -1)
+	                   wait,         // poll() timeout
 	                   lastKey = -1; // Last key down (for repeat)
-	uint32_t           pressMask[5]; // For Vulcan pinch detect
-	struct input_event keyEv, synEv; // uinput events
+	int64_t            now,          // Time at poll() return
+	                   deadline = 0; // When current timeout elapses
+	bool               changed;      // Input state changed this pass
+	uint32_t           pressMask[N_WORDS], // For Vulcan pinch detect
+	                   prev[N_WORDS]; // Pin states before this pass
 	sigset_t           sigset;       // Signal mask
 
+	// Switch health query (see healthReport()) rather than normal run
+	if((argc > 1) && !strcmp(argv[1], "--health"))
+		return healthReport((argc > 2) ? argv[2] : HEALTH_FILE);
+
 	// If in foreground, set max debug level (config may override)
 	if(getpgrp() == tcgetpgrp(STDOUT_FILENO)) startupDebug = debug = 99;
 
@@ -1001,45 +3894,52 @@ int main(int argc, char *argv[]) {
 		printf("%s: Config file is '%s'\n", __progname, cfgPathname);
 	}
 
+	// Binary and arguments for live re-exec (see reExec())
+	progArgv = argv;
+	if((i = readlink("/proc/self/exe", execPath,
+	  sizeof(execPath) - 1)) > 0) execPath[i] = 0;
+	else strcpy(execPath, argv[0]);
+
 	// Catch signals, config file changes ------------------------------
 
 	// Clear all descriptors and GPIO state, init input event structures
 	memset(p, 0, sizeof(p));
-	for(i=0; i<35; i++)  p[i].fd = -1;
-	for(i=0; i<161; i++) key[i] = KEY_RESERVED;
+	for(i=0; i<N_PFD; i++)   p[i].fd = -1;
+	for(i=0; i<=N_PINS; i++) key[i] = KEY_RESERVED;
+	for(i=0; i<8; i++)       adcAxis[i] = -1;
+	for(i=0; i<N_EVPINS; i++) evPin[i].src = -1;
 	memset(intstate  , 0, sizeof(intstate));
 	memset(extstate  , 0, sizeof(extstate));
 	memset(vulcanMask, 0, sizeof(vulcanMask));
 	memset(mcpI2C    , 0, sizeof(mcpI2C));
+	memset(mcpChip   , 0, sizeof(mcpChip));
+	memset(chipNode  , 0, sizeof(chipNode));
 	memset(i2cfd     , 0, sizeof(i2cfd));
-	memset(&keyEv    , 0, sizeof(keyEv));
-	memset(&synEv    , 0, sizeof(synEv));
-	keyEv.type = EV_KEY;
-	synEv.type = EV_SYN;
-	synEv.code = SYN_REPORT;
 	mcpMask    = 0;
+	chipMask   = 0;
 
 	sigfillset(&sigset);
 	sigprocmask(SIG_BLOCK, &sigset, NULL);
-	// pollfd #32 catches signals, so GPIO cleanup on exit is possible
-	p[32].fd     = signalfd(-1, &sigset, 0);
-	p[32].events = POLLIN;
+	// PFD_SIGNAL catches signals, so GPIO cleanup on exit is possible
+	p[PFD_SIGNAL].fd     = signalfd(-1, &sigset, 0);
+	p[PFD_SIGNAL].events = POLLIN;
 
-	// pollfd #33 and #34 will be used for detecting changes in the
-	// config file and its parent directory.  This will let you edit
+	// PFD_CFGFILE and PFD_CFGDIR will be used for detecting changes in
+	// the config file and its parent directory.  This will let you edit
 	// the config and have immediate feedback without needing to kill
 	// the process or reboot the system.
-	for(i=33; i<=34; i++) {
+	for(i=PFD_CFGFILE; i<=PFD_CFGDIR; i++) {
 		p[i].fd     = inotify_init();
 		p[i].events = POLLIN;
 	}
-	fileWatch = inotify_add_watch(p[33].fd, cfgPathname,
+	fileWatch = inotify_add_watch(p[PFD_CFGFILE].fd, cfgPathname,
 	  IN_MODIFY | IN_IGNORED);
-	inotify_add_watch(p[34].fd, cfgPath,
+	inotify_add_watch(p[PFD_CFGDIR].fd, cfgPath,
 	  IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO);
 
-	// p[0-31] are related to GPIO states, and will be reconfigured
-	// each time the config file is loaded.
+	// p[0-31] are related to GPIO states, PFD_ADC to the ADC scan timer
+	// and PFD_EVDEV+ to input devices; these will be reconfigured each
+	// time the config file is loaded.
 
 	// GPIO startup ----------------------------------------------------
 
@@ -1047,26 +3947,33 @@ int main(int argc, char *argv[]) {
 	if(debug & isEarlyPi) {
 		printf("%s: running on Rev1 Pi 1 Board\n", __progname);
 	}
+	rp1 = rp1Detect();
 
 	// Although Sysfs provides solid GPIO interrupt handling, there's
 	// no interface to the internal pull-up resistors (this is by
 	// design, being a hardware-dependent feature).  It's necessary to
 	// grapple with the GPIO configuration registers directly to enable
 	// the pull-ups.  Based on GPIO example code by Dom and Gert van
-	// Loo on elinux.org
-	if((fd = open("/dev/mem", O_RDWR | O_SYNC)) < 0)
-		err("Can't open /dev/mem");
-	gpio = mmap(            // Memory-mapped I/O
-	  NULL,                 // Any adddress will do
-	  BLOCK_SIZE,           // Mapped block length
-	  PROT_READ|PROT_WRITE, // Enable read+write
-	  MAP_SHARED,           // Shared with other processes
-	  fd,                   // File to map
-	  bcm_host_get_peripheral_address() + GPIO_BASE);
-	close(fd);              // Not needed after mmap()
-	if(gpio == MAP_FAILED) err("Can't mmap()");
+	// Loo on elinux.org.  Failure is only fatal once a config uses
+	// native pins; configs with only input device and ADC sources
+	// (e.g. the simulated workload for 'make pgo') run without.  On a
+	// Pi 5 the registers are the RP1's, preferably through its own
+	// gpiomem device (no /dev/mem access needed).
+	if(rp1) {
+		if(!(gpio = gpioMap("/dev/gpiomem0", 0, RP1_MAP_SIZE)))
+			gpio = gpioMap("/dev/mem", RP1_GPIO_BASE, RP1_MAP_SIZE);
+	} else {
+		gpio = gpioMap("/dev/mem", bcm_host_get_peripheral_address() +
+		  GPIO_BASE, BLOCK_SIZE);
+	}
 
-	pinConfigLoad();
+	if(stateLoad()) { // Live upgrade; debounce anything pending
+		timeout  = debounceTime;
+		deadline = msNow() + timeout;
+		if(healthPath[0]) healthOpen(); // Mapping isn't inherited
+	} else {
+		pinConfigLoad();
+	}
 
 	// Main loop -------------------------------------------------------
 
@@ -1080,53 +3987,88 @@ int main(int argc, char *argv[]) {
 	// pretty deep, please excuse the mid-function shift here to
 	// 2-space indenting.
 
+	// Timeouts are tracked as a deadline rather than passed straight to
+	// poll(), as periodic sources (ADC timer) may wake the loop many
+	// times within one debounce or repeat interval.
+
 	while(running) { // Signal handler will set this to 0 to exit
 	  // Wait for IRQ on pin (or timeout for button debounce)
-	  c = 0; // By default, don't issue SYN event
-	  if(poll(p, 35, timeout) > 0) { // If IRQ...
-	    for(i=0; i<32; i++) {  // For each GPIO bit...
+	  c       = 0; // By default, don't issue SYN event
+	  changed = false;
+	  if(timeout < 0) {
+	    wait = -1;
+	  } else {
+	    wait = deadline - msNow();
+	    if(wait < 0) wait = 0;
+	  }
+	  if(seqPos < nSeq) { // ORDER SPACED frame pending; round up to ms
+	    int w = (seqDue(seqPos) - usNow() + 999) / 1000;
+	    if(w < 0) w = 0;
+	    if((wait < 0) || (w < wait)) wait = w;
+	  }
+	  if(runNext) { // RUN hold time pending
+	    int w = runNext - msNow();
+	    if(w < 0) w = 0;
+	    if((wait < 0) || (w < wait)) wait = w;
+	  }
+	  if(poll(p, N_PFD, wait) > 0) { // If IRQ...
+	    wakeTime = usNow(); // Edge time for pins without their own
+	    memcpy(prev, intstate, sizeof(prev));
+	    for(i=0; i<N_GPIO; i++) {  // For each GPIO bit...
 	      if(p[i].revents) { // Event received?
-	        if(mcpI2C[i]) { // Is port expander (0x20-0x27)
-	          uint8_t c, buf[4], idx = mcpI2C[i] - 0x20; // 0-7
+	        if(mcpI2C[i]) { // Is port expander
+	          uint8_t c, idx = mcpI2C[i] & 7; // Address slot 0-7
+	          int     levels;
 	          // Must drain fd every time else it triggers forever
 	          lseek(p[i].fd, 0, SEEK_SET);
 	          while(read(p[i].fd, &c, 1) > 0); // Ignore value
-	          write(i2cfd[idx], &readAddr, 1);
-	          if(read(i2cfd[idx], buf, 4) == 4) { // INTCAP+GPIO
-	            // Buttons pull GPIO low, so invert into intstate[]
-	            uint16_t merged = ~((buf[3] << 8) | buf[2]);
-	            uint8_t  i2     = 1 + idx / 2; // Index of 32-bit state
-	            if(idx & 1) { // Upper half of state
-	              intstate[i2] = (intstate[i2]&0x0000FFFF)|(merged<<16);
-	            } else {      // Lower half of state
-	              intstate[i2] = (intstate[i2]&0xFFFF0000)|merged;
-	            }
-	          }
+	          if((levels = expander[mcpChip[idx]].read(i2cfd[idx])) >= 0)
+	            expState(idx, levels);
 	        } else { // Is regular GPIO
 	          // Read current pin state, store in internal state flag,
 	          // flag, but don't issue to uinput yet -- must debounce!
 	          lseek(p[i].fd, 0, SEEK_SET);
 	          read(p[i].fd, &c, 1);
-	          if(c == '0')      intstate[0] |=  (1 << i);
-	          else if(c == '1') intstate[0] &= ~(1 << i);
+	          // An IRQ with no change of level means edges in pairs,
+	          // too quick to see (bounce); counted for switch health.
+	          if(((c == '0') || (c == '1')) &&
+	             !pinSet(gpioPin(i), c == '0')) {
+	            edgeNote(gpioPin(i), wakeTime);
+	            edgeNote(gpioPin(i), wakeTime);
+	          }
 	        }
-	        timeout      = debounceTime;
+	        changed      = true;
 	        p[i].revents = 0;
 	      }
 	    }
-	    for(; i<35; i++) { // Check signals, etc.
+	    for(; i<N_PFD; i++) { // Check signals, ADC, input devices, etc.
 	      if(p[i].revents) { // Event received?
-	        pollHandler(i);
+	        if(pollHandler(i)) changed = true;
 	        p[i].revents = 0;
 	      }
 	    }
-	    // Else timeout occurred
+	    // GPIO, MCP and ADC pins take the wake time; evdev pins were
+	    // stamped with their source event times as read
+	    if(changed) edgeMark(prev, wakeTime);
+	  }
+	  if(seqPos < nSeq) seqRun(usNow());
+	  now = msNow();
+	  if(runNext && (now >= runNext)) runNext = runCheck(now, false);
+	  if(changed) { // (Re)start debounce interval
+	    timeout  = debounceTime;
+	    deadline = now + timeout;
+	  }
+	  if((timeout < 0) || (now < deadline)) {
+	    // No timeout due yet
 	  } else if(timeout == debounceTime) { // Debounce timeout
 	    memset(pressMask, 0, sizeof(pressMask));
 	    uint8_t  a;
 	    uint32_t b;
-	    for(a=i=0; a<5; a++) {
-	      for(b=1; b; b <<= 1, i++) { // i=0 to 159
+	    int      k;
+	    seqRun(INT64_MAX); // Any frames still held back go first
+	    nSeq = seqPos = 0;
+	    for(a=i=0; a<N_WORDS; a++) {
+	      for(b=1; b && (i<N_PINS); b <<= 1, i++) { // i=0 to N_PINS-1
 	        if((key[i] > KEY_RESERVED) && (key[i] < GND)) {
 	          // Compare internal state against previously-issued value.
 	          // Send keys only for changed states.
@@ -1136,32 +4078,45 @@ int main(int argc, char *argv[]) {
 	            // it'd be doing about the same thing behind the scenes,
 	            // but might be more legible in source form.
 	            extstate[a] = (extstate[a] & ~b) | (intstate[a] & b);
-	            keyEv.code  = key[i];
-	            keyEv.value = ((intstate[a] & b) > 0);
-	            write(keyfd, &keyEv, sizeof(keyEv));
+	            // Insert into seq[] by edge time; ties stay in pin order
+	            for(k=nSeq++; k && (seq[k-1].t > edgeTime[i]); k--)
+	              seq[k] = seq[k-1];
+	            seq[k].t     = edgeTime[i];
+	            seq[k].pin   = i;
+	            seq[k].value = (intstate[a] & b) > 0;
 	            c = 1; // Follow w/SYN event
-	            if(intstate[a] & b) { // Press?
-	              // Note pressed key and set initial repeat interval.
-	              lastKey = i;
-	              timeout = repTime1;
-	              if(debug >= 3) {
-	                printf("%s: GPIO%02d key press code %d\n",
-	                  __progname, i, key[i]);
-	              }
-	            } else { // Release?
-	              // Stop repeat and return to normal IRQ monitoring
-	              // (no timeout).
-	              lastKey = timeout = -1;
-	              if(debug >= 3) {
-	                printf("%s: GPIO%02d key release code %d\n",
-	                  __progname, i, key[i]);
-	              }
-	            }
+	          } else {
+	            edgeCount[i] = 0; // Any edges were a glitch; start over
 	          }
 	          if(intstate[a] & b) pressMask[a] |= b;
 	        }
 	      }
 	    }
+	    for(k=0; k<nSeq; k++) { // In edge-time order...
+	      i = seq[k].pin;
+	      if(seq[k].value) { // Press?
+	        // Note pressed key and set initial repeat interval.
+	        lastKey = i;
+	        timeout = repTime1;
+	        if(health && ((i < ADC_PIN0) || (i >= GPIO_PIN1)))
+	          healthNote(i); // Switch (native or MCP) bounce stats
+	        if(debug >= 3) {
+	          printf("%s: GPIO%02d key press code %d\n",
+	            __progname, i, key[i]);
+	        }
+	      } else { // Release?
+	        // Stop repeat and return to normal IRQ monitoring
+	        // (no timeout).
+	        lastKey = timeout = -1;
+	        if(debug >= 3) {
+	          printf("%s: GPIO%02d key release code %d\n",
+	            __progname, i, key[i]);
+	        }
+	      }
+	      edgeCount[i] = 0;
+	      if(order == ORDER_FRAME) outQueue(EV_KEY, key[i], seq[k].value);
+	    }
+	    if(nRun) runNext = runCheck(now, true);
 	    // There's an occasional case where it seems the MCP will
 	    // trigger a pin-change IRQ but then the GPIO pin state
 	    // reverts to its prior value due to switch bounce; this
@@ -1170,30 +4125,40 @@ int main(int argc, char *argv[]) {
 	    // (SYN event flag) as timeout reset fallback.  If not
 	    // reset, the debounce code above is called on every pass
 	    // regardless whether input is received, wasting CPU cycles.
-	    if(!c) timeout = -1;
+	    if(!c) {
+	      timeout = -1;
+	    } else if(order == ORDER_FRAME) { // Earliest edge, then SYN below
+	      outQueue(EV_MSC, MSC_TIMESTAMP, (int32_t)seq[0].t);
+	      seqPos = nSeq; // All output
+	    } else { // One frame each; first now, others now or when due
+	      seqBase = usNow();
+	      seqPos  = 0;
+	      seqRun((order == ORDER_SPLIT) ? INT64_MAX : seqBase);
+	      c       = 0; // Frames have their own SYNs
+	    }
 
 	    // If the "Vulcan nerve pinch" buttons are pressed,
 	    // set long timeout -- if this time elapses without
 	    // a button state change, esc keypress will be sent.
-	    if(key[160] != KEY_RESERVED) { // Any vulcan key defined?
-	      for(a=0; (a<5) &&
+	    if(key[VULCAN] != KEY_RESERVED) { // Any vulcan key defined?
+	      for(a=0; (a<N_WORDS) &&
 	       ((pressMask[a] & vulcanMask[a]) == vulcanMask[a]); a++);
-	      if(a == 5) timeout = vulcanTime;
+	      if(a == N_WORDS) timeout = vulcanTime;
 	    }
+	    deadline = now + timeout;
 	  } else if(timeout == vulcanTime) { // Vulcan key timeout
 	    // Send keycode (MAME exits or displays exit menu)
-	    keyEv.code = key[160];
 	    if(debug >= 3) {
-	      printf("%s: GPIO combo %04X%04X%04X%04X%04X press, "
-	        "release code %d\n", __progname, vulcanMask[4],
-	        vulcanMask[3], vulcanMask[2], vulcanMask[1], vulcanMask[0],
-	        key[160]);
+	      printf("%s: release code %d for GPIO combo ", __progname,
+	        key[VULCAN]);
+	      printMask(vulcanMask);
 	    }
 	    for(i=1; i>= 0; i--) { // Press, release
-	      keyEv.value = i;
-	      write(keyfd, &keyEv, sizeof(keyEv));
+	      outQueue(EV_KEY, key[VULCAN], i);
+	      outFlush();
 	      usleep(10000); // Be slow, else MAME flakes
-	      write(keyfd, &synEv, sizeof(synEv));
+	      outQueue(EV_SYN, SYN_REPORT, 0);
+	      outFlush();
 	      usleep(10000);
 	    }
 	    timeout = -1; // Return to normal processing
@@ -1201,16 +4166,17 @@ int main(int argc, char *argv[]) {
 	  } else if(lastKey >= 0) { // Else key repeat timeout
 	    if(timeout == repTime1) timeout = repTime2;
 	    else if(timeout > 30)   timeout -= 5; // Accelerate
+	    deadline    = now + timeout;
 	    c           = 1; // Follow w/SYN event
-	    keyEv.code  = key[lastKey];
-	    keyEv.value = 2; // Key repeat event
 	    if(debug >= 3) {
 	      printf("%s: repeating key code %d\n",
-	        __progname, keyEv.code);
+	        __progname, key[lastKey]);
 	    }
-	    write(keyfd, &keyEv, sizeof(keyEv));
+	    outQueue(EV_KEY, key[lastKey], 2); // Key repeat event
 	  }
-	  if(c) write(keyfd, &synEv, sizeof(synEv));
+	  if(c) outQueue(EV_SYN, SYN_REPORT, 0);
+	  // Write this pass's events in one go, unless waiting on POLLOUT
+	  if(p[PFD_OUT].fd < 0) outFlush();
 	}
 
 	// Clean up --------------------------------------------------------